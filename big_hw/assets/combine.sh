@@ -1,30 +1,94 @@
 #!/bin/bash
 
 cd ../src || exit
+# includes of the sources are stripped, headers they need beyond those of the progtest template are listed here
+cat >| ../assets/all_in_one.cpp << 'END'
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+END
+
 grep -vh '^#include' \
   SpreadsheetStructure/CPos.h \
+  Evaluation/CFunctionRef.h \
+  Evaluation/CNumberKernels.h \
+  SpreadsheetStructure/CDependencyGraph.h \
   ExpressionBuilders/CycleDetectionVisitor/CCycleDetectionVisitor.h \
+  Evaluation/CBytecode.h \
   ExpressionBuilders/ASTNodes/CASTNode.h \
   ExpressionBuilders/ASTNodes/BinaryOperationNode.h \
   ExpressionBuilders/ASTNodes/RelationalOperationNode.h \
   ExpressionBuilders/ASTNodes/UnaryOperationNode.h \
   ExpressionBuilders/ASTNodes/FunctionNode.h \
+  ExpressionBuilders/ASTNodes/CASTArena.h \
   ExpressionBuilders/CASTExpressionBuilder.h \
+  ExpressionBuilders/CASTOptimizer.h \
+  ExpressionBuilders/CExpressionTemplate.h \
+  ExpressionBuilders/CExpressionCache.h \
+  SpreadsheetStructure/CCellPool.h \
   SpreadsheetStructure/CCell.h \
+  SpreadsheetStructure/CColumnIndex.h \
+  SpreadsheetStructure/CCellStorage.h \
+  Evaluation/CThreadPool.h \
+  Evaluation/CRecalculationEngine.h \
   SpreadsheetStructure/CRange.h \
+  InputOutputUtilities/CChecksum.h \
+  InputOutputUtilities/CHashingReader.h \
+  InputOutputUtilities/CPartitions.h \
+  InputOutputUtilities/CBinaryFormat.h \
+  InputOutputUtilities/CMappedFile.h \
   InputOutputUtilities/CLoader.h \
-  CSpreadsheet.h >| ../assets/all_in_one.cpp
+  CSpreadsheet.h >> ../assets/all_in_one.cpp
 
 grep -vh '^#include' \
   SpreadsheetStructure/CPos.cpp \
+  Evaluation/CNumberKernels.cpp \
+  SpreadsheetStructure/CDependencyGraph.cpp \
   ExpressionBuilders/CycleDetectionVisitor/CCycleDetectionVisitor.cpp \
   ExpressionBuilders/ASTNodes/CASTNode.cpp \
   ExpressionBuilders/ASTNodes/BinaryOperationNode.cpp \
   ExpressionBuilders/ASTNodes/RelationalOperationNode.cpp \
   ExpressionBuilders/ASTNodes/UnaryOperationNode.cpp \
   ExpressionBuilders/ASTNodes/FunctionNode.cpp \
+  ExpressionBuilders/ASTNodes/CASTArena.cpp \
+  Evaluation/CBytecode.cpp \
   ExpressionBuilders/CASTExpressionBuilder.cpp \
+  ExpressionBuilders/CASTOptimizer.cpp \
+  ExpressionBuilders/CExpressionTemplate.cpp \
+  ExpressionBuilders/CExpressionCache.cpp \
+  SpreadsheetStructure/CCellPool.cpp \
   SpreadsheetStructure/CCell.cpp \
+  SpreadsheetStructure/CColumnIndex.cpp \
+  SpreadsheetStructure/CCellStorage.cpp \
+  Evaluation/CThreadPool.cpp \
+  Evaluation/CRecalculationEngine.cpp \
   SpreadsheetStructure/CRange.cpp \
+  InputOutputUtilities/CChecksum.cpp \
+  InputOutputUtilities/CHashingReader.cpp \
+  InputOutputUtilities/CPartitions.cpp \
+  InputOutputUtilities/CBinaryFormat.cpp \
+  InputOutputUtilities/CMappedFile.cpp \
   InputOutputUtilities/CLoader.cpp \
-  CSpreadsheet.cpp >> ../assets/all_in_one.cpp
\ No newline at end of file
+  CSpreadsheet.cpp >> ../assets/all_in_one.cpp
+
+# the combined source must compile after the includes and declarations of the progtest template
+sed -n '2,/^using CValue/p' ../assets/template.cpp | cat - ../assets/all_in_one.cpp |
+  g++ -std=c++20 -fsyntax-only -I../assets -x c++ - || exit
@@ -0,0 +1,34 @@
+#include "src/CSpreadsheet.h"
+#include "tests/Benchmark.h"
+
+// Size of allocated memory is stored before the memory, the header keeps the memory aligned.
+constexpr size_t HEADER = alignof(max_align_t);
+
+// Counts heap allocations and memory in use for the benchmark report.
+void *operator new(size_t size) {
+    Benchmark::allocations++;
+    if (auto *memory = static_cast<char *>(malloc(size + HEADER))) {
+        *reinterpret_cast<size_t *>(memory) = size;
+        Benchmark::allocate(size);
+        return memory + HEADER;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    if (memory == nullptr) {
+        return;
+    }
+    char *start = static_cast<char *>(memory) - HEADER;
+    Benchmark::used -= *reinterpret_cast<size_t *>(start);
+    free(start);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+int main() {
+    Benchmark::runAll();
+    return EXIT_SUCCESS;
+}
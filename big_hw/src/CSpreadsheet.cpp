@@ -2,107 +2,420 @@
 // Created by bardanik on 11/04/24.
 //
 
+#include <algorithm>
 #include "CSpreadsheet.h"
 
 
 CSpreadsheet::CSpreadsheet(const CSpreadsheet &src) {
-    for (const auto &row_element: src.m_cells) {
-        int row = row_element.first;
-        for (const auto &col_element: row_element.second) {
-            int col = col_element.first;
-            shared_ptr<CCell> copy = shared_ptr<CCell>(col_element.second->copy());
-            setCell(m_cells, {row, col}, copy);
-        }
-    }
+    // the pastes are applied to the source once, so the copy and the source share the pasted cells
+    src.materialize();
+    m_cells = src.m_cells;
+    m_graph = src.m_graph;
+    m_thread_count = src.m_thread_count;
 }
 
 CSpreadsheet &CSpreadsheet::operator=(CSpreadsheet src) {
     swap(m_cells, src.m_cells);
+    swap(m_graph, src.m_graph);
+    swap(m_thread_count, src.m_thread_count);
+    swap(m_pool, src.m_pool);
+    swap(m_pastes, src.m_pastes);
+    m_pending.store(!m_pastes.empty(), memory_order_release);
     return *this;
 }
 
 
+void CSpreadsheet::setThreadCount(unsigned count) {
+    count = max(count, 1u);
+    if (count != m_thread_count) {
+        m_pool = nullptr;
+    }
+    m_thread_count = count;
+}
+
+unsigned CSpreadsheet::getThreadCount() const {
+    return m_thread_count;
+}
+
+CThreadPool *CSpreadsheet::getThreadPool() const {
+    // const operations, e.g. saving, can be called concurrently, the pool serializes their runs
+    lock_guard<mutex> lock(m_pool_mutex);
+    if (m_thread_count > 1 && m_pool == nullptr) {
+        m_pool = make_unique<CThreadPool>(m_thread_count);
+    }
+    return m_pool.get();
+}
+
+void CSpreadsheet::setRangeIndex(bool enabled) {
+    materialize();
+    m_cells.setRangeIndex(enabled);
+}
+
 bool CSpreadsheet::load(istream &is) {
     CLoader loader(is);
-    Cells loaded;
-    bool ok = loader.load(loaded);
-    if (!ok) {
+    loader.setThreadPool(getThreadPool());
+    return loadCells([&loader](CCellStorage &cells) {
+        return loader.load(cells);
+    });
+}
+
+bool CSpreadsheet::loadFile(const string &filename) {
+    CLoader loader(filename);
+    loader.setThreadPool(getThreadPool());
+    return loadCells([&loader](CCellStorage &cells) {
+        return loader.load(cells);
+    });
+}
+
+template<typename Load>
+bool CSpreadsheet::loadCells(Load load) {
+    materialize();
+    // the loader stages the cells itself, the container is replaced only if the loading succeeds
+    if (!load(m_cells)) {
         return false;
     }
-    m_cells = loaded;
+    m_graph.clear();
+    m_cells.forEach([this](const pair<int, int> &coords, CCell &cell) {
+        registerReferences(coords, cell);
+    });
     return true;
 }
 
 bool CSpreadsheet::save(ostream &os) const {
+    return save(os, CLoader::TEXT);
+}
+
+bool CSpreadsheet::save(ostream &os, CLoader::EFormat format) const {
+    materialize();
     CLoader loader(os);
-    return loader.save(m_cells);
+    loader.setThreadPool(getThreadPool());
+    return loader.save(m_cells, format);
 }
 
 bool CSpreadsheet::setCell(CPos pos, string contents) {
-    CCell *cell = CCell::createCell(contents);
-    auto to_set = shared_ptr<CCell>(cell);
-    return setCell(m_cells, pos, to_set);
+    auto coords = pos.getCoords();
+    bool pending = keepWritten(coords);
+    CCellHandle handle = CCell::createCell(m_cells.getPool(), contents);
+    // number cells are released when they are set, so the references are registered before
+    registerReferences(coords, *m_cells.getPool().find(handle));
+    if (!setCell(m_cells, pos, handle)) {
+        return false;
+    }
+    invalidate({coords, coords});
+    // cells of pending pastes are not placed yet, so cycles through them are left for evaluation
+    if (!pending) {
+        detectCycle(coords);
+    }
+    return true;
 }
 
 
-bool CSpreadsheet::setCell(Cells &cells, const CPos &pos, shared_ptr<CCell> &cell) {
-    auto [row, col] = pos.getCoords();
-    auto row_element = cells.find(row);
-    if (row_element == cells.end()) {
-        cells.insert({row, {{col, cell}}});
-        return true;
-    }
-    auto col_element = row_element->second.find(col);
-    if (col_element == row_element->second.end()) {
-        row_element->second.insert({col, cell});
-        return true;
-    }
-    col_element->second = cell;
+bool CSpreadsheet::setCell(CCellStorage &cells, const CPos &pos, CCellHandle cell) {
+    cells.set(pos.getCoords(), cell);
     return true;
 }
 
 
 CValue CSpreadsheet::getValue(CPos pos) {
-    auto [row, col] = pos.getCoords();
-    auto row_element = m_cells.find(row);
-    if (row_element == m_cells.end()) {
-        return {};
-    }
-    auto col_element = row_element->second.find(col);
-    if (col_element == row_element->second.end()) {
-        return {};
-    }
-    try {
-        CCycleDetectionVisitor visitor;
-        return col_element->second->getValue(*this, visitor);
-    } catch (CCycleDetectedException &e) {
-        return {};
+    materialize();
+    auto coords = pos.getCoords();
+    CCell *cell = m_cells.find(coords);
+    if (cell == nullptr) {
+        return numberValue(coords);
     }
+    m_cells.refreshIndexes();
+    CRecalculationEngine(*this, getThreadPool()).recalculate(coords);
+    // a cell ending in a cycle is evaluated as undefined
+    CCycleDetectionVisitor visitor;
+    return cell->getValue(*this, visitor);
 }
 
 
 CValue CSpreadsheet::getValue(CPos pos, CCycleDetectionVisitor &visitor) {
-    auto [row, col] = pos.getCoords();
-    auto row_element = m_cells.find(row);
-    if (row_element == m_cells.end()) {
-        return {};
+    materialize();
+    auto coords = pos.getCoords();
+    CCell *cell = m_cells.find(coords);
+    if (cell == nullptr) {
+        return numberValue(coords);
     }
-    auto col_element = row_element->second.find(col);
-    if (col_element == row_element->second.end()) {
-        return {};
-    }
-    return col_element->second->getValue(*this, visitor);
+    return cell->getValue(*this, visitor);
 }
 
 
 void CSpreadsheet::copyRect(CPos dst, CPos src, int w, int h) {
-    CRange range(*this);
-    range.select(src, w, h);
-    range.paste(dst);
+    if (m_pastes.size() >= PENDING_PASTES) {
+        materialize();
+    }
+    PendingPaste paste{src, dst, w, h, {}};
+    Rect rewritten = paste.destination();
+    // a pending paste is dropped if the new paste rewrites all its cells and no later paste copies them
+    vector<Rect> read = {paste.source()};
+    for (size_t i = m_pastes.size(); i-- > 0;) {
+        Rect pasted = m_pastes[i].destination();
+        bool is_rewritten = contains(rewritten, pasted.first) && contains(rewritten, pasted.second);
+        bool is_read = any_of(read.begin(), read.end(), [&pasted](const Rect &source) {
+            return source.first.first <= pasted.second.first && pasted.first.first <= source.second.first
+                   && source.first.second <= pasted.second.second && pasted.first.second <= source.second.second;
+        });
+        if (is_rewritten && !is_read) {
+            m_pastes.erase(m_pastes.begin() + static_cast<long>(i));
+            continue;
+        }
+        read.push_back(m_pastes[i].source());
+    }
+    m_pastes.push_back(paste);
+    m_pending.store(true, memory_order_release);
 }
 
-Cells &CSpreadsheet::getCells() {
+CCellStorage &CSpreadsheet::getCells() {
+    materialize();
     return m_cells;
 }
 
+vector<CPos> CSpreadsheet::dependentsOf(CPos pos, bool transitive) const {
+    materialize();
+    return collect(pos.getCoords(), transitive, [this](const pair<int, int> &coords) {
+        return m_graph.dependentsOf({coords, coords});
+    });
+}
+
+vector<CPos> CSpreadsheet::precedentsOf(CPos pos, bool transitive) const {
+    materialize();
+    return collect(pos.getCoords(), transitive, [this](const pair<int, int> &coords) {
+        return getPrecedents(coords, true);
+    });
+}
+
+CDependencyGraph &CSpreadsheet::getDependencyGraph() {
+    materialize();
+    return m_graph;
+}
+
+CExpressionCache &CSpreadsheet::getExpressionCache() {
+    return m_expressions;
+}
+
+const CExpressionCache &CSpreadsheet::getExpressionCache() const {
+    return m_expressions;
+}
+
+void CSpreadsheet::registerReferences(const pair<int, int> &coords, CCell &cell) {
+    m_graph.setReferences(coords, cell.build(*this));
+}
+
+void CSpreadsheet::invalidate(const Rect &changed) const {
+    queue<pair<int, int>> to_invalidate;
+    for (const auto &dependent: m_graph.dependentsOf(changed)) {
+        to_invalidate.push(dependent);
+    }
+    // Cells without computed value can be skipped, because cells that used their value were invalidated before.
+    while (!to_invalidate.empty()) {
+        auto coords = to_invalidate.front();
+        to_invalidate.pop();
+        CCell *cell = findCell(coords);
+        if (cell == nullptr || !cell->invalidate()) {
+            continue;
+        }
+        for (const auto &dependent: m_graph.dependentsOf({coords, coords})) {
+            to_invalidate.push(dependent);
+        }
+    }
+}
+
+vector<pair<int, int>> CSpreadsheet::getPrecedents(const pair<int, int> &coords, bool numbers) const {
+    vector<pair<int, int>> precedents;
+    for (const auto &[from, to]: m_graph.precedentsOf(coords)) {
+        if (from == to) {
+            precedents.push_back(from);
+            continue;
+        }
+        m_cells.forEach({from, to}, [&precedents](const pair<int, int> &cell_coords, const CCell &) {
+            precedents.push_back(cell_coords);
+        });
+        if (numbers) {
+            m_cells.forEachNumber({from, to}, [&precedents](const pair<int, int> &number_coords, double) {
+                precedents.push_back(number_coords);
+            });
+        }
+    }
+    return precedents;
+}
+
+template<typename Step>
+vector<CPos> CSpreadsheet::collect(const pair<int, int> &coords, bool transitive, Step step) {
+    set<pair<int, int>> found;
+    queue<pair<int, int>> to_visit;
+    to_visit.push(coords);
+    while (!to_visit.empty()) {
+        auto current = to_visit.front();
+        to_visit.pop();
+        for (const auto &next: step(current)) {
+            if (found.insert(next).second && transitive) {
+                to_visit.push(next);
+            }
+        }
+    }
+    vector<CPos> positions;
+    for (const auto &[row, col]: found) {
+        positions.emplace_back(row, col);
+    }
+    return positions;
+}
+
+CCell *CSpreadsheet::findCell(const pair<int, int> &coords) const {
+    return m_cells.find(coords);
+}
+
+void CSpreadsheet::materialize() const {
+    // every reference of an evaluated expression gets here, so the lock is taken only if there are pastes
+    if (!m_pending.load(memory_order_acquire)) {
+        return;
+    }
+    lock_guard<mutex> lock(m_paste_mutex);
+    if (m_pastes.empty()) {
+        return;
+    }
+    auto &pool = m_cells.getPool();
+    for (const auto &paste: m_pastes) {
+        // cells written after the paste was recorded are copied aside and placed back over the pasted cells
+        vector<pair<pair<int, int>, CCellHandle>> written;
+        for (const auto &coords: paste.written) {
+            if (const double *number = m_cells.findNumber(coords)) {
+                written.emplace_back(coords, pool.create<CNumberCell>(*number));
+            } else if (const CCell *cell = m_cells.find(coords)) {
+                written.emplace_back(coords, cell->copy(pool));
+            }
+        }
+        applyPaste(paste);
+        for (const auto &[coords, handle]: written) {
+            m_graph.setReferences(coords, pool.find(handle)->getReferences());
+            setCell(m_cells, CPos(coords.first, coords.second), handle);
+            invalidate({coords, coords});
+        }
+    }
+    m_pastes.clear();
+    m_pending.store(false, memory_order_release);
+}
+
+void CSpreadsheet::applyPaste(const PendingPaste &paste) const {
+    auto [from, to] = paste.source();
+    Rect destination = paste.destination();
+    pair<int, int> offset = {destination.first.first - from.first, destination.first.second - from.second};
+    auto &pool = m_cells.getPool();
+    // cells are collected before deleting, because the pasted area can overlap the copied one
+    vector<pair<pair<int, int>, CCellHandle>> cells;
+    m_cells.forEach({from, to}, [&cells, &pool, &offset](const pair<int, int> &coords, const CCell &cell) {
+        cells.push_back({{coords.first + offset.first, coords.second + offset.second}, cell.copy(pool)});
+    });
+    vector<pair<pair<int, int>, double>> numbers;
+    m_cells.forEachNumber({from, to}, [&numbers, &offset](const pair<int, int> &coords, double number) {
+        numbers.push_back({{coords.first + offset.first, coords.second + offset.second}, number});
+    });
+    m_graph.removeReferences(destination);
+    m_cells.erase(destination);
+    for (const auto &[coords, number]: numbers) {
+        m_cells.setNumber(coords, number);
+    }
+    // copied cells were built in this or the copied spreadsheet, so their references are known without building
+    for (const auto &[coords, handle]: cells) {
+        CCell &placed = *pool.find(handle);
+        placed.shift(offset);
+        m_cells.set(coords, handle);
+        m_graph.setReferences(coords, placed.getReferences());
+    }
+    invalidate(destination);
+}
+
+bool CSpreadsheet::keepWritten(const pair<int, int> &coords) {
+    if (m_pastes.empty()) {
+        return false;
+    }
+    for (const auto &paste: m_pastes) {
+        if (contains(paste.source(), coords)) {
+            // the cell is read by a pending paste, so the pastes are applied before it is changed
+            materialize();
+            return false;
+        }
+    }
+    for (auto &paste: m_pastes) {
+        if (contains(paste.destination(), coords)) {
+            paste.written.insert(coords);
+        }
+    }
+    return true;
+}
+
+bool CSpreadsheet::contains(const Rect &area, const pair<int, int> &coords) {
+    return area.first.first <= coords.first && coords.first <= area.second.first
+           && area.first.second <= coords.second && coords.second <= area.second.second;
+}
+
+Rect CSpreadsheet::PendingPaste::source() const {
+    auto [row, col] = src.getCoords();
+    return {{row, col}, {row + h - 1, col + w - 1}};
+}
+
+Rect CSpreadsheet::PendingPaste::destination() const {
+    auto [row, col] = dst.getCoords();
+    return {{row, col}, {row + h - 1, col + w - 1}};
+}
+
+void CSpreadsheet::detectCycle(const pair<int, int> &coords) {
+    // cells which can be searched through, conditional cells do not have to evaluate all their references
+    auto unconditional = [this](const pair<int, int> &cell_coords) -> CExprCell * {
+        auto *cell = dynamic_cast<CExprCell *>(findCell(cell_coords));
+        if (cell == nullptr || cell->getTemplate() == nullptr || cell->isConditional()) {
+            return nullptr;
+        }
+        return cell;
+    };
+    // a cell without dependents cannot be on a cycle, which is the common case of filling new cells
+    CExprCell *root = unconditional(coords);
+    if (root == nullptr || m_graph.dependentsOf({coords, coords}).empty()) {
+        return;
+    }
+
+    // Iterative DFS, the stack is the path from the set cell. Cells with computed values are skipped,
+    // they do not depend on the set cell, because all its dependents were invalidated.
+    CCycleDetectionVisitor visitor;
+    vector<pair<CExprCell *, vector<pair<int, int>>>> path;
+    vector<size_t> next;
+    visitor.reach(root);
+    path.emplace_back(root, getPrecedents(coords));
+    next.push_back(0);
+    size_t searched = 1;
+    while (!path.empty()) {
+        auto &[cell, precedents] = path.back();
+        if (next.back() == precedents.size()) {
+            path.pop_back();
+            next.pop_back();
+            continue;
+        }
+        auto precedent = precedents[next.back()++];
+        if (precedent == coords) {
+            for (const auto &[member, member_precedents]: path) {
+                member->markCyclic();
+            }
+            return;
+        }
+        CExprCell *reached = unconditional(precedent);
+        if (reached == nullptr || reached->isEvaluated() || !visitor.reach(reached)) {
+            continue;
+        }
+        if (++searched > CYCLE_SEARCH_LIMIT) {
+            return;
+        }
+        path.emplace_back(reached, getPrecedents(precedent));
+        next.push_back(0);
+    }
+}
+
+CValue CSpreadsheet::numberValue(const pair<int, int> &coords) const {
+    const double *number = m_cells.findNumber(coords);
+    if (number == nullptr) {
+        return {};
+    }
+    return *number;
+}
+
 
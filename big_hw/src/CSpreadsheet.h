@@ -6,7 +6,15 @@
 #define BARDANIK_CSPREADSHEET_H
 
 
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <queue>
 #include "SpreadsheetStructure/CRange.h"
+#include "SpreadsheetStructure/CDependencyGraph.h"
+#include "Evaluation/CRecalculationEngine.h"
+#include "Evaluation/CNumberKernels.h"
+#include "ExpressionBuilders/CExpressionCache.h"
 #include "InputOutputUtilities/CLoader.h"
 
 constexpr unsigned SPREADSHEET_CYCLIC_DEPS = 0x01;
@@ -24,7 +32,7 @@ public:
      * What functions the spreadsheet supports.
      */
     static unsigned capabilities() {
-        return SPREADSHEET_CYCLIC_DEPS | SPREADSHEET_FILE_IO | SPREADSHEET_FUNCTIONS;
+        return SPREADSHEET_CYCLIC_DEPS | SPREADSHEET_FILE_IO | SPREADSHEET_FUNCTIONS | SPREADSHEET_SPEED;
     }
 
     /**
@@ -33,7 +41,10 @@ public:
     CSpreadsheet() = default;
 
     /**
-     * Copy constructor - makes deep copy of cells.
+     * Copy constructor - makes deep copy of cells. Tiles of the storage with numbers only are shared
+     * with the source and are copied on the first write, so the copies behave as independent spreadsheets,
+     * also when they are changed from different threads. Copying itself must not run concurrently
+     * with changes of the source.
      * @param src - spreadsheet to make deep copy from.
      */
     CSpreadsheet(const CSpreadsheet &src);
@@ -45,6 +56,25 @@ public:
      */
     CSpreadsheet &operator=(CSpreadsheet src);
 
+    /**
+     * Sets number of threads used to evaluate independent cells in parallel and to load and save cells.
+     * @param count - number of threads, 1 evaluates everything in the calling thread.
+     */
+    void setThreadCount(unsigned count);
+
+    /**
+     * Gets number of threads used to evaluate cells.
+     * @return number of threads, at least 1.
+     */
+    unsigned getThreadCount() const;
+
+    /**
+     * Enables or disables indexes of number columns, which are used to aggregate large ranges
+     * in sum, count, min and max functions without reading every number. Indexes are updated with each change.
+     * @param enabled - true to maintain indexes.
+     */
+    void setRangeIndex(bool enabled);
+
     /**
      * Loads spreadsheet from any input stream.
      * @param is - input stream to load this spreadsheet from.
@@ -52,6 +82,13 @@ public:
      */
     bool load(istream &is);
 
+    /**
+     * Loads spreadsheet from a file saved in any format, the file is mapped to memory instead of reading it.
+     * @param filename - path of the file to load this spreadsheet from.
+     * @return true if successfully loaded data to this spreadsheet, in case of error this data are not rewritten.
+     */
+    bool loadFile(const string &filename);
+
     /**
      * Saves this spreadsheet to any output stream.
      * @param os - output stream to save this spreadsheet data.
@@ -59,6 +96,14 @@ public:
      */
     bool save(ostream &os) const;
 
+    /**
+     * Saves this spreadsheet to any output stream in a given format.
+     * @param os - output stream to save this spreadsheet data.
+     * @param format - text format or binary format, which keeps numbers exactly and is faster to load.
+     * @return true if successfully saved data, in case of error this data are not rewritten.
+     */
+    bool save(ostream &os, CLoader::EFormat format) const;
+
     /**
      * Set cell in spreadsheet with content. The content can be a number, string literal, or expression.
      * @param pos - where to set content.
@@ -85,7 +130,10 @@ public:
 
     /**
      * Copy rectangular portion of the spreadsheet and paste it to the another place,
-     * rewriting previous values.
+     * rewriting previous values. The paste is only recorded and it is applied once, when the spreadsheet
+     * is read for the first time or before a copied cell is changed, cells written in the meantime
+     * are kept over the pasted ones.
+     * A paste that is rewritten by a later paste before that is never applied.
      * @param dst - upper left corner where to paste copied rectangular selection.
      * @param src - upper left corner from which to copy rectangular selection.
      * @param w - width of the rectangular selection, w >= 1.
@@ -100,21 +148,202 @@ public:
      * Set cell in provided cells container.
      * @param cells - container in which to set a cell.
      * @param pos - position of the cell to evaluate.
-     * @param cell - cell to assign.
+     * @param cell - handle of a cell created in the pool of the container, the container becomes its owner.
      * @return true if the cell is successfully set.
      */
-    static bool setCell(Cells &cells, const CPos &pos, shared_ptr<CCell> &cell);
+    static bool setCell(CCellStorage &cells, const CPos &pos, CCellHandle cell);
 
     /**
      * Get the container with cells of this spreadsheet.
      * @return container with cells.
      */
-    Cells &getCells();
+    CCellStorage &getCells();
+
+    /**
+     * Finds cells that reference a given position, directly or through a range.
+     * @param pos - referenced position.
+     * @param transitive - if true, cells that depend on the position through other cells are found too.
+     * @return positions of dependent cells, each position only once.
+     */
+    vector<CPos> dependentsOf(CPos pos, bool transitive = false) const;
+
+    /**
+     * Finds cells referenced by the cell on a given position. Single references are returned
+     * even if they point to an empty position, from ranges only non-empty cells are returned.
+     * @param pos - position of the cell.
+     * @param transitive - if true, cells referenced by the found cells are found too.
+     * @return positions of referenced cells, each position only once.
+     */
+    vector<CPos> precedentsOf(CPos pos, bool transitive = false) const;
+
+    /**
+     * Get the graph of references between cells of this spreadsheet.
+     * @return dependency graph.
+     */
+    CDependencyGraph &getDependencyGraph();
+
+    /**
+     * Prepares the cell placed at some position for evaluation and stores its references
+     * in the dependency graph, replacing references of the cell which was there before.
+     * @param coords - coordinates where the cell is placed.
+     * @param cell - the placed cell.
+     */
+    void registerReferences(const pair<int, int> &coords, CCell &cell);
+
+    /**
+     * Drops computed values of all cells that depend directly or transitively on some changed positions.
+     * Must be called every time cells in the spreadsheet are set, rewritten or deleted.
+     * @param changed - rectangle of positions which were changed.
+     */
+    void invalidate(const Rect &changed) const;
+
+    /**
+     * Finds direct precedents of a cell, expanding ranges to non-empty cells in them.
+     * @param coords - coordinates of the cell.
+     * @param numbers - if false, number cells in ranges are skipped, they never have to be evaluated.
+     * @return coordinates of referenced cells, can contain duplicates.
+     */
+    vector<pair<int, int>> getPrecedents(const pair<int, int> &coords, bool numbers = false) const;
+
+    /**
+     * Finds a string or expression cell on a given position, number cells are stored only as values.
+     * @param coords - coordinates of the cell.
+     * @return pointer to the cell or nullptr if there is no such cell.
+     */
+    CCell *findCell(const pair<int, int> &coords) const;
+
+    /**
+     * Get the cache of parsed expressions of this spreadsheet, cells with the same expression share
+     * one parsed expression. Hits and misses of the cache can be read from it.
+     * @return cache of parsed expressions.
+     */
+    CExpressionCache &getExpressionCache();
+
+    /**
+     * Get the cache of parsed expressions of this spreadsheet to read its counters.
+     * @return cache of parsed expressions.
+     */
+    const CExpressionCache &getExpressionCache() const;
 
 private:
 
-    // Container for storing cells.
-    Cells m_cells;
+    /**
+     * Paste recorded by copyRect, which was not applied to the cells yet.
+     */
+    struct PendingPaste {
+        // Upper left corner of the copied rectangle.
+        CPos src;
+        // Upper left corner where the rectangle is pasted.
+        CPos dst;
+        // Width and height of the rectangle.
+        int w, h;
+        // Cells of the destination written after the paste was recorded, they are kept when the paste is applied.
+        set<pair<int, int>> written;
+
+        /**
+         * Gets the copied rectangle.
+         */
+        Rect source() const;
+
+        /**
+         * Gets the rectangle where the cells are pasted.
+         */
+        Rect destination() const;
+    };
+
+    /**
+     * Applies pending pastes in the order they were recorded. Is called before every operation which
+     * reads cells, so the pending pastes are not observable. Const operations apply them too, the cells
+     * hold the pasted state once it is computed, and concurrent const operations apply them only once.
+     */
+    void materialize() const;
+
+    /**
+     * Copies cells of one paste to its destination, materialize() has to hold the lock of the pastes.
+     * @param paste - the applied paste.
+     */
+    void applyPaste(const PendingPaste &paste) const;
+
+    /**
+     * Prepares pending pastes for writing a cell. If the cell is read by a pending paste, the pastes are applied,
+     * otherwise the cell is written right away and pending pastes which rewrite it keep it when they are applied.
+     * @param coords - coordinates of the written cell.
+     * @return true if some pastes are still pending.
+     */
+    bool keepWritten(const pair<int, int> &coords);
+
+    /**
+     * Checks if a rectangle contains a position.
+     * @param area - the rectangle.
+     * @param coords - coordinates of the position.
+     * @return true if the position is inside the rectangle.
+     */
+    static bool contains(const Rect &area, const pair<int, int> &coords);
+
+    /**
+     * Searches for a cycle through a cell that was just set, while the dependency graph is at hand.
+     * If the cell references itself through cells that are not conditional, all cells of the cycle
+     * are marked as cyclic, so their evaluation fails immediately. Other cycles are left for evaluation.
+     * @param coords - coordinates of the set cell.
+     */
+    void detectCycle(const pair<int, int> &coords);
+
+    /**
+     * Gets threads used for parallel work, they are started the first time they are needed.
+     * @return the threads or nullptr if this spreadsheet uses only one thread.
+     */
+    CThreadPool *getThreadPool() const;
+
+    /**
+     * Loads cells of this spreadsheet and registers their references if the loading succeeds.
+     * @tparam Load - callable loading cells to a given storage, returns false and keeps the storage on failure.
+     * @param load - function loading the cells.
+     * @return true if successfully loaded.
+     */
+    template<typename Load>
+    bool loadCells(Load load);
+
+    /**
+     * Gets value of a number cell.
+     * @param coords - coordinates of the cell.
+     * @return the number or undefined value if there is no number cell.
+     */
+    CValue numberValue(const pair<int, int> &coords) const;
+
+    /**
+     * Collects positions reachable from a given position by some step.
+     * @tparam Step - callable returning direct neighbours of coordinates.
+     * @param coords - coordinates from which to start.
+     * @param transitive - if false, only direct neighbours are returned.
+     * @param step - gets direct neighbours.
+     * @return reached positions, without the starting one if it is not on a cycle.
+     */
+    template<typename Step>
+    static vector<CPos> collect(const pair<int, int> &coords, bool transitive, Step step);
+
+    // Maximal number of pending pastes, older pastes are applied when a paste is recorded over the limit.
+    static constexpr size_t PENDING_PASTES = 64;
+    // Maximal number of cells searched for a cycle when setting a cell, larger searches are left for evaluation.
+    static constexpr size_t CYCLE_SEARCH_LIMIT = 256;
+
+    // Container for storing cells, const operations can apply pending pastes to it.
+    mutable CCellStorage m_cells;
+    // References between cells, changed together with the cells.
+    mutable CDependencyGraph m_graph;
+    // Parsed expressions shared by cells, are not copied, parsed trees reference their spreadsheet.
+    mutable CExpressionCache m_expressions;
+    // Number of threads used for evaluation.
+    unsigned m_thread_count = 1;
+    // Threads for parallel evaluation, loading and saving, started when they are needed for the first time.
+    mutable unique_ptr<CThreadPool> m_pool;
+    // Guards creating the threads by const operations.
+    mutable mutex m_pool_mutex;
+    // Pastes recorded by copyRect, which were not applied yet, in the order they were recorded.
+    mutable vector<PendingPaste> m_pastes;
+    // If some pastes are pending, is checked before the lock is taken.
+    mutable atomic<bool> m_pending = false;
+    // Guards applying the pastes by const operations.
+    mutable mutex m_paste_mutex;
 
 };
 
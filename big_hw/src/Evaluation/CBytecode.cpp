@@ -0,0 +1,491 @@
+//
+// Created by bardanik on 22/05/24.
+//
+
+#include <cmath>
+#include "../CSpreadsheet.h"
+#include "CBytecode.h"
+
+namespace {
+    /**
+     * Adds two values - numbers are summed, strings are concatenated, a number is converted to string
+     * if added to a string.
+     */
+    CValue add(const CValue &left, const CValue &right) {
+        if (holds_alternative<double>(left)) {
+            if (holds_alternative<double>(right)) {
+                return get<double>(left) + get<double>(right);
+            }
+            if (holds_alternative<string>(right)) {
+                return to_string(get<double>(left)) + get<string>(right);
+            }
+        } else if (holds_alternative<string>(left)) {
+            if (holds_alternative<double>(right)) {
+                return get<string>(left) + to_string(get<double>(right));
+            }
+            if (holds_alternative<string>(right)) {
+                return get<string>(left) + get<string>(right);
+            }
+        }
+        return {};
+    }
+
+    /**
+     * Applies arithmetic operation on two numbers, division by zero is checked by the caller.
+     */
+    double arithmetic(CBytecode::OpCode op, double lhs, double rhs) {
+        switch (op) {
+            case CBytecode::SUBTRACT:
+                return lhs - rhs;
+            case CBytecode::MULTIPLY:
+                return lhs * rhs;
+            case CBytecode::DIVIDE:
+                return lhs / rhs;
+            default:
+                return pow(lhs, rhs);
+        }
+    }
+
+    /**
+     * Applies arithmetic operation on two values, values which are not numbers and division by zero
+     * give undefined value.
+     */
+    CValue arithmetic(CBytecode::OpCode op, const CValue &left, const CValue &right) {
+        if (!holds_alternative<double>(left) || !holds_alternative<double>(right)) {
+            return {};
+        }
+        if (op == CBytecode::DIVIDE && get<double>(right) == 0) {
+            return {};
+        }
+        return arithmetic(op, get<double>(left), get<double>(right));
+    }
+
+    /**
+     * Compares two numbers or two strings.
+     */
+    template<typename T>
+    bool compare(CBytecode::OpCode op, const T &lhs, const T &rhs) {
+        switch (op) {
+            case CBytecode::EQUAL:
+                return lhs == rhs;
+            case CBytecode::NOT_EQUAL:
+                return lhs != rhs;
+            case CBytecode::LESS:
+                return lhs < rhs;
+            case CBytecode::LESS_EQUAL:
+                return lhs <= rhs;
+            case CBytecode::GREATER:
+                return lhs > rhs;
+            default:
+                return lhs >= rhs;
+        }
+    }
+
+    /**
+     * Applies relational operation on two numbers or two strings, other values give undefined value.
+     */
+    CValue relational(CBytecode::OpCode op, const CValue &left, const CValue &right) {
+        if (holds_alternative<double>(left) && holds_alternative<double>(right)) {
+            return static_cast<double>(compare(op, get<double>(left), get<double>(right)));
+        }
+        if (holds_alternative<string>(left) && holds_alternative<string>(right)) {
+            return static_cast<double>(compare(op, get<string>(left), get<string>(right)));
+        }
+        return {};
+    }
+}
+
+CBytecode::CBytecode(CSpreadsheet &spreadsheet) : m_spreadsheet(spreadsheet) {
+
+}
+
+size_t CBytecode::emit(OpCode op, uint32_t arg) {
+    // operands are popped from the inferred types and the result is a number if all operands are numbers
+    bool number = true;
+    switch (op) {
+        case CONSTANT:
+            number = holds_alternative<double>(m_constants[arg]);
+            m_types.push_back(number);
+            m_max_depth = max(m_max_depth, ++m_depth);
+            break;
+        case REFERENCE:
+        case SUM_RANGE:
+        case COUNT_RANGE:
+        case MIN_RANGE:
+        case MAX_RANGE:
+            // values known only at runtime are expected to be numbers
+            m_types.push_back(true);
+            m_max_depth = max(m_max_depth, ++m_depth);
+            break;
+        case NEGATE:
+        case NUMBER_VALUE:
+        case TEST:
+            number = m_types.back();
+            break;
+        case COUNTVAL_RANGE:
+        case COUNT_VALUE:
+            number = m_types.back();
+            m_types.back() = true;
+            break;
+        case JUMP:
+        case LOAD:
+        case STORE:
+            break;
+        case BRANCH:
+            number = m_types.back();
+            m_types.pop_back();
+            m_depth--;
+            break;
+        default:
+            number = m_types.back() && m_types[m_types.size() - 2];
+            m_types.pop_back();
+            m_types.back() = number;
+            m_depth--;
+    }
+    m_numeric = m_numeric && number;
+    m_instructions.push_back({op, arg});
+    return m_instructions.size() - 1;
+}
+
+void CBytecode::setTarget(size_t position) {
+    m_instructions[position].arg = static_cast<uint32_t>(m_instructions.size());
+}
+
+uint32_t CBytecode::addConstant(const CValue &value) {
+    m_constants.push_back(value);
+    return static_cast<uint32_t>(m_constants.size() - 1);
+}
+
+uint32_t CBytecode::addReference(const CPos &position) {
+    m_references.push_back(position);
+    return static_cast<uint32_t>(m_references.size() - 1);
+}
+
+uint32_t CBytecode::addRange(const CPos &from, const CPos &to) {
+    m_ranges.emplace_back(from, to);
+    return static_cast<uint32_t>(m_ranges.size() - 1);
+}
+
+void CBytecode::share(const string &expression) {
+    m_shared.emplace(expression, NO_SLOT);
+}
+
+bool CBytecode::findShared(const string &expression, uint32_t &slot) {
+    auto found = m_shared.find(expression);
+    if (found == m_shared.end()) {
+        return false;
+    }
+    if (found->second == NO_SLOT) {
+        if (m_slots == MAX_SLOTS) {
+            return false;
+        }
+        found->second = m_slots++;
+    }
+    slot = found->second;
+    return true;
+}
+
+vector<string> CBytecode::getShared() const {
+    vector<string> shared(m_slots);
+    for (const auto &[expression, slot]: m_shared) {
+        if (slot != NO_SLOT) {
+            shared[slot] = expression;
+        }
+    }
+    return shared;
+}
+
+CValue CBytecode::evaluate(CCycleDetectionVisitor &visitor) const {
+    return evaluate(m_numeric, visitor);
+}
+
+CValue CBytecode::evaluateGeneric(CCycleDetectionVisitor &visitor) const {
+    return evaluate(false, visitor);
+}
+
+bool CBytecode::isNumeric() const {
+    return m_numeric;
+}
+
+CValue CBytecode::evaluate(bool numeric, CCycleDetectionVisitor &visitor) const {
+    size_t size = m_slots + m_max_depth;
+    if (size <= LOCAL_STACK) {
+        double numbers[LOCAL_STACK];
+        CValue values[LOCAL_STACK];
+        return evaluate(numbers, values, numeric, visitor);
+    }
+    vector<double> numbers(numeric ? size : 0);
+    vector<CValue> values(size);
+    return evaluate(numbers.data(), values.data(), numeric, visitor);
+}
+
+CValue CBytecode::evaluate(double *numbers, CValue *values, bool numeric, CCycleDetectionVisitor &visitor) const {
+    size_t depth = 0, next = 0;
+    uint32_t loaded = 0;
+    CValue result;
+    if (numeric) {
+        if (execute(numbers + m_slots, loaded, depth, next, result, visitor)) {
+            return numbers[m_slots + depth - 1];
+        }
+        // continue by the generic path from the instruction after the one that gave not a number
+        for (uint32_t slot = 0; slot < m_slots; slot++) {
+            if (loaded >> slot & 1) {
+                values[slot] = numbers[slot];
+            }
+        }
+        copy(numbers + m_slots, numbers + m_slots + depth, values + m_slots);
+        values[m_slots + depth++] = std::move(result);
+    }
+    execute(values + m_slots, loaded, depth, next, result, visitor);
+    return std::move(values[m_slots + depth - 1]);
+}
+
+template<typename Value>
+bool CBytecode::execute(Value *stack, uint32_t &loaded, size_t &depth, size_t &next, CValue &result,
+                        CCycleDetectionVisitor &visitor) const {
+    constexpr bool numeric = is_same_v<Value, double>;
+    Value *slots = stack - m_slots;
+    // top points after the last value on the stack
+    Value *top = stack + depth;
+    // stops the double-only path after the instruction i, whose result is not a number and was popped from the stack
+    auto stop = [stack, &top, &depth, &next](size_t i) {
+        depth = top - stack;
+        next = i + 1;
+        return false;
+    };
+    size_t size = m_instructions.size();
+    for (size_t i = next; i < size; i++) {
+        auto [op, arg] = m_instructions[i];
+        switch (op) {
+            case CONSTANT:
+                if constexpr (numeric) {
+                    *top++ = get<double>(m_constants[arg]);
+                } else {
+                    *top++ = m_constants[arg];
+                }
+                break;
+            case REFERENCE:
+                if (!reference(arg, *top, result, visitor)) {
+                    return stop(i);
+                }
+                top++;
+                break;
+            case ADD:
+            case SUBTRACT:
+            case MULTIPLY:
+            case DIVIDE:
+            case POWER:
+            case EQUAL:
+            case NOT_EQUAL:
+            case LESS:
+            case LESS_EQUAL:
+            case GREATER:
+            case GREATER_EQUAL: {
+                const Value &right = *--top;
+                Value &left = top[-1];
+                if constexpr (numeric) {
+                    if (op == ADD) {
+                        left += right;
+                    } else if (op == DIVIDE && right == 0) {
+                        result = {};
+                        --top;
+                        return stop(i);
+                    } else if (op < EQUAL) {
+                        left = arithmetic(op, left, right);
+                    } else {
+                        left = static_cast<double>(compare(op, left, right));
+                    }
+                } else if (op == ADD) {
+                    left = add(left, right);
+                } else if (op < EQUAL) {
+                    left = arithmetic(op, left, right);
+                } else {
+                    left = relational(op, left, right);
+                }
+                break;
+            }
+            case NEGATE:
+                if constexpr (numeric) {
+                    top[-1] = -top[-1];
+                } else if (holds_alternative<double>(top[-1])) {
+                    top[-1] = -get<double>(top[-1]);
+                } else {
+                    top[-1] = {};
+                }
+                break;
+            case SUM_RANGE:
+            case COUNT_RANGE:
+            case MIN_RANGE:
+            case MAX_RANGE:
+                if constexpr (numeric) {
+                    result = evaluateRange(op, arg, {}, visitor);
+                    if (!holds_alternative<double>(result)) {
+                        return stop(i);
+                    }
+                    *top++ = get<double>(result);
+                } else {
+                    *top++ = evaluateRange(op, arg, {}, visitor);
+                }
+                break;
+            case COUNTVAL_RANGE:
+                if constexpr (numeric) {
+                    top[-1] = get<double>(evaluateRange(op, arg, top[-1], visitor));
+                } else {
+                    top[-1] = evaluateRange(op, arg, top[-1], visitor);
+                }
+                break;
+            case NUMBER_VALUE:
+                if constexpr (!numeric) {
+                    if (!holds_alternative<double>(top[-1])) {
+                        top[-1] = {};
+                    }
+                }
+                break;
+            case COUNT_VALUE:
+                if constexpr (numeric) {
+                    top[-1] = 1.0;
+                } else {
+                    top[-1] = static_cast<double>(!holds_alternative<monostate>(top[-1]));
+                }
+                break;
+            case COUNTVAL_VALUE: {
+                const Value &value = *--top;
+                top[-1] = static_cast<double>(top[-1] == value);
+                break;
+            }
+            case TEST:
+                if constexpr (!numeric) {
+                    if (!holds_alternative<double>(top[-1])) {
+                        top[-1] = {};
+                        i = arg - 1;
+                    }
+                }
+                break;
+            case BRANCH: {
+                double condition;
+                if constexpr (numeric) {
+                    condition = *--top;
+                } else {
+                    condition = get<double>(*--top);
+                }
+                if (condition == 0.0) {
+                    i = arg - 1;
+                }
+                break;
+            }
+            case JUMP:
+                i = arg - 1;
+                break;
+            case LOAD: {
+                uint32_t slot = m_instructions[arg - 1].arg;
+                if (loaded >> slot & 1) {
+                    *top++ = slots[slot];
+                    i = arg - 1;
+                }
+                break;
+            }
+            case STORE:
+                slots[arg] = top[-1];
+                loaded |= 1u << arg;
+                break;
+        }
+    }
+    depth = top - stack;
+    return true;
+}
+
+bool CBytecode::reference(uint32_t reference, double &number, CValue &result, CCycleDetectionVisitor &visitor) const {
+    CPos position = m_references[reference];
+    position.shift(visitor.getShift());
+    auto coords = position.getCoords();
+    CCellStorage &cells = m_spreadsheet.getCells();
+    if (const double *stored = cells.findNumber(coords)) {
+        number = *stored;
+        return true;
+    }
+    CCell *cell = cells.find(coords);
+    if (cell == nullptr) {
+        result = {};
+        return false;
+    }
+    const CValue &value = cell->evaluate(m_spreadsheet, visitor);
+    if (!holds_alternative<double>(value)) {
+        result = value;
+        return false;
+    }
+    number = get<double>(value);
+    return true;
+}
+
+bool CBytecode::reference(uint32_t reference, CValue &value, CValue &, CCycleDetectionVisitor &visitor) const {
+    CPos position = m_references[reference];
+    position.shift(visitor.getShift());
+    value = m_spreadsheet.getValue(position, visitor);
+    return true;
+}
+
+const vector<CBytecode::Instruction> &CBytecode::getInstructions() const {
+    return m_instructions;
+}
+
+CValue CBytecode::evaluateRange(OpCode op, uint32_t range, const CValue &value, CCycleDetectionVisitor &visitor) const {
+    auto [from, to] = m_ranges[range];
+    from.shift(visitor.getShift());
+    to.shift(visitor.getShift());
+    CRange selection(m_spreadsheet);
+    selection.select(from, to);
+
+    if (op == COUNTVAL_RANGE) {
+        double count = 0.0;
+        // number of cells in the range, the other positions are empty and match only undefined value
+        size_t cells = 0;
+        auto values = [&value, &count, &cells](const CValue &range_value) {
+            cells++;
+            if (range_value == value) {
+                count++;
+            }
+        };
+        auto numbers = [&value, &count, &cells](const double *range_numbers, uint64_t mask) {
+            cells += CNumberKernels::count(mask);
+            if (holds_alternative<double>(value)) {
+                count += static_cast<double>(CNumberKernels::countEqual(range_numbers, mask, get<double>(value)));
+            }
+        };
+        selection.evaluate(visitor, values, numbers);
+        if (holds_alternative<monostate>(value)) {
+            auto [rows, cols] = CPos::getOffset(from, to);
+            count += static_cast<double>(static_cast<size_t>(rows + 1) * (cols + 1) - cells);
+        }
+        return count;
+    }
+
+    // only the kernel of the function runs over the numbers, count needs none
+    unsigned parts = 0;
+    if (op == SUM_RANGE) {
+        parts = CNumberAggregate::SUM;
+    } else if (op == MIN_RANGE) {
+        parts = CNumberAggregate::MIN;
+    } else if (op == MAX_RANGE) {
+        parts = CNumberAggregate::MAX;
+    }
+    CNumberAggregate numbers(parts);
+    size_t defined = 0;
+    auto values = [&numbers, &defined](const CValue &range_value) {
+        if (holds_alternative<double>(range_value)) {
+            numbers.add(&get<double>(range_value), 1);
+        } else if (holds_alternative<string>(range_value)) {
+            defined++;
+        }
+    };
+    selection.evaluate(visitor, values, numbers);
+    if (op == COUNT_RANGE) {
+        return static_cast<double>(defined + numbers.count);
+    }
+    if (numbers.count == 0) {
+        return {};
+    }
+    if (op == SUM_RANGE) {
+        return numbers.sum;
+    }
+    return op == MIN_RANGE ? numbers.min : numbers.max;
+}
@@ -0,0 +1,286 @@
+//
+// Created by bardanik on 22/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CBYTECODE_H
+#define PA2_BIG_TASK_CBYTECODE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include "../SpreadsheetStructure/CPos.h"
+#include "../ExpressionBuilders/CycleDetectionVisitor/CCycleDetectionVisitor.h"
+
+class CSpreadsheet;
+
+// Value type that is stored in each cell - double, string or monostate (undefined).
+using CValue = variant<monostate, double, string>;
+
+/**
+ * Expression compiled to a linear program for a stack machine. AST nodes emit their instructions
+ * in postfix order, so the program is evaluated by one loop over the instructions with a stack of values,
+ * without virtual calls and recursion over the AST tree. Values are computed with the same rules as
+ * by the AST nodes, which are kept as the reference implementation.
+ *
+ * References and ranges are stored not shifted and are shifted by the shift of the evaluated cell,
+ * like in the AST tree, so one program is shared by all copies of a cell.
+ *
+ * Types of values on the stack are inferred while the program is emitted. If no instruction can produce
+ * a string or undefined value except references and functions, whose values are known only at runtime,
+ * the program is numeric and it is evaluated over a stack of doubles without construction of variants.
+ * When a reference or a function gives other value than a number, or a division by zero occurs,
+ * the stack is converted and the rest of the program is evaluated by the generic path.
+ *
+ * Subexpressions that occur more times in an expression are shared - the first evaluated occurrence
+ * stores its value to a slot and the other occurrences only load it. Slots are filled lazily,
+ * since an occurrence may be in a branch of if function, which is not evaluated.
+ */
+class CBytecode {
+public:
+    /**
+     * Operations of the stack machine.
+     */
+    enum OpCode : uint8_t {
+        // Pushes a constant, argument is index of the constant.
+        CONSTANT,
+        // Pushes value of a cell, argument is index of the reference.
+        REFERENCE,
+        // Binary operations pop the right and the left operand and push the result.
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        POWER,
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        // Negates the top of the stack.
+        NEGATE,
+        // Functions over a range push their result, argument is index of the range.
+        SUM_RANGE,
+        COUNT_RANGE,
+        MIN_RANGE,
+        MAX_RANGE,
+        // Pops the searched value and pushes the count of its occurrences in a range.
+        COUNTVAL_RANGE,
+        // Functions over a single value - sum, min and max keep only a number on the top of the stack.
+        NUMBER_VALUE,
+        // Replaces the top of the stack by 1 if it is defined, otherwise by 0.
+        COUNT_VALUE,
+        // Pops a value and the searched value and pushes 1 if they are equal, otherwise 0.
+        COUNTVAL_VALUE,
+        // If the top of the stack is not a number, replaces it by undefined value and jumps to the argument.
+        TEST,
+        // Pops a number and jumps to the argument if it is zero.
+        BRANCH,
+        // Jumps to the argument.
+        JUMP,
+        // If the slot of the shared expression is filled, pushes its value and jumps to the argument,
+        // which is the position after the STORE instruction of the expression.
+        LOAD,
+        // Copies the top of the stack to a slot of a shared expression, argument is index of the slot.
+        STORE
+    };
+
+    /**
+     * Single instruction of the program.
+     */
+    struct Instruction {
+        // Operation of the instruction.
+        OpCode op;
+        // Index of a constant, reference or range, or target of a jump.
+        uint32_t arg;
+    };
+
+    /**
+     * Constructs an empty program.
+     * @param spreadsheet - spreadsheet where referenced cells are expected.
+     */
+    explicit CBytecode(CSpreadsheet &spreadsheet);
+
+    /**
+     * Appends an instruction to the program.
+     * @param op - operation of the instruction.
+     * @param arg - argument of the instruction.
+     * @return position of the instruction, is used to set target of a jump later.
+     */
+    size_t emit(OpCode op, uint32_t arg = 0);
+
+    /**
+     * Sets target of a jump instruction to the end of the program, i.e. to the next emitted instruction.
+     * @param position - position of the jump instruction.
+     */
+    void setTarget(size_t position);
+
+    /**
+     * Adds a constant to the program.
+     * @param value - the constant.
+     * @return index of the constant.
+     */
+    uint32_t addConstant(const CValue &value);
+
+    /**
+     * Adds a reference to a cell to the program.
+     * @param position - referenced position, not shifted.
+     * @return index of the reference.
+     */
+    uint32_t addReference(const CPos &position);
+
+    /**
+     * Adds a range to the program.
+     * @param from - upper left corner of the range, not shifted.
+     * @param to - bottom right corner of the range, not shifted.
+     * @return index of the range.
+     */
+    uint32_t addRange(const CPos &from, const CPos &to);
+
+    /**
+     * Marks an expression as shared, so its value is computed only once during evaluation of the program.
+     * @param expression - text of the expression, given by CASTNode::toString.
+     */
+    void share(const string &expression);
+
+    /**
+     * Gets slot of a shared expression. A slot is assigned when the expression is compiled for the first time.
+     * @param expression - text of the expression, given by CASTNode::toString.
+     * @param slot - index of the slot if the expression is shared.
+     * @return false if the expression is not shared or there is no free slot.
+     */
+    bool findShared(const string &expression, uint32_t &slot);
+
+    /**
+     * Gets shared expressions which were assigned a slot.
+     * @return texts of the expressions ordered by their slots.
+     */
+    vector<string> getShared() const;
+
+    /**
+     * Evaluates the program.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return value of the expression.
+     */
+    CValue evaluate(CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Evaluates the program by the generic path only, even if it is numeric.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return value of the expression.
+     */
+    CValue evaluateGeneric(CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Checks if the program is evaluated by the double-only path.
+     * @return true if all values on the stack are numbers, when referenced cells and functions give numbers.
+     */
+    bool isNumeric() const;
+
+    /**
+     * Gets instructions of the program.
+     * @return the instructions in the order they are executed without jumps.
+     */
+    const vector<Instruction> &getInstructions() const;
+
+private:
+    /**
+     * Evaluates function over a range.
+     * @param op - the function.
+     * @param range - index of the range.
+     * @param value - searched value for countval function.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return result of the function.
+     */
+    CValue evaluateRange(OpCode op, uint32_t range, const CValue &value, CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Evaluates the program with stacks on the call stack if they are small enough.
+     * @param numeric - true if the double-only path is tried first.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return value of the expression.
+     */
+    CValue evaluate(bool numeric, CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Evaluates the program with given stacks, first by the double-only path if the program is numeric.
+     * Slots of shared expressions are stored at the beginning of the stacks.
+     * @param numbers - memory for at least m_slots + m_max_depth numbers.
+     * @param values - memory for at least m_slots + m_max_depth values.
+     * @param numeric - true if the double-only path is tried first.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return value of the expression.
+     */
+    CValue evaluate(double *numbers, CValue *values, bool numeric, CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Executes instructions of the program, specialized for stack of doubles and stack of variant values.
+     * The generic variant always executes the program to its end. The double-only variant stops at
+     * the first instruction, whose result is not a number.
+     * @param stack - the stack with depth values on it, slots of shared expressions are before the stack.
+     * @param loaded - bitmap of filled slots, i-th bit is set if i-th slot is filled.
+     * @param depth - number of values on the stack, is updated to the number of values below
+     * the result of the last executed instruction if it stopped.
+     * @param next - position of the first executed instruction, is updated to the position after
+     * the instruction, where the execution stopped.
+     * @param result - result of the instruction, where the execution stopped.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return true if the whole program was executed, false if the execution stopped.
+     */
+    template<typename Value>
+    bool execute(Value *stack, uint32_t &loaded, size_t &depth, size_t &next, CValue &result,
+                 CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Gets value of a referenced cell as a number, without copying value of the cell.
+     * @param reference - index of the reference.
+     * @param number - the value if it is a number.
+     * @param result - the value if it is not a number.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return true if the value is a number.
+     */
+    bool reference(uint32_t reference, double &number, CValue &result, CCycleDetectionVisitor &visitor) const;
+
+    /**
+     * Gets value of a referenced cell.
+     * @param reference - index of the reference.
+     * @param value - the value.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return always true.
+     */
+    bool reference(uint32_t reference, CValue &value, CValue &, CCycleDetectionVisitor &visitor) const;
+
+    // Programs with smaller stack are evaluated without allocation of the stack.
+    static constexpr size_t LOCAL_STACK = 16;
+    // Maximal number of slots of shared expressions, filled slots are marked in a bitmap.
+    static constexpr uint32_t MAX_SLOTS = 32;
+    // Marks slot of a shared expression, which was not compiled yet.
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    // Instructions of the program.
+    vector<Instruction> m_instructions;
+    // Constants used by the program.
+    vector<CValue> m_constants;
+    // Referenced positions, not shifted.
+    vector<CPos> m_references;
+    // Corners of referenced ranges, not shifted.
+    vector<pair<CPos, CPos>> m_ranges;
+    // Number of values on the stack after the last instruction, counting both branches of if function.
+    size_t m_depth = 0;
+    // Upper bound of the number of values on the stack.
+    size_t m_max_depth = 0;
+    // Inferred types of values on the stack during emitting, true if the value is a number.
+    vector<bool> m_types;
+    // True if no instruction makes a value, which is not a number, from numbers.
+    bool m_numeric = true;
+    // Slots of shared expressions by their texts.
+    unordered_map<string, uint32_t> m_shared;
+    // Number of assigned slots.
+    uint32_t m_slots = 0;
+    // Spreadsheet where referenced cells are expected.
+    CSpreadsheet &m_spreadsheet;
+};
+
+
+#endif //PA2_BIG_TASK_CBYTECODE_H
@@ -0,0 +1,54 @@
+//
+// Created by bardanik on 17/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CFUNCTIONREF_H
+#define PA2_BIG_TASK_CFUNCTIONREF_H
+
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+template<typename Signature>
+class CFunctionRef;
+
+/**
+ * Non-owning reference to a callable object. Unlike std::function it never allocates and calling it
+ * is a single indirect call, so it is used for callbacks called for every cell of a range.
+ * The referenced callable must live longer than the reference - it is meant for function parameters.
+ * @tparam Result - return type of the callable.
+ * @tparam Args - argument types of the callable.
+ */
+template<typename Result, typename... Args>
+class CFunctionRef<Result(Args...)> {
+public:
+    /**
+     * Constructs reference to a callable object.
+     * @param callable - function, lambda or other callable object.
+     */
+    template<typename Callable>
+    requires (!is_same_v<remove_cvref_t<Callable>, CFunctionRef>)
+    CFunctionRef(Callable &&callable) : m_callable(const_cast<void *>(static_cast<const void *>(&callable))),
+                                        m_call([](void *referenced, Args... args) -> Result {
+                                            return (*static_cast<remove_reference_t<Callable> *>(referenced))(
+                                                    std::forward<Args>(args)...);
+                                        }) {
+    }
+
+    /**
+     * Calls the referenced callable.
+     */
+    Result operator()(Args... args) const {
+        return m_call(m_callable, std::forward<Args>(args)...);
+    }
+
+private:
+    // Referenced callable object.
+    void *m_callable;
+    // Function calling the referenced callable with its real type.
+    Result (*m_call)(void *, Args...);
+};
+
+
+#endif //PA2_BIG_TASK_CFUNCTIONREF_H
@@ -0,0 +1,333 @@
+//
+// Created by bardanik on 16/05/24.
+//
+
+#include <bit>
+#include <cmath>
+#include "CNumberKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NUMBER_KERNELS_X86
+
+#include <immintrin.h>
+
+#endif
+
+namespace {
+
+    // Minimum and maximum skip NaN numbers, NaN as the given value means there is no number yet,
+    // so the result is NaN only if all numbers are NaN, like when the first number was taken as the start.
+
+    double scalarSum(const double *numbers, uint64_t mask) {
+        double sum = 0.0;
+        for (; mask != 0; mask &= mask - 1) {
+            sum += numbers[countr_zero(mask)];
+        }
+        return sum;
+    }
+
+    double scalarMin(const double *numbers, uint64_t mask, double value) {
+        for (; mask != 0; mask &= mask - 1) {
+            double number = numbers[countr_zero(mask)];
+            if (number < value || isnan(value)) {
+                value = number;
+            }
+        }
+        return value;
+    }
+
+    double scalarMax(const double *numbers, uint64_t mask, double value) {
+        for (; mask != 0; mask &= mask - 1) {
+            double number = numbers[countr_zero(mask)];
+            if (number > value || isnan(value)) {
+                value = number;
+            }
+        }
+        return value;
+    }
+
+    size_t scalarCountEqual(const double *numbers, uint64_t mask, double value) {
+        size_t count = 0;
+        for (; mask != 0; mask &= mask - 1) {
+            if (numbers[countr_zero(mask)] == value) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+#ifdef NUMBER_KERNELS_X86
+
+    // SSE2 kernels work on pairs of numbers, pairs with only one valid number are handled by scalar code.
+
+    // minpd and maxpd return the second operand if any operand is NaN, so numbers are the first operand
+    // to skip NaN numbers and lanes without a number yet are replaced by the numbers
+    __attribute__((target("sse2")))
+    __m128d sse2MinLanes(__m128d numbers, __m128d min) {
+        __m128d empty = _mm_cmpunord_pd(min, min);
+        return _mm_or_pd(_mm_and_pd(empty, numbers), _mm_andnot_pd(empty, _mm_min_pd(numbers, min)));
+    }
+
+    __attribute__((target("sse2")))
+    __m128d sse2MaxLanes(__m128d numbers, __m128d max) {
+        __m128d empty = _mm_cmpunord_pd(max, max);
+        return _mm_or_pd(_mm_and_pd(empty, numbers), _mm_andnot_pd(empty, _mm_max_pd(numbers, max)));
+    }
+
+    __attribute__((target("sse2")))
+    double sse2Sum(const double *numbers, uint64_t mask) {
+        __m128d sum = _mm_setzero_pd();
+        double rest = 0.0;
+        for (int i = 0; i < 64 && mask >> i != 0; i += 2) {
+            uint64_t lanes = mask >> i & 3;
+            if (lanes == 3) {
+                sum = _mm_add_pd(sum, _mm_loadu_pd(numbers + i));
+            } else if (lanes != 0) {
+                rest += scalarSum(numbers + i, lanes);
+            }
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, sum);
+        return lanes[0] + lanes[1] + rest;
+    }
+
+    __attribute__((target("sse2")))
+    double sse2Min(const double *numbers, uint64_t mask, double value) {
+        __m128d min = _mm_set1_pd(value);
+        for (int i = 0; i < 64 && mask >> i != 0; i += 2) {
+            uint64_t lanes = mask >> i & 3;
+            if (lanes == 3) {
+                min = sse2MinLanes(_mm_loadu_pd(numbers + i), min);
+            } else if (lanes != 0) {
+                min = sse2MinLanes(_mm_set1_pd(scalarMin(numbers + i, lanes, value)), min);
+            }
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, min);
+        return scalarMin(lanes, 3, value);
+    }
+
+    __attribute__((target("sse2")))
+    double sse2Max(const double *numbers, uint64_t mask, double value) {
+        __m128d max = _mm_set1_pd(value);
+        for (int i = 0; i < 64 && mask >> i != 0; i += 2) {
+            uint64_t lanes = mask >> i & 3;
+            if (lanes == 3) {
+                max = sse2MaxLanes(_mm_loadu_pd(numbers + i), max);
+            } else if (lanes != 0) {
+                max = sse2MaxLanes(_mm_set1_pd(scalarMax(numbers + i, lanes, value)), max);
+            }
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, max);
+        return scalarMax(lanes, 3, value);
+    }
+
+    __attribute__((target("sse2")))
+    size_t sse2CountEqual(const double *numbers, uint64_t mask, double value) {
+        __m128d searched = _mm_set1_pd(value);
+        size_t count = 0;
+        for (int i = 0; i < 64 && mask >> i != 0; i += 2) {
+            uint64_t lanes = mask >> i & 3;
+            if (lanes == 3) {
+                count += popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(numbers + i),
+                                                                                    searched))));
+            } else if (lanes != 0) {
+                count += scalarCountEqual(numbers + i, lanes, value);
+            }
+        }
+        return count;
+    }
+
+    // AVX2 kernels work on groups of four numbers, partially valid groups are read by masked loads,
+    // which do not touch invalid numbers, so a segment may be shorter than 64 numbers.
+
+    __attribute__((target("avx2")))
+    __m256i laneMask(uint64_t lanes) {
+        return _mm256_set_epi64x(-static_cast<long long>(lanes >> 3 & 1), -static_cast<long long>(lanes >> 2 & 1),
+                                 -static_cast<long long>(lanes >> 1 & 1), -static_cast<long long>(lanes & 1));
+    }
+
+    __attribute__((target("avx2")))
+    __m256d avx2MinLanes(__m256d numbers, __m256d min) {
+        return _mm256_blendv_pd(_mm256_min_pd(numbers, min), numbers, _mm256_cmp_pd(min, min, _CMP_UNORD_Q));
+    }
+
+    __attribute__((target("avx2")))
+    __m256d avx2MaxLanes(__m256d numbers, __m256d max) {
+        return _mm256_blendv_pd(_mm256_max_pd(numbers, max), numbers, _mm256_cmp_pd(max, max, _CMP_UNORD_Q));
+    }
+
+    __attribute__((target("avx2")))
+    double avx2Sum(const double *numbers, uint64_t mask) {
+        __m256d sum = _mm256_setzero_pd();
+        for (int i = 0; i < 64 && mask >> i != 0; i += 4) {
+            uint64_t lanes = mask >> i & 15;
+            if (lanes == 15) {
+                sum = _mm256_add_pd(sum, _mm256_loadu_pd(numbers + i));
+            } else if (lanes != 0) {
+                sum = _mm256_add_pd(sum, _mm256_maskload_pd(numbers + i, laneMask(lanes)));
+            }
+        }
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        double lanes[2];
+        _mm_storeu_pd(lanes, half);
+        return lanes[0] + lanes[1];
+    }
+
+    __attribute__((target("avx2")))
+    double avx2Min(const double *numbers, uint64_t mask, double value) {
+        __m256d min = _mm256_set1_pd(value);
+        for (int i = 0; i < 64 && mask >> i != 0; i += 4) {
+            uint64_t lanes = mask >> i & 15;
+            if (lanes == 15) {
+                min = avx2MinLanes(_mm256_loadu_pd(numbers + i), min);
+            } else if (lanes != 0) {
+                __m256i valid = laneMask(lanes);
+                // invalid lanes are replaced by the current minimum, so they change nothing
+                __m256d loaded = _mm256_blendv_pd(min, _mm256_maskload_pd(numbers + i, valid),
+                                                  _mm256_castsi256_pd(valid));
+                min = avx2MinLanes(loaded, min);
+            }
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, min);
+        return scalarMin(lanes, 15, value);
+    }
+
+    __attribute__((target("avx2")))
+    double avx2Max(const double *numbers, uint64_t mask, double value) {
+        __m256d max = _mm256_set1_pd(value);
+        for (int i = 0; i < 64 && mask >> i != 0; i += 4) {
+            uint64_t lanes = mask >> i & 15;
+            if (lanes == 15) {
+                max = avx2MaxLanes(_mm256_loadu_pd(numbers + i), max);
+            } else if (lanes != 0) {
+                __m256i valid = laneMask(lanes);
+                __m256d loaded = _mm256_blendv_pd(max, _mm256_maskload_pd(numbers + i, valid),
+                                                  _mm256_castsi256_pd(valid));
+                max = avx2MaxLanes(loaded, max);
+            }
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, max);
+        return scalarMax(lanes, 15, value);
+    }
+
+    __attribute__((target("avx2")))
+    size_t avx2CountEqual(const double *numbers, uint64_t mask, double value) {
+        __m256d searched = _mm256_set1_pd(value);
+        size_t count = 0;
+        for (int i = 0; i < 64 && mask >> i != 0; i += 4) {
+            uint64_t lanes = mask >> i & 15;
+            if (lanes == 0) {
+                continue;
+            }
+            __m256d loaded = lanes == 15 ? _mm256_loadu_pd(numbers + i)
+                                         : _mm256_maskload_pd(numbers + i, laneMask(lanes));
+            auto equal = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(loaded, searched, _CMP_EQ_OQ)));
+            count += popcount(equal & static_cast<unsigned>(lanes));
+        }
+        return count;
+    }
+
+#endif
+}
+
+CNumberAggregate::CNumberAggregate(unsigned parts) : parts(parts) {
+
+}
+
+void CNumberAggregate::add(const double *numbers, uint64_t mask) {
+    if (mask == 0) {
+        return;
+    }
+    count += CNumberKernels::count(mask);
+    if (parts & SUM) {
+        sum += CNumberKernels::sum(numbers, mask);
+    }
+    if (parts & MIN) {
+        min = CNumberKernels::min(numbers, mask, min);
+    }
+    if (parts & MAX) {
+        max = CNumberKernels::max(numbers, mask, max);
+    }
+}
+
+void CNumberAggregate::merge(const CNumberAggregate &other) {
+    sum += other.sum;
+    count += other.count;
+    if (other.min < min || isnan(min)) {
+        min = other.min;
+    }
+    if (other.max > max || isnan(max)) {
+        max = other.max;
+    }
+}
+
+double CNumberKernels::sum(const double *numbers, uint64_t mask) {
+    return kernels(current()).sum(numbers, mask);
+}
+
+double CNumberKernels::min(const double *numbers, uint64_t mask, double value) {
+    return kernels(current()).min(numbers, mask, value);
+}
+
+double CNumberKernels::max(const double *numbers, uint64_t mask, double value) {
+    return kernels(current()).max(numbers, mask, value);
+}
+
+size_t CNumberKernels::countEqual(const double *numbers, uint64_t mask, double value) {
+    return kernels(current()).count_equal(numbers, mask, value);
+}
+
+size_t CNumberKernels::count(uint64_t mask) {
+    return popcount(mask);
+}
+
+CNumberKernels::Implementation CNumberKernels::implementation() {
+    return current();
+}
+
+vector<CNumberKernels::Implementation> CNumberKernels::supported() {
+    vector<Implementation> implementations = {SCALAR};
+#ifdef NUMBER_KERNELS_X86
+    if (__builtin_cpu_supports("sse2")) {
+        implementations.push_back(SSE2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        implementations.push_back(AVX2);
+    }
+#endif
+    return implementations;
+}
+
+bool CNumberKernels::use(Implementation implementation) {
+    for (auto supported_implementation: supported()) {
+        if (supported_implementation == implementation) {
+            current() = implementation;
+            return true;
+        }
+    }
+    return false;
+}
+
+const CNumberKernels::Kernels &CNumberKernels::kernels(Implementation implementation) {
+    static const Kernels scalar = {scalarSum, scalarMin, scalarMax, scalarCountEqual};
+#ifdef NUMBER_KERNELS_X86
+    static const Kernels sse2 = {sse2Sum, sse2Min, sse2Max, sse2CountEqual};
+    static const Kernels avx2 = {avx2Sum, avx2Min, avx2Max, avx2CountEqual};
+    if (implementation == AVX2) {
+        return avx2;
+    }
+    if (implementation == SSE2) {
+        return sse2;
+    }
+#endif
+    return scalar;
+}
+
+CNumberKernels::Implementation &CNumberKernels::current() {
+    static Implementation implementation = supported().back();
+    return implementation;
+}
@@ -0,0 +1,175 @@
+//
+// Created by bardanik on 16/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CNUMBERKERNELS_H
+#define PA2_BIG_TASK_CNUMBERKERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Aggregate of a set of numbers, which can be merged with aggregates of other sets.
+ * The count is always computed, the sum, the minimum and the maximum only if they are requested.
+ */
+struct CNumberAggregate {
+    /**
+     * Parts of the aggregate computed by add(), they can be combined.
+     */
+    enum Part : unsigned {
+        SUM = 0x01,
+        MIN = 0x02,
+        MAX = 0x04,
+        ALL = SUM | MIN | MAX
+    };
+
+    /**
+     * Creates an empty aggregate computing all parts.
+     */
+    CNumberAggregate() = default;
+
+    /**
+     * Creates an empty aggregate.
+     * @param parts - parts computed from added segments, the others keep their initial values.
+     */
+    explicit CNumberAggregate(unsigned parts);
+
+    /**
+     * Adds valid numbers of a segment to the aggregate.
+     * @param numbers - numbers of the segment.
+     * @param mask - bitmap of valid numbers.
+     */
+    void add(const double *numbers, uint64_t mask);
+
+    /**
+     * Adds numbers of another aggregate.
+     * @param other - aggregate to add.
+     */
+    void merge(const CNumberAggregate &other);
+
+    // Sum of the numbers.
+    double sum = 0.0;
+    // Number of the numbers.
+    size_t count = 0;
+    // Minimum of the numbers without NaN numbers, NaN if there are no such numbers.
+    double min = numeric_limits<double>::quiet_NaN();
+    // Maximum of the numbers without NaN numbers, NaN if there are no such numbers.
+    double max = numeric_limits<double>::quiet_NaN();
+    // Parts computed from added segments, only one kernel runs for a single function.
+    unsigned parts = ALL;
+};
+
+/**
+ * Aggregation kernels over segments of packed numbers. A segment is a pointer to at most 64 numbers
+ * and a bitmap, the i-th bit is set if the i-th number is valid - only valid numbers are read.
+ *
+ * Kernels are implemented with AVX2 and SSE2 instructions, with a scalar fallback. The implementation
+ * is chosen at runtime by features of the CPU, AVX2 and SSE2 code is compiled only for those functions,
+ * so the program runs on any x86-64 CPU and compiles on other platforms too.
+ */
+class CNumberKernels {
+public:
+    /**
+     * Instruction sets of the kernels.
+     */
+    enum Implementation {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * Sums valid numbers of a segment.
+     * @param numbers - numbers of the segment.
+     * @param mask - bitmap of valid numbers.
+     * @return sum of the valid numbers.
+     */
+    static double sum(const double *numbers, uint64_t mask);
+
+    /**
+     * Finds minimum of valid numbers of a segment and a given value, NaN numbers are skipped.
+     * @param numbers - numbers of the segment.
+     * @param mask - bitmap of valid numbers.
+     * @param value - value to compare with, e.g. minimum of the previous segments, NaN if there is none.
+     * @return the minimum, NaN only if the value and all valid numbers are NaN.
+     */
+    static double min(const double *numbers, uint64_t mask, double value);
+
+    /**
+     * Finds maximum of valid numbers of a segment and a given value, NaN numbers are skipped.
+     * @param numbers - numbers of the segment.
+     * @param mask - bitmap of valid numbers.
+     * @param value - value to compare with, e.g. maximum of the previous segments, NaN if there is none.
+     * @return the maximum, NaN only if the value and all valid numbers are NaN.
+     */
+    static double max(const double *numbers, uint64_t mask, double value);
+
+    /**
+     * Counts valid numbers of a segment equal to a value.
+     * @param numbers - numbers of the segment.
+     * @param mask - bitmap of valid numbers.
+     * @param value - value to look for.
+     * @return number of equal numbers.
+     */
+    static size_t countEqual(const double *numbers, uint64_t mask, double value);
+
+    /**
+     * Counts valid numbers of a segment.
+     * @param mask - bitmap of valid numbers.
+     * @return number of valid numbers.
+     */
+    static size_t count(uint64_t mask);
+
+    /**
+     * Gets the implementation used by the kernels, the best supported one unless changed by use().
+     * @return used implementation.
+     */
+    static Implementation implementation();
+
+    /**
+     * Finds implementations supported by the CPU.
+     * @return supported implementations, scalar is always supported.
+     */
+    static vector<Implementation> supported();
+
+    /**
+     * Changes the used implementation, is meant for testing and benchmarks.
+     * Must not be called while kernels are used by other threads.
+     * @param implementation - implementation to use.
+     * @return true if the implementation is supported and is used from now.
+     */
+    static bool use(Implementation implementation);
+
+private:
+
+    /**
+     * Kernel functions of one implementation.
+     */
+    struct Kernels {
+        double (*sum)(const double *, uint64_t);
+
+        double (*min)(const double *, uint64_t, double);
+
+        double (*max)(const double *, uint64_t, double);
+
+        size_t (*count_equal)(const double *, uint64_t, double);
+    };
+
+    /**
+     * Gets kernels of an implementation.
+     */
+    static const Kernels &kernels(Implementation implementation);
+
+    /**
+     * Gets implementation that is used now, the best supported one is chosen on the first call.
+     */
+    static Implementation &current();
+};
+
+
+#endif //PA2_BIG_TASK_CNUMBERKERNELS_H
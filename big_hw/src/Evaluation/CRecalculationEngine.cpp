@@ -0,0 +1,168 @@
+//
+// Created by bardanik on 14/05/24.
+//
+
+#include "../CSpreadsheet.h"
+#include "CRecalculationEngine.h"
+
+CRecalculationEngine::CRecalculationEngine(CSpreadsheet &spreadsheet, CThreadPool *pool) : m_spreadsheet(spreadsheet),
+                                                                                           m_pool(pool) {
+
+}
+
+void CRecalculationEngine::recalculate(const pair<int, int> &coords) {
+    findLevels(coords);
+    if (m_pool != nullptr && m_pool->getThreadCount() > 1) {
+        recalculateParallel();
+        return;
+    }
+    for (const auto &level: m_levels) {
+        for (CCell *cell: level) {
+            evaluate(cell);
+        }
+    }
+}
+
+vector<CCell *> CRecalculationEngine::getEvaluationOrder(const pair<int, int> &coords) {
+    findLevels(coords);
+    vector<CCell *> order;
+    for (const auto &level: m_levels) {
+        order.insert(order.end(), level.begin(), level.end());
+    }
+    return order;
+}
+
+void CRecalculationEngine::recalculateParallel() {
+    // the parser used for building AST trees is not known to be thread safe, so trees are built before
+    for (const auto &level: m_levels) {
+        for (CCell *cell: level) {
+            cell->prepare(m_spreadsheet);
+        }
+    }
+    for (const auto &level: m_levels) {
+        if (level.size() < PARALLEL_LEVEL_SIZE) {
+            for (CCell *cell: level) {
+                evaluate(cell);
+            }
+            continue;
+        }
+        m_pool->run(level.size(), [this, &level](size_t index) {
+            evaluate(level[index]);
+        });
+    }
+}
+
+void CRecalculationEngine::evaluate(CCell *cell) {
+    // clean cells cannot end in a cycle, if they do, the cell is not cached and is evaluated again by the caller
+    CCycleDetectionVisitor visitor;
+    cell->getValue(m_spreadsheet, visitor);
+}
+
+void CRecalculationEngine::findLevels(const pair<int, int> &coords) {
+    m_nodes.clear();
+    m_levels.clear();
+    CCell *root = m_spreadsheet.findCell(coords);
+    if (root == nullptr || root->isEvaluated()) {
+        return;
+    }
+
+    // Iterative Tarjan's algorithm, components are found in the reverse topological order.
+    vector<pair<pair<int, int>, size_t>> call_stack;
+    vector<pair<int, int>> component_stack;
+    size_t index = 0;
+
+    auto open = [&](const pair<int, int> &cell_coords, CCell *cell) {
+        m_nodes[cell_coords] = {cell, m_spreadsheet.getPrecedents(cell_coords), index, index, true, CLEAN, 0};
+        index++;
+        call_stack.emplace_back(cell_coords, 0);
+        component_stack.push_back(cell_coords);
+    };
+    open(coords, root);
+
+    while (!call_stack.empty()) {
+        auto &[current, next] = call_stack.back();
+        Node &node = m_nodes[current];
+        if (next < node.precedents.size()) {
+            auto precedent = node.precedents[next++];
+            auto found = m_nodes.find(precedent);
+            if (found != m_nodes.end()) {
+                if (found->second.on_stack) {
+                    node.low_link = min(node.low_link, found->second.index);
+                }
+                continue;
+            }
+            CCell *cell = m_spreadsheet.findCell(precedent);
+            if (cell != nullptr && cell->isCyclic()) {
+                // a cell marked before is resolved already, its dependents are marked by it
+                m_nodes[precedent] = {cell, {}, index++, 0, false, CYCLIC, 0};
+            } else if (cell != nullptr && !cell->isEvaluated()) {
+                open(precedent, cell);
+            }
+            continue;
+        }
+
+        auto finished = current;
+        call_stack.pop_back();
+        if (!call_stack.empty()) {
+            Node &parent = m_nodes[call_stack.back().first];
+            parent.low_link = min(parent.low_link, node.low_link);
+        }
+        if (node.low_link != node.index) {
+            continue;
+        }
+        vector<pair<int, int>> component;
+        do {
+            component.push_back(component_stack.back());
+            component_stack.pop_back();
+            m_nodes[component.back()].on_stack = false;
+        } while (component.back() != finished);
+        resolveComponent(component);
+    }
+}
+
+void CRecalculationEngine::resolveComponent(const vector<pair<int, int>> &component) {
+    bool cyclic = component.size() > 1;
+    for (const auto &precedent: m_nodes[component.front()].precedents) {
+        cyclic = cyclic || precedent == component.front();
+    }
+
+    if (cyclic) {
+        bool conditional = false;
+        for (const auto &member: component) {
+            conditional = conditional || m_nodes[member].cell->isConditional();
+        }
+        for (const auto &member: component) {
+            Node &node = m_nodes[member];
+            node.state = conditional ? TAINTED : CYCLIC;
+            if (!conditional) {
+                node.cell->markCyclic();
+            }
+        }
+        return;
+    }
+
+    Node &node = m_nodes[component.front()];
+    for (const auto &precedent: node.precedents) {
+        auto found = m_nodes.find(precedent);
+        if (found == m_nodes.end()) {
+            continue;
+        }
+        if (found->second.state == CLEAN) {
+            node.level = max(node.level, found->second.level + 1);
+            continue;
+        }
+        if (found->second.state == CYCLIC && !node.cell->isConditional()) {
+            node.state = CYCLIC;
+            break;
+        }
+        node.state = TAINTED;
+    }
+    if (node.state == CLEAN) {
+        if (m_levels.size() <= node.level) {
+            m_levels.resize(node.level + 1);
+        }
+        m_levels[node.level].push_back(node.cell);
+    } else if (node.state == CYCLIC) {
+        node.cell->markCyclic();
+    }
+}
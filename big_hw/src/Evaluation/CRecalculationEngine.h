@@ -0,0 +1,120 @@
+//
+// Created by bardanik on 14/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CRECALCULATIONENGINE_H
+#define PA2_BIG_TASK_CRECALCULATIONENGINE_H
+
+#include <vector>
+#include <map>
+#include "../SpreadsheetStructure/CCell.h"
+#include "CThreadPool.h"
+
+/**
+ * Evaluates cells without deep recursion. Before a cell is evaluated, the engine walks its precedents
+ * that have no computed value (dirty cells) in the dependency graph with an explicit stack, orders them
+ * topologically and evaluates them one by one from the leaves. Every evaluated cell then finds values
+ * of cells it references already computed, so the native stack grows only by one cell at a time.
+ *
+ * Cells, from which a cycle in the dependency graph can be reached, are not evaluated by the engine.
+ * If the cycle is reached only through expressions without if function, which evaluate all references,
+ * the evaluation would certainly end in the cycle, so such cells are just marked as cyclic. Otherwise
+ * whether the cell really ends in a cycle depends on the evaluation (taken branches of if functions),
+ * so it is left for the recursive evaluation with CCycleDetectionVisitor. That keeps the cycle
+ * semantics unchanged.
+ *
+ * Clean cells are also split into levels - a cell is in the level one above the highest level of its
+ * dirty precedents. Cells in the same level do not depend on each other, so with a thread pool
+ * each level is evaluated in parallel. Every cell is evaluated only from already computed values,
+ * so the result is the same as in the serial evaluation.
+ */
+class CRecalculationEngine {
+public:
+    /**
+     * Constructs engine working on some spreadsheet.
+     * @param spreadsheet - spreadsheet with cells and their dependency graph.
+     * @param pool - thread pool for parallel evaluation, nullptr to evaluate serially.
+     */
+    explicit CRecalculationEngine(CSpreadsheet &spreadsheet, CThreadPool *pool = nullptr);
+
+    /**
+     * Evaluates a cell and all its dirty precedents which do not lead to a cycle.
+     * @param coords - coordinates of the cell.
+     */
+    void recalculate(const pair<int, int> &coords);
+
+    /**
+     * Orders dirty cells, on which a cell depends, topologically. Cells leading to a cycle are left out.
+     * @param coords - coordinates of the cell.
+     * @return cells in the order of evaluation, the cell itself is the last one if it is included.
+     * Cells are ordered by levels.
+     */
+    vector<CCell *> getEvaluationOrder(const pair<int, int> &coords);
+
+private:
+    /**
+     * State of a dirty cell found in the graph.
+     */
+    enum State {
+        // No cycle can be reached from the cell.
+        CLEAN,
+        // Cycle can be reached, but it depends on evaluation of if functions.
+        TAINTED,
+        // Evaluation of the cell will certainly end in a cycle.
+        CYCLIC
+    };
+
+    /**
+     * Dirty cell found in the graph and its bookkeeping for the Tarjan's algorithm.
+     */
+    struct Node {
+        CCell *cell;
+        vector<pair<int, int>> precedents;
+        size_t index;
+        size_t low_link;
+        bool on_stack;
+        State state;
+        // Level of a clean cell, cells in level 0 do not have dirty precedents.
+        size_t level;
+    };
+
+    /**
+     * Evaluates cells of each level in parallel, levels one after another.
+     */
+    void recalculateParallel();
+
+    /**
+     * Evaluates a single cell, its precedents must be already computed.
+     * @param cell - cell to evaluate.
+     */
+    void evaluate(CCell *cell);
+
+    /**
+     * Decides state of cells in a strongly connected component of the graph, all components
+     * reachable from it are already resolved. Clean cells are added to their levels,
+     * cells which certainly end in a cycle are marked as cyclic.
+     * @param component - coordinates of cells in the component.
+     */
+    void resolveComponent(const vector<pair<int, int>> &component);
+
+    /**
+     * Finds clean cells that depend on a cell and orders them into levels.
+     * @param coords - coordinates of the cell.
+     */
+    void findLevels(const pair<int, int> &coords);
+
+    // Levels with less cells are evaluated serially.
+    static constexpr size_t PARALLEL_LEVEL_SIZE = 64;
+
+    // Spreadsheet with evaluated cells.
+    CSpreadsheet &m_spreadsheet;
+    // Thread pool for parallel evaluation, can be nullptr.
+    CThreadPool *m_pool;
+    // Dirty cells found in the graph.
+    map<pair<int, int>, Node> m_nodes;
+    // Clean cells ordered into levels.
+    vector<vector<CCell *>> m_levels;
+};
+
+
+#endif //PA2_BIG_TASK_CRECALCULATIONENGINE_H
@@ -0,0 +1,132 @@
+//
+// Created by bardanik on 15/05/24.
+//
+
+#include "CThreadPool.h"
+
+CThreadPool::CThreadPool(unsigned thread_count) {
+    thread_count = max(thread_count, 1u);
+    for (unsigned i = 0; i < thread_count; i++) {
+        m_queues.push_back(make_unique<WorkQueue>());
+    }
+    for (unsigned i = 1; i < thread_count; i++) {
+        m_threads.emplace_back(&CThreadPool::loop, this, i);
+    }
+}
+
+CThreadPool::~CThreadPool() {
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_stopping = true;
+    }
+    m_started.notify_all();
+    for (auto &worker: m_threads) {
+        worker.join();
+    }
+}
+
+void CThreadPool::run(size_t count, const function<void(size_t)> &task) {
+    lock_guard<mutex> run_guard(m_run_lock);
+    size_t workers = m_queues.size();
+    for (size_t worker = 0; worker < workers; worker++) {
+        lock_guard<mutex> guard(m_queues[worker]->lock);
+        for (size_t index = count * worker / workers; index < count * (worker + 1) / workers; index++) {
+            m_queues[worker]->indices.push_back(index);
+        }
+    }
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_task = &task;
+        m_working = static_cast<unsigned>(m_threads.size());
+        m_generation++;
+    }
+    m_started.notify_all();
+
+    work(0);
+
+    unique_lock<mutex> guard(m_lock);
+    m_finished.wait(guard, [this] { return m_working == 0; });
+    m_task = nullptr;
+}
+
+void CThreadPool::runOn(CThreadPool *pool, size_t count, const function<void(size_t)> &task) {
+    if (pool != nullptr && count > 1) {
+        pool->run(count, task);
+        return;
+    }
+    for (size_t index = 0; index < count; index++) {
+        task(index);
+    }
+}
+
+unsigned CThreadPool::getThreadCount() const {
+    return static_cast<unsigned>(m_queues.size());
+}
+
+void CThreadPool::work(unsigned worker) {
+    size_t index;
+    while (take(worker, index)) {
+        (*m_task)(index);
+    }
+}
+
+bool CThreadPool::take(unsigned worker, size_t &index) {
+    {
+        lock_guard<mutex> guard(m_queues[worker]->lock);
+        if (!m_queues[worker]->indices.empty()) {
+            index = m_queues[worker]->indices.front();
+            m_queues[worker]->indices.pop_front();
+            return true;
+        }
+    }
+    while (true) {
+        size_t victim = worker, largest = 0;
+        for (size_t other = 0; other < m_queues.size(); other++) {
+            lock_guard<mutex> guard(m_queues[other]->lock);
+            if (m_queues[other]->indices.size() > largest) {
+                largest = m_queues[other]->indices.size();
+                victim = other;
+            }
+        }
+        if (largest == 0) {
+            return false;
+        }
+        deque<size_t> stolen;
+        {
+            lock_guard<mutex> guard(m_queues[victim]->lock);
+            auto &indices = m_queues[victim]->indices;
+            size_t half = (indices.size() + 1) / 2;
+            // steal from the back, the owner takes from the front
+            stolen.assign(indices.end() - static_cast<long>(half), indices.end());
+            indices.erase(indices.end() - static_cast<long>(half), indices.end());
+        }
+        if (stolen.empty()) {
+            continue;
+        }
+        index = stolen.front();
+        stolen.pop_front();
+        lock_guard<mutex> guard(m_queues[worker]->lock);
+        m_queues[worker]->indices.insert(m_queues[worker]->indices.end(), stolen.begin(), stolen.end());
+        return true;
+    }
+}
+
+void CThreadPool::loop(unsigned worker) {
+    size_t seen_generation = 0;
+    while (true) {
+        {
+            unique_lock<mutex> guard(m_lock);
+            m_started.wait(guard, [&] { return m_stopping || m_generation != seen_generation; });
+            if (m_stopping) {
+                return;
+            }
+            seen_generation = m_generation;
+        }
+        work(worker);
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_working--;
+        }
+        m_finished.notify_one();
+    }
+}
@@ -0,0 +1,112 @@
+//
+// Created by bardanik on 15/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CTHREADPOOL_H
+#define PA2_BIG_TASK_CTHREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+using namespace std;
+
+/**
+ * Pool of worker threads which run indexed tasks in parallel. Each run splits task indices evenly
+ * between workers, every worker has its own queue of indices and when it runs out of work,
+ * it steals half of the remaining indices from the most loaded worker.
+ * The thread calling run() works as one of the workers. Runs called from several threads at once
+ * are done one after another, a task must not call run() on its own pool.
+ */
+class CThreadPool {
+public:
+    /**
+     * Starts worker threads.
+     * @param thread_count - number of threads working on tasks including the calling thread, at least 1.
+     */
+    explicit CThreadPool(unsigned thread_count);
+
+    CThreadPool(const CThreadPool &) = delete;
+
+    CThreadPool &operator=(const CThreadPool &) = delete;
+
+    /**
+     * Stops and joins worker threads.
+     */
+    ~CThreadPool();
+
+    /**
+     * Runs tasks with indices 0 to count - 1 and waits until all of them are done.
+     * @param count - number of tasks.
+     * @param task - task to run for every index, must not throw.
+     */
+    void run(size_t count, const function<void(size_t)> &task);
+
+    /**
+     * Runs tasks on a pool or one by one in the calling thread if there is no pool.
+     * @param pool - the pool or nullptr.
+     * @param count - number of tasks.
+     * @param task - task to run for every index, must not throw.
+     */
+    static void runOn(CThreadPool *pool, size_t count, const function<void(size_t)> &task);
+
+    /**
+     * Number of threads working on tasks including the calling thread.
+     */
+    unsigned getThreadCount() const;
+
+private:
+    /**
+     * Queue of task indices owned by a worker.
+     */
+    struct WorkQueue {
+        mutex lock;
+        deque<size_t> indices;
+    };
+
+    /**
+     * Runs tasks from own queue, steals from others when own queue is empty.
+     * @param worker - index of the worker.
+     */
+    void work(unsigned worker);
+
+    /**
+     * Takes task index from own queue, or steals half of the largest queue of other workers.
+     * @param worker - index of the worker.
+     * @param index - taken task index.
+     * @return false if there is no task left.
+     */
+    bool take(unsigned worker, size_t &index);
+
+    /**
+     * Loop of a worker thread waiting for runs.
+     * @param worker - index of the worker.
+     */
+    void loop(unsigned worker);
+
+    // Queues of all workers, the calling thread has the index 0.
+    vector<unique_ptr<WorkQueue>> m_queues;
+    // Started worker threads.
+    vector<thread> m_threads;
+    // Serializes runs, the queues and the run state below belong to one run at a time.
+    mutex m_run_lock;
+    // Task of the current run.
+    const function<void(size_t)> *m_task = nullptr;
+    // Guards the run state below.
+    mutex m_lock;
+    condition_variable m_started;
+    condition_variable m_finished;
+    // Incremented with every run, so waiting threads recognize a new run.
+    size_t m_generation = 0;
+    // Number of worker threads still working on the current run.
+    unsigned m_working = 0;
+    // If the pool is being destroyed.
+    bool m_stopping = false;
+};
+
+
+#endif //PA2_BIG_TASK_CTHREADPOOL_H
@@ -2,6 +2,7 @@
 // Created by bardanik on 04/05/24.
 //
 
+#include "../CASTOptimizer.h"
 #include "BinaryOperationNode.h"
 
 BinaryOperationNode::BinaryOperationNode(CASTNode *left_operand, CASTNode *right_operand) : m_left_operand(
@@ -9,39 +10,29 @@ BinaryOperationNode::BinaryOperationNode(CASTNode *left_operand, CASTNode *right
 
 }
 
-BinaryOperationNode::~BinaryOperationNode() {
-    delete m_left_operand;
-    delete m_right_operand;
-}
-
 pair<CValue, CValue> BinaryOperationNode::evaluateValues(CCycleDetectionVisitor &visitor) {
     return {m_left_operand->evaluate(visitor), m_right_operand->evaluate(visitor)};
 }
 
-template<typename L, typename R>
-bool BinaryOperationNode::typesAre(const CValue &first, const CValue &second) {
-    return holds_alternative<L>(first) && holds_alternative<R>(second);
-}
-
-template<typename L, typename R>
-bool BinaryOperationNode::typesAre(const pair<CValue, CValue> &values) {
-    return typesAre<L, R>(values.first, values.second);
+CASTNode *BinaryOperationNode::optimize(CASTOptimizer &optimizer) {
+    optimizer.optimize(m_left_operand);
+    optimizer.optimize(m_right_operand);
+    if (m_left_operand->isConstant() && m_right_operand->isConstant()) {
+        return optimizer.fold(*this);
+    }
+    return this;
 }
 
-template<typename L, typename R>
-pair<L, R> BinaryOperationNode::getValues(const CValue &first, const CValue &second) {
-    L left = get<L>(first);
-    R right = get<R>(second);
-    return {left, right};
+void BinaryOperationNode::compileOperation(CBytecode &program, CBytecode::OpCode op) const {
+    m_left_operand->compileShared(program);
+    m_right_operand->compileShared(program);
+    program.emit(op);
 }
 
-
-template<typename L, typename R>
-pair<L, R> BinaryOperationNode::getValues(const pair<CValue, CValue> &values) {
-    return getValues<L, R>(values.first, values.second);
+string BinaryOperationNode::operationToString(const string &operation) const {
+    return "(" + m_left_operand->getText() + " " + operation + " " + m_right_operand->getText() + ")";
 }
 
-
 AddNode::AddNode(CASTNode *left_operand, CASTNode *right_operand) : BinaryOperationNode(left_operand, right_operand) {
 
 }
@@ -65,6 +56,14 @@ CValue AddNode::evaluate(CCycleDetectionVisitor &visitor) {
     return result;
 }
 
+void AddNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::ADD);
+}
+
+string AddNode::toString() const {
+    return operationToString("+");
+}
+
 
 SubtractNode::SubtractNode(CASTNode *left_operand, CASTNode *right_operand) : BinaryOperationNode(left_operand, right_operand) {
 
@@ -80,6 +79,14 @@ CValue SubtractNode::evaluate(CCycleDetectionVisitor &visitor) {
     return result;
 }
 
+void SubtractNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::SUBTRACT);
+}
+
+string SubtractNode::toString() const {
+    return operationToString("-");
+}
+
 
 MultiplicationNode::MultiplicationNode(CASTNode *left_operand, CASTNode *right_operand) : BinaryOperationNode(left_operand,
                                                                                                               right_operand) {
@@ -97,6 +104,14 @@ CValue MultiplicationNode::evaluate(CCycleDetectionVisitor &visitor) {
     return result;
 }
 
+void MultiplicationNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::MULTIPLY);
+}
+
+string MultiplicationNode::toString() const {
+    return operationToString("*");
+}
+
 
 DivisionNode::DivisionNode(CASTNode *left_operand, CASTNode *right_operand) : BinaryOperationNode(left_operand, right_operand) {
 
@@ -116,6 +131,14 @@ CValue DivisionNode::evaluate(CCycleDetectionVisitor &visitor) {
     return result;
 }
 
+void DivisionNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::DIVIDE);
+}
+
+string DivisionNode::toString() const {
+    return operationToString("/");
+}
+
 
 PowerNode::PowerNode(CASTNode *left_operand, CASTNode *right_operand) : BinaryOperationNode(left_operand, right_operand) {
 
@@ -131,3 +154,11 @@ CValue PowerNode::evaluate(CCycleDetectionVisitor &visitor) {
     return result;
 }
 
+void PowerNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::POWER);
+}
+
+string PowerNode::toString() const {
+    return operationToString("^");
+}
+
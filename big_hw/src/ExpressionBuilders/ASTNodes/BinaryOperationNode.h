@@ -20,7 +20,7 @@ public:
      */
     BinaryOperationNode(CASTNode *left_operand, CASTNode *right_operand);
 
-    ~BinaryOperationNode();
+    CASTNode *optimize(CASTOptimizer &optimizer) override;
 
     /**
      * Get values of specified type from the CValue.
@@ -66,12 +66,49 @@ protected:
      */
     pair<CValue, CValue> evaluateValues(CCycleDetectionVisitor &visitor);
 
+    /**
+     * Appends instructions of both operands and of the operation to a program.
+     * @param program - program to which the instructions are appended.
+     * @param op - the binary operation.
+     */
+    void compileOperation(CBytecode &program, CBytecode::OpCode op) const;
+
+    /**
+     * Converts the operation to a parenthesized text with texts of both operands.
+     * @param operation - symbol of the operation.
+     * @return text of the operation.
+     */
+    string operationToString(const string &operation) const;
+
 private:
 
     CASTNode *m_left_operand;
     CASTNode *m_right_operand;
 };
 
+template<typename L, typename R>
+bool BinaryOperationNode::typesAre(const CValue &first, const CValue &second) {
+    return holds_alternative<L>(first) && holds_alternative<R>(second);
+}
+
+template<typename L, typename R>
+bool BinaryOperationNode::typesAre(const pair<CValue, CValue> &values) {
+    return typesAre<L, R>(values.first, values.second);
+}
+
+template<typename L, typename R>
+pair<L, R> BinaryOperationNode::getValues(const CValue &first, const CValue &second) {
+    L left = get<L>(first);
+    R right = get<R>(second);
+    return {left, right};
+}
+
+
+template<typename L, typename R>
+pair<L, R> BinaryOperationNode::getValues(const pair<CValue, CValue> &values) {
+    return getValues<L, R>(values.first, values.second);
+}
+
 /**
  * The node that performs addition operation on both operands.
  */
@@ -80,6 +117,10 @@ public:
     AddNode(CASTNode *left_operand, CASTNode *right_operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -90,6 +131,10 @@ public:
     SubtractNode(CASTNode *left_operand, CASTNode *right_operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -100,6 +145,10 @@ public:
     MultiplicationNode(CASTNode *left_operand, CASTNode *right_operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -110,6 +159,10 @@ public:
     DivisionNode(CASTNode *left_operand, CASTNode *right_operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 
@@ -121,6 +174,10 @@ public:
     PowerNode(CASTNode *left_operand, CASTNode *right_operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 #endif //PA2_BIG_TASK_BINARYOPERATIONNODE_H
@@ -0,0 +1,40 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CASTArena.h"
+
+CASTArena::~CASTArena() {
+    for (NodeHeader *header = m_last_node; header != nullptr; header = header->previous) {
+        header->node->~CASTNode();
+    }
+    while (m_last_block != nullptr) {
+        BlockHeader *previous = m_last_block->previous;
+        ::operator delete(m_last_block);
+        m_last_block = previous;
+    }
+}
+
+size_t CASTArena::getNodes() const {
+    return m_nodes;
+}
+
+size_t CASTArena::getBlocks() const {
+    return m_blocks;
+}
+
+void *CASTArena::allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (m_free == nullptr || static_cast<size_t>(m_end - m_free) < size) {
+        constexpr size_t header_size = (sizeof(BlockHeader) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        m_block_size = max(m_block_size == 0 ? FIRST_BLOCK : m_block_size * 2, header_size + size);
+        char *block = static_cast<char *>(::operator new(m_block_size));
+        m_last_block = new(block) BlockHeader{m_last_block};
+        m_free = block + header_size;
+        m_end = block + m_block_size;
+        m_blocks++;
+    }
+    void *memory = m_free;
+    m_free += size;
+    return memory;
+}
@@ -0,0 +1,112 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CASTARENA_H
+#define PA2_BIG_TASK_CASTARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "CASTNode.h"
+
+/**
+ * Bump allocator of AST nodes of one expression. Nodes are placed one after another into blocks of memory,
+ * which grow twice, so a typical expression needs a single allocation instead of one per node.
+ * Nodes do not own their operands - all nodes are destroyed at once with the arena, in the reverse order
+ * of their creation, and the blocks are freed.
+ */
+class CASTArena {
+public:
+    CASTArena() = default;
+
+    CASTArena(const CASTArena &) = delete;
+
+    CASTArena &operator=(const CASTArena &) = delete;
+
+    /**
+     * Destroys all created nodes and frees the blocks.
+     */
+    ~CASTArena();
+
+    /**
+     * Constructs a node in the arena.
+     * @tparam Node - type of the node.
+     * @param args - arguments of the constructor of the node.
+     * @return the node, which lives until the arena is destroyed.
+     */
+    template<typename Node, typename... Args>
+    Node *create(Args &&... args);
+
+    /**
+     * Gets number of nodes created in the arena.
+     * @return the number of nodes.
+     */
+    size_t getNodes() const;
+
+    /**
+     * Gets number of blocks allocated by the arena.
+     * @return the number of blocks.
+     */
+    size_t getBlocks() const;
+
+private:
+    /**
+     * Precedes each node in a block and links the nodes in the reverse order of their creation.
+     */
+    struct NodeHeader {
+        // Header of the previously created node.
+        NodeHeader *previous;
+        // The node after the header.
+        CASTNode *node;
+    };
+
+    /**
+     * Precedes memory of each block and links the blocks in the reverse order of their allocation.
+     */
+    struct BlockHeader {
+        // Previously allocated block.
+        BlockHeader *previous;
+    };
+
+    /**
+     * Allocates memory for a node with its header, a new block is allocated if the current one is full.
+     * @param size - size of the node with its header.
+     * @return aligned memory for the header and the node.
+     */
+    void *allocate(size_t size);
+
+    // Alignment of all allocations.
+    static constexpr size_t ALIGNMENT = alignof(max_align_t);
+    // Size of the first block, enough for nodes of a usual expression.
+    static constexpr size_t FIRST_BLOCK = 2048;
+
+    // Header of the last created node.
+    NodeHeader *m_last_node = nullptr;
+    // Last allocated block.
+    BlockHeader *m_last_block = nullptr;
+    // Free memory of the last block.
+    char *m_free = nullptr;
+    // End of the last block.
+    char *m_end = nullptr;
+    // Size of the last block.
+    size_t m_block_size = 0;
+    // Number of created nodes.
+    size_t m_nodes = 0;
+    // Number of allocated blocks.
+    size_t m_blocks = 0;
+};
+
+template<typename Node, typename... Args>
+Node *CASTArena::create(Args &&... args) {
+    static_assert(alignof(Node) <= ALIGNMENT);
+    constexpr size_t header_size = (sizeof(NodeHeader) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    char *memory = static_cast<char *>(allocate(header_size + sizeof(Node)));
+    Node *node = new(memory + header_size) Node(std::forward<Args>(args)...);
+    m_last_node = new(memory) NodeHeader{m_last_node, node};
+    m_nodes++;
+    return node;
+}
+
+
+#endif //PA2_BIG_TASK_CASTARENA_H
@@ -2,21 +2,32 @@
 // Created by bardanik on 14/04/24.
 //
 
+#include <sstream>
+#include <iomanip>
 #include "../../CSpreadsheet.h"
 #include "CASTNode.h"
 
 
-CReferenceNode::CReferenceNode(const string &pos, CSpreadsheet &spreadsheet, const pair<int, int> &offset)
+CReferenceNode::CReferenceNode(const string &pos, CSpreadsheet &spreadsheet)
         : m_reference_position(CPos(pos)),
           m_spreadsheet(spreadsheet) {
-    m_reference_position.shift(offset);
 }
 
 CValue CReferenceNode::evaluate(CCycleDetectionVisitor &visitor) {
-    auto value = m_spreadsheet.getValue(m_reference_position, visitor);
+    CPos position = m_reference_position;
+    position.shift(visitor.getShift());
+    auto value = m_spreadsheet.getValue(position, visitor);
     return value;
 }
 
+void CReferenceNode::compile(CBytecode &program) const {
+    program.emit(CBytecode::REFERENCE, program.addReference(m_reference_position));
+}
+
+string CReferenceNode::toString() const {
+    return m_reference_position.toString();
+}
+
 CStringNode::CStringNode(const string &parsed_value) : m_value({parsed_value}) {
 
 }
@@ -25,6 +36,23 @@ CValue CStringNode::evaluate(CCycleDetectionVisitor &visitor) {
     return m_value;
 }
 
+void CStringNode::compile(CBytecode &program) const {
+    program.emit(CBytecode::CONSTANT, program.addConstant(m_value));
+}
+
+string CStringNode::toString() const {
+    // quotes are doubled like in the expression syntax
+    string text = "\"";
+    for (char c: get<string>(m_value)) {
+        text += c == '"' ? "\"\"" : string(1, c);
+    }
+    return text + "\"";
+}
+
+bool CStringNode::isConstant() const {
+    return true;
+}
+
 
 CNumberNode::CNumberNode(double number) : m_number({number}) {
 
@@ -34,14 +62,31 @@ CValue CNumberNode::evaluate(CCycleDetectionVisitor &visitor) {
     return m_number;
 }
 
+void CNumberNode::compile(CBytecode &program) const {
+    program.emit(CBytecode::CONSTANT, program.addConstant(m_number));
+}
+
+string CNumberNode::toString() const {
+    // the shortest precision that keeps the number, so different numbers give different texts
+    double number = get<double>(m_number);
+    ostringstream text;
+    text << setprecision(15) << number;
+    if (stod(text.str()) != number) {
+        text.str("");
+        text << setprecision(17) << number;
+    }
+    return text.str();
+}
+
+bool CNumberNode::isConstant() const {
+    return true;
+}
+
 
 CRangeNode::CRangeNode(const string &from,
                        const string &to,
-                       CSpreadsheet &spreadsheet,
-                       const pair<int, int> &offset) : m_from_position(from), m_to_position(to),
-                                                       m_spreadsheet(spreadsheet) {
-    m_from_position.shift(offset);
-    m_to_position.shift(offset);
+                       CSpreadsheet &spreadsheet) : m_from_position(from), m_to_position(to),
+                                                    m_spreadsheet(spreadsheet) {
 
 }
 
@@ -49,22 +94,69 @@ CValue CRangeNode::evaluate(CCycleDetectionVisitor &visitor) {
     return {};
 }
 
-vector<CValue> CRangeNode::evaluateRange(CCycleDetectionVisitor &visitor) {
-    CRange range(m_spreadsheet);
-    range.select(m_from_position, m_to_position);
-    return range.evaluate(visitor);
+void CRangeNode::compile(CBytecode &program) const {
+    program.emit(CBytecode::CONSTANT, program.addConstant({}));
+}
+
+void CRangeNode::compileRange(CBytecode &program, CBytecode::OpCode range_op, CBytecode::OpCode value_op) const {
+    program.emit(range_op, program.addRange(m_from_position, m_to_position));
+}
+
+string CRangeNode::toString() const {
+    return m_from_position.toString() + ":" + m_to_position.toString();
 }
 
-size_t CRangeNode::rangeCapacity() const {
-    auto [row, col] = CPos::getOffset(m_from_position, m_to_position);
-    int h = row + 1, w = col + 1;
-    return h * w;
+size_t CRangeNode::evaluateRange(CCycleDetectionVisitor &visitor, const ValuesConsumer &values,
+                                 const NumbersConsumer &numbers) {
+    auto [from, to] = getCorners(visitor);
+    CRange range(m_spreadsheet);
+    range.select(from, to);
+    range.evaluate(visitor, values, numbers);
+    auto [row, col] = CPos::getOffset(from, to);
+    return static_cast<size_t>(row + 1) * static_cast<size_t>(col + 1);
 }
 
-vector<CValue> CASTNode::evaluateRange(CCycleDetectionVisitor &visitor) {
-    return {evaluate(visitor)};
+pair<CPos, CPos> CRangeNode::getCorners(const CCycleDetectionVisitor &visitor) const {
+    CPos from = m_from_position, to = m_to_position;
+    from.shift(visitor.getShift());
+    to.shift(visitor.getShift());
+    return {from, to};
 }
 
-size_t CASTNode::rangeCapacity() const {
+size_t CASTNode::evaluateRange(CCycleDetectionVisitor &visitor, const ValuesConsumer &values,
+                               const NumbersConsumer &numbers) {
+    values(evaluate(visitor));
     return 1;
 }
+
+void CASTNode::compileRange(CBytecode &program, CBytecode::OpCode range_op, CBytecode::OpCode value_op) const {
+    compileShared(program);
+    program.emit(value_op);
+}
+
+void CASTNode::compileShared(CBytecode &program) const {
+    uint32_t slot;
+    if (isConstant() || !program.findShared(getText(), slot)) {
+        compile(program);
+        return;
+    }
+    size_t load = program.emit(CBytecode::LOAD);
+    compile(program);
+    program.emit(CBytecode::STORE, slot);
+    program.setTarget(load);
+}
+
+const string &CASTNode::getText() const {
+    if (m_text.empty()) {
+        m_text = toString();
+    }
+    return m_text;
+}
+
+bool CASTNode::isConstant() const {
+    return false;
+}
+
+CASTNode *CASTNode::optimize(CASTOptimizer &optimizer) {
+    return this;
+}
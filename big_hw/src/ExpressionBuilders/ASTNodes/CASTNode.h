@@ -6,50 +6,111 @@
 #define PA2_BIG_TASK_CAST_H
 
 
+#include <cstdint>
 #include <variant>
 #include <vector>
 #include "../../SpreadsheetStructure/CPos.h"
+#include "../../Evaluation/CFunctionRef.h"
+#include "../../Evaluation/CBytecode.h"
 #include "../CycleDetectionVisitor/CCycleDetectionVisitor.h"
 
 class CSpreadsheet;
 
 class CRange;
 
+class CASTOptimizer;
+
 using namespace literals;
 
 // Value type that is stored in each cell - double, string or monostate (undefined).
 using CValue = variant<monostate, double, string>;
 
+// Receives numbers of a range - pointer to numbers and bitmap, i-th bit is set if i-th number is valid.
+using NumbersConsumer = CFunctionRef<void(const double *, uint64_t)>;
+// Receives values of a range one by one.
+using ValuesConsumer = CFunctionRef<void(const CValue &)>;
+
 /**
  * Represents an abstract node in the AST tree.
  */
 class CASTNode {
 public:
     /**
-     * Evaluates the node and returns the evaluation value.
+     * Evaluates the node by walking the tree and returns the evaluation value.
+     * Cells are evaluated by their compiled programs (CBytecode), the tree is evaluated only by the optimizer
+     * to fold constant subtrees and by tests as the reference the programs are compared to.
      * @param visitor - cycle detection visitor that is propagated to check for cycles.
      * @return evaluation of the node.
      */
     virtual CValue evaluate(CCycleDetectionVisitor &visitor) = 0;
 
     /**
-     * Evaluates range of nodes.
-     * Is used by CRangeNode to evaluate ranges. In case of other nodes
-     * returns just a vector with a single value.
-     * @param visitor - cycle detection visitor that is propagated to check for cycles.
-     * @return evaluations of each cell in range. In case of a non range node, returns
-     * a vector with a single element in it.
+     * Appends instructions which evaluate the node to a program, instructions of operands are appended first.
+     * @param program - program to which the instructions are appended.
+     */
+    virtual void compile(CBytecode &program) const = 0;
+
+    /**
+     * Appends instructions of a function over a range. Is used by CRangeNode to compile the function
+     * with the range, in case of other nodes the node is compiled and the function is applied on its value.
+     * @param program - program to which the instructions are appended.
+     * @param range_op - operation of the function over a range.
+     * @param value_op - operation of the function over a single value.
      */
-    virtual vector<CValue> evaluateRange(CCycleDetectionVisitor &visitor);
+    virtual void compileRange(CBytecode &program, CBytecode::OpCode range_op, CBytecode::OpCode value_op) const;
 
     /**
-     * Returns the size of the rectangular selection of the range,
-     * considering empty cells too.
-     * @return the size of the rectangualr selection.
+     * Appends instructions of the node like compile, but if the node is a shared subexpression of the program,
+     * its value is stored to a slot and loaded from the slot if it was already computed.
+     * Is used by nodes to compile their operands.
+     * @param program - program to which the instructions are appended.
      */
-    virtual size_t rangeCapacity() const;
+    void compileShared(CBytecode &program) const;
+
+    /**
+     * Converts the subtree to a text, operations are fully parenthesized. Identical subtrees give the same text,
+     * so it is used to find repeated subexpressions and to dump the optimized tree.
+     * @return text of the subtree.
+     */
+    virtual string toString() const = 0;
+
+    /**
+     * Gets text of the subtree like toString, but the text is computed only once, so texts of all subtrees
+     * are built in linear time. The subtree must not be changed after the text is computed.
+     * @return text of the subtree.
+     */
+    const string &getText() const;
+
+    /**
+     * Checks if the node is a literal, i.e. its value does not depend on any cell.
+     * @return true for number and string literals.
+     */
+    virtual bool isConstant() const;
+
+    /**
+     * Optimizes operands of the node by the optimizer and simplifies the node if possible.
+     * @param optimizer - optimizer of the tree.
+     * @return the node itself or a new node that replaces it, the old node is then deleted by the optimizer.
+     */
+    virtual CASTNode *optimize(CASTOptimizer &optimizer);
+
+    /**
+     * Evaluates range of nodes and passes values to consumers. Is used by CRangeNode to evaluate ranges,
+     * in case of other nodes the value of the node is passed. Packed number cells are passed by segments,
+     * so aggregate functions can use vectorized kernels on them.
+     * @param visitor - cycle detection visitor that is propagated to check for cycles.
+     * @param values - function receiving values of the other cells, or the value of a non range node.
+     * @param numbers - function receiving segments of packed numbers and bitmaps of valid numbers.
+     * @return number of positions of the range including empty ones, 1 for a non range node.
+     */
+    virtual size_t evaluateRange(CCycleDetectionVisitor &visitor, const ValuesConsumer &values,
+                                 const NumbersConsumer &numbers);
 
     virtual ~CASTNode() = default;
+
+private:
+    // Text of the subtree, empty until it is computed by getText.
+    mutable string m_text;
 };
 
 /**
@@ -65,6 +126,12 @@ public:
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
+    bool isConstant() const override;
+
 private:
     // Value of the node.
     CValue m_value;
@@ -73,6 +140,7 @@ private:
 /**
  * Represents a node that stores reference to another cell and also a spreadsheet,
  * where that cell is expected to be located. In evaluation finds that cell and gets value from the cell.
+ * The reference is shifted by the shift of the evaluated cell, look CCell documentation for details.
  */
 class CReferenceNode : public CASTNode {
 public:
@@ -80,14 +148,15 @@ public:
      * Constructs a reference node.
      * @param pos - position of the referenced cell.
      * @param spreadsheet - spreadsheet where the referenced cell is expected.
-     * @param offset - offset of the cell, that is used to construct reference node to point to
-     * the correct place, considering the global shift of the cell. Look CCell documentation for details
-     * of how it is implemented.
      */
-    CReferenceNode(const string &pos, CSpreadsheet &spreadsheet, const pair<int, int> &offset);
+    CReferenceNode(const string &pos, CSpreadsheet &spreadsheet);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     // Reference cell position.
     CPos m_reference_position;
@@ -103,22 +172,33 @@ private:
 class CRangeNode : public CASTNode {
 public:
     /**
-     * Constucts a range node.
+     * Constucts a range node. The corners are shifted by the shift of the evaluated cell,
+     * look at CCell documentation for details how it works.
      * @param from - upper left corner position of the range.
      * @param to - bottom right corner position of the range.
      * @param spreadsheet - spreadsheet where selection is made.
-     * @param offset - offset to consider shift if some cells were copied and shifted.
-     * Look at CCell documentation for details how it works.
      */
-    CRangeNode(const string &from, const string &to, CSpreadsheet &spreadsheet, const pair<int, int> &offset);
+    CRangeNode(const string &from, const string &to, CSpreadsheet &spreadsheet);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
-    vector<CValue> evaluateRange(CCycleDetectionVisitor &visitor) override;
+    void compile(CBytecode &program) const override;
+
+    void compileRange(CBytecode &program, CBytecode::OpCode range_op, CBytecode::OpCode value_op) const override;
+
+    size_t evaluateRange(CCycleDetectionVisitor &visitor, const ValuesConsumer &values,
+                         const NumbersConsumer &numbers) override;
 
-    size_t rangeCapacity() const override;
+    string toString() const override;
 
 private:
+    /**
+     * Gets corners of the range shifted by the shift of the evaluated cell.
+     * @param visitor - cycle detection visitor, knows shift of the evaluated cell.
+     * @return upper left and bottom right corner.
+     */
+    pair<CPos, CPos> getCorners(const CCycleDetectionVisitor &visitor) const;
+
     // Upper left corner position of the range.
     CPos m_from_position;
     // Bottom right corner position of the range.
@@ -136,6 +216,12 @@ public:
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
+    bool isConstant() const override;
+
 private:
     CValue m_number;
 };
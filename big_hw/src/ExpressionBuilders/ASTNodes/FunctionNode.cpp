@@ -2,7 +2,9 @@
 // Created by bardanik on 06/05/24.
 //
 
+#include "../CASTOptimizer.h"
 #include "FunctionNode.h"
+#include "../../Evaluation/CNumberKernels.h"
 #include "BinaryOperationNode.h"
 
 template<typename... Args>
@@ -10,10 +12,19 @@ FunctionNode::FunctionNode(Args... args) : m_args{args...} {
 
 }
 
-FunctionNode::~FunctionNode() {
-    for (auto *arg: m_args) {
-        delete arg;
+CASTNode *FunctionNode::optimize(CASTOptimizer &optimizer) {
+    for (auto &arg: m_args) {
+        optimizer.optimize(arg);
     }
+    return this;
+}
+
+string FunctionNode::functionToString(const string &name) const {
+    string text = name + "(";
+    for (size_t i = 0; i < m_args.size(); i++) {
+        text += (i ? ", " : "") + m_args[i]->getText();
+    }
+    return text + ")";
 }
 
 
@@ -22,38 +33,54 @@ SumNode::SumNode(CASTNode *m_range) : FunctionNode(m_range) {
 }
 
 CValue SumNode::evaluate(CCycleDetectionVisitor &visitor) {
-    auto range_node = m_args[0];
-    auto range = range_node->evaluateRange(visitor);
-    double sum = 0.0;
-    bool at_least_one_number = false;
-    for (auto &value: range) {
+    CNumberAggregate numbers(CNumberAggregate::SUM);
+    auto values = [&numbers](const CValue &value) {
         if (holds_alternative<double>(value)) {
-            at_least_one_number = true;
-            sum += get<double>(value);
+            numbers.add(&get<double>(value), 1);
         }
-    }
+    };
+    m_args[0]->evaluateRange(visitor, values, [&numbers](const double *segment, uint64_t mask) {
+        numbers.add(segment, mask);
+    });
 
-    if (at_least_one_number) {
-        return {sum};
+    if (numbers.count != 0) {
+        return {numbers.sum};
     }
     return {};
 }
 
+void SumNode::compile(CBytecode &program) const {
+    m_args[0]->compileRange(program, CBytecode::SUM_RANGE, CBytecode::NUMBER_VALUE);
+}
+
+string SumNode::toString() const {
+    return functionToString("sum");
+}
+
 CountNode::CountNode(CASTNode *m_range) : FunctionNode(m_range) {
 
 }
 
 CValue CountNode::evaluate(CCycleDetectionVisitor &visitor) {
-    auto range_node = m_args[0];
-    auto range = range_node->evaluateRange(visitor);
-    double count = 0.0;
-    for (auto &value: range) {
-        if (holds_alternative<monostate>(value)) {
-            continue;
+    CNumberAggregate numbers(0);
+    size_t count = 0;
+    auto values = [&count](const CValue &value) {
+        if (!holds_alternative<monostate>(value)) {
+            count++;
         }
-        count++;
-    }
-    return {count};
+    };
+    m_args[0]->evaluateRange(visitor, values, [&numbers](const double *segment, uint64_t mask) {
+        numbers.add(segment, mask);
+    });
+    return {static_cast<double>(count + numbers.count)};
+}
+
+void CountNode::compile(CBytecode &program) const {
+    m_args[0]->compileRange(program, CBytecode::COUNT_RANGE, CBytecode::COUNT_VALUE);
+}
+
+string CountNode::toString() const {
+    return functionToString("count");
 }
 
 MinNode::MinNode(CASTNode *m_range) : FunctionNode(m_range) {
@@ -61,88 +88,95 @@ MinNode::MinNode(CASTNode *m_range) : FunctionNode(m_range) {
 }
 
 CValue MinNode::evaluate(CCycleDetectionVisitor &visitor) {
-    auto range_node = m_args[0];
-    auto range = range_node->evaluateRange(visitor);
-    double min = 0.0;
-    bool at_least_one_number = false;
-    for (auto &value: range) {
+    CNumberAggregate numbers(CNumberAggregate::MIN);
+    auto values = [&numbers](const CValue &value) {
         if (holds_alternative<double>(value)) {
-            double number = get<double>(value);
-            if (at_least_one_number) {
-                if (min > number) {
-                    min = number;
-                }
-            } else {
-                at_least_one_number = true;
-                min = number;
-            }
-
+            numbers.add(&get<double>(value), 1);
         }
-    }
+    };
+    m_args[0]->evaluateRange(visitor, values, [&numbers](const double *segment, uint64_t mask) {
+        numbers.add(segment, mask);
+    });
 
-    if (at_least_one_number) {
-        return {min};
+    if (numbers.count != 0) {
+        return {numbers.min};
     }
     return {};
 }
 
+void MinNode::compile(CBytecode &program) const {
+    m_args[0]->compileRange(program, CBytecode::MIN_RANGE, CBytecode::NUMBER_VALUE);
+}
+
+string MinNode::toString() const {
+    return functionToString("min");
+}
+
 MaxNode::MaxNode(CASTNode *m_range) : FunctionNode(m_range) {
 
 }
 
 CValue MaxNode::evaluate(CCycleDetectionVisitor &visitor) {
-    auto range_node = m_args[0];
-    auto range = range_node->evaluateRange(visitor);
-    double max = 0.0;
-    bool at_least_one_number = false;
-    for (auto &value: range) {
+    CNumberAggregate numbers(CNumberAggregate::MAX);
+    auto values = [&numbers](const CValue &value) {
         if (holds_alternative<double>(value)) {
-            double number = get<double>(value);
-            if (at_least_one_number) {
-                if (max < number) {
-                    max = number;
-                }
-            } else {
-                at_least_one_number = true;
-                max = number;
-            }
-
+            numbers.add(&get<double>(value), 1);
         }
-    }
+    };
+    m_args[0]->evaluateRange(visitor, values, [&numbers](const double *segment, uint64_t mask) {
+        numbers.add(segment, mask);
+    });
 
-    if (at_least_one_number) {
-        return {max};
+    if (numbers.count != 0) {
+        return {numbers.max};
     }
     return {};
 }
 
-CountValNode::CountValNode(CASTNode *value, CASTNode *range) : FunctionNode(value, range) {
+void MaxNode::compile(CBytecode &program) const {
+    m_args[0]->compileRange(program, CBytecode::MAX_RANGE, CBytecode::NUMBER_VALUE);
+}
 
+string MaxNode::toString() const {
+    return functionToString("max");
 }
 
-CValue CountValNode::evaluate(CCycleDetectionVisitor &visitor) {
-    CValue value = m_args[0]->evaluate(visitor);
-    auto range = m_args[1]->evaluateRange(visitor);
+CountValNode::CountValNode(CASTNode *value, CASTNode *range) : FunctionNode(value, range) {
 
-    if (holds_alternative<double>(value)) {
-        return countValRange<double>(range, get<double>(value));
-    } else if (holds_alternative<string>(value)) {
-        return countValRange<string>(range, get<string>(value));
-    } else {
-        auto empty_cells_count = static_cast<double>(m_args[1]->rangeCapacity() - range.size());
-        return countValRange<monostate>(range, get<monostate>(value)) + empty_cells_count;
-    }
 }
 
-template<typename T>
-double CountValNode::countValRange(const vector<CValue> &range, const T &value) const {
+CValue CountValNode::evaluate(CCycleDetectionVisitor &visitor) {
+    CValue value = m_args[0]->evaluate(visitor);
     double count = 0.0;
-    for (auto &range_value: range) {
-        if (holds_alternative<T>(range_value) && get<T>(range_value) == value) {
+    // number of cells in the range, the other positions are empty and match only undefined value
+    size_t cells = 0;
+    auto values = [&value, &count, &cells](const CValue &range_value) {
+        cells++;
+        if (range_value == value) {
             count++;
         }
+    };
+    auto numbers = [&value, &count, &cells](const double *range_numbers, uint64_t mask) {
+        cells += CNumberKernels::count(mask);
+        if (holds_alternative<double>(value)) {
+            count += static_cast<double>(CNumberKernels::countEqual(range_numbers, mask, get<double>(value)));
+        }
+    };
+    size_t capacity = m_args[1]->evaluateRange(visitor, values, numbers);
+
+    if (holds_alternative<monostate>(value)) {
+        count += static_cast<double>(capacity - cells);
     }
-    return count;
+    return {count};
+}
+
+void CountValNode::compile(CBytecode &program) const {
+    m_args[0]->compileShared(program);
+    m_args[1]->compileRange(program, CBytecode::COUNTVAL_RANGE, CBytecode::COUNTVAL_VALUE);
+}
+
+string CountValNode::toString() const {
+    return functionToString("countval");
 }
 
 
@@ -163,3 +197,38 @@ CValue ConditionalNode::evaluate(CCycleDetectionVisitor &visitor) {
         return {};
     }
 }
+
+CASTNode *ConditionalNode::optimize(CASTOptimizer &optimizer) {
+    optimizer.optimize(m_args[0]);
+    CValue condition;
+    if (m_args[0]->isConstant()) {
+        CCycleDetectionVisitor visitor;
+        condition = m_args[0]->evaluate(visitor);
+    }
+    if (!holds_alternative<double>(condition)) {
+        optimizer.optimize(m_args[1]);
+        optimizer.optimize(m_args[2]);
+        return this;
+    }
+    // only the selected branch is optimized, the other one is not used anymore
+    size_t selected = get<double>(condition) == 0.0 ? 2 : 1;
+    optimizer.optimize(m_args[selected]);
+    return m_args[selected];
+}
+
+void ConditionalNode::compile(CBytecode &program) const {
+    // condition that is not a number gives undefined value, zero selects the second branch
+    m_args[0]->compileShared(program);
+    size_t test = program.emit(CBytecode::TEST);
+    size_t branch = program.emit(CBytecode::BRANCH);
+    m_args[1]->compileShared(program);
+    size_t jump = program.emit(CBytecode::JUMP);
+    program.setTarget(branch);
+    m_args[2]->compileShared(program);
+    program.setTarget(jump);
+    program.setTarget(test);
+}
+
+string ConditionalNode::toString() const {
+    return functionToString("if");
+}
@@ -21,9 +21,16 @@ public:
     template<typename... Args>
     explicit FunctionNode(Args... args);
 
-    ~FunctionNode();
+    CASTNode *optimize(CASTOptimizer &optimizer) override;
 
 protected:
+    /**
+     * Converts the function call to a text with texts of the arguments.
+     * @param name - name of the function.
+     * @return text of the function call.
+     */
+    string functionToString(const string &name) const;
+
     // Stores arguments passed to this function node.
     vector<CASTNode *> m_args;
 };
@@ -40,6 +47,10 @@ public:
     explicit SumNode(CASTNode *m_range);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -55,6 +66,9 @@ public:
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -70,6 +84,10 @@ public:
     explicit MinNode(CASTNode *m_range);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -85,6 +103,10 @@ public:
     explicit MaxNode(CASTNode *m_range);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 /**
@@ -102,17 +124,9 @@ public:
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
 
-private:
-    /**
-     * Performs counting based on given type, for example double, string or monostate (undefined).
-     * @tparam T - type of the reference value.
-     * @param range - vector of CValues (result of range node evaluation).
-     * @param value - represents a value to which to compare each value in a range to count it in.
-     * @return count of values from range that match the specified value argument.
-     */
-    template<typename T>
-    double countValRange(const vector<CValue> &range, const T &value) const;
+    void compile(CBytecode &program) const override;
 
+    string toString() const override;
 };
 
 /**
@@ -130,7 +144,16 @@ public:
      */
     explicit ConditionalNode(CASTNode *cond, CASTNode *if_true, CASTNode *if_false);
 
+    /**
+     * Optimizes the arguments. If the condition is a constant number, the node is replaced by the selected branch.
+     */
+    CASTNode *optimize(CASTOptimizer &optimizer) override;
+
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 
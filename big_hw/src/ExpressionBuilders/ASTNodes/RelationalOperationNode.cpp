@@ -28,6 +28,14 @@ EqualNode::EqualNode(CASTNode *left_operand, CASTNode *right_operand) : Relation
 
 }
 
+void EqualNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::EQUAL);
+}
+
+string EqualNode::toString() const {
+    return operationToString("=");
+}
+
 bool EqualNode::compare(double lhs, double rhs) {
     return lhs == rhs;
 }
@@ -41,6 +49,14 @@ LessThanNode::LessThanNode(CASTNode *left_operand, CASTNode *right_operand) : Re
 
 }
 
+void LessThanNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::LESS);
+}
+
+string LessThanNode::toString() const {
+    return operationToString("<");
+}
+
 bool LessThanNode::compare(double lhs, double rhs) {
     return lhs < rhs;
 }
@@ -54,6 +70,14 @@ NotEqualNode::NotEqualNode(CASTNode *left_operand, CASTNode *right_operand) : Re
 
 }
 
+void NotEqualNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::NOT_EQUAL);
+}
+
+string NotEqualNode::toString() const {
+    return operationToString("<>");
+}
+
 bool NotEqualNode::compare(double lhs, double rhs) {
     return lhs != rhs;
 }
@@ -67,6 +91,14 @@ GreaterThanNode::GreaterThanNode(CASTNode *left_operand, CASTNode *right_operand
                                                                                                             right_operand) {
 }
 
+void GreaterThanNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::GREATER);
+}
+
+string GreaterThanNode::toString() const {
+    return operationToString(">");
+}
+
 bool GreaterThanNode::compare(double lhs, double rhs) {
     return lhs > rhs;
 }
@@ -81,6 +113,14 @@ LessThanOrEqualNode::LessThanOrEqualNode(CASTNode *left_operand, CASTNode *right
 
 }
 
+void LessThanOrEqualNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::LESS_EQUAL);
+}
+
+string LessThanOrEqualNode::toString() const {
+    return operationToString("<=");
+}
+
 bool LessThanOrEqualNode::compare(double lhs, double rhs) {
     return lhs <= rhs;
 }
@@ -95,6 +135,14 @@ GreaterThanOrEqualNode::GreaterThanOrEqualNode(CASTNode *left_operand, CASTNode
 
 }
 
+void GreaterThanOrEqualNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::GREATER_EQUAL);
+}
+
+string GreaterThanOrEqualNode::toString() const {
+    return operationToString(">=");
+}
+
 bool GreaterThanOrEqualNode::compare(double lhs, double rhs) {
     return lhs >= rhs;
 }
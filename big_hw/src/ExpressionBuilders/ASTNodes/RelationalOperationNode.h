@@ -49,6 +49,10 @@ class EqualNode : public RelationalOperationNode {
 public:
     EqualNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -62,6 +66,10 @@ class NotEqualNode : public RelationalOperationNode {
 public:
     NotEqualNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -75,6 +83,10 @@ class LessThanNode : public RelationalOperationNode {
 public:
     LessThanNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -88,6 +100,10 @@ class GreaterThanNode : public RelationalOperationNode {
 public:
     GreaterThanNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -101,6 +117,10 @@ class LessThanOrEqualNode : public RelationalOperationNode {
 public:
     LessThanOrEqualNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -114,6 +134,10 @@ class GreaterThanOrEqualNode : public RelationalOperationNode {
 public:
     GreaterThanOrEqualNode(CASTNode *left_operand, CASTNode *right_operand);
 
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
+
 private:
     bool compare(double lhs, double rhs) override;
 
@@ -2,20 +2,34 @@
 // Created by bardanik on 04/05/24.
 //
 
+#include "../CASTOptimizer.h"
 #include "UnaryOperationNode.h"
 
 UnaryOperationNode::UnaryOperationNode(CASTNode *operand) : m_operand(operand) {
 
 }
 
-UnaryOperationNode::~UnaryOperationNode() {
-    delete m_operand;
-}
-
 CValue UnaryOperationNode::evaluateValue(CCycleDetectionVisitor &visitor) {
     return m_operand->evaluate(visitor);
 }
 
+CASTNode *UnaryOperationNode::optimize(CASTOptimizer &optimizer) {
+    optimizer.optimize(m_operand);
+    if (m_operand->isConstant()) {
+        return optimizer.fold(*this);
+    }
+    return this;
+}
+
+void UnaryOperationNode::compileOperation(CBytecode &program, CBytecode::OpCode op) const {
+    m_operand->compileShared(program);
+    program.emit(op);
+}
+
+string UnaryOperationNode::operationToString(const string &operation) const {
+    return "(" + operation + m_operand->getText() + ")";
+}
+
 
 NegationNode::NegationNode(CASTNode *operand) : UnaryOperationNode(operand) {
 
@@ -30,4 +44,12 @@ CValue NegationNode::evaluate(CCycleDetectionVisitor &visitor) {
         return result;
     }
     return {};
-}
\ No newline at end of file
+}
+
+void NegationNode::compile(CBytecode &program) const {
+    compileOperation(program, CBytecode::NEGATE);
+}
+
+string NegationNode::toString() const {
+    return operationToString("-");
+}
@@ -18,7 +18,7 @@ public:
      */
     explicit UnaryOperationNode(CASTNode *operand);
 
-    ~UnaryOperationNode();
+    CASTNode *optimize(CASTOptimizer &optimizer) override;
 
     /**
      * Evaluates the stored operand in the unary operation node.
@@ -28,6 +28,19 @@ public:
     CValue evaluateValue(CCycleDetectionVisitor &visitor);
 
 protected:
+    /**
+     * Appends instructions of the operand and of the operation to a program.
+     * @param program - program to which the instructions are appended.
+     * @param op - the unary operation.
+     */
+    void compileOperation(CBytecode &program, CBytecode::OpCode op) const;
+
+    /**
+     * Converts the operation to a text with text of the operand.
+     * @param operation - symbol of the operation.
+     * @return text of the operation.
+     */
+    string operationToString(const string &operation) const;
 
 private:
     // Operand on which operation is applied.
@@ -42,6 +55,10 @@ public:
     explicit NegationNode(CASTNode *operand);
 
     CValue evaluate(CCycleDetectionVisitor &visitor) override;
+
+    void compile(CBytecode &program) const override;
+
+    string toString() const override;
 };
 
 
@@ -5,9 +5,8 @@
 #include "CASTExpressionBuilder.h"
 
 
-CASTExpressionBuilder::CASTExpressionBuilder(CSpreadsheet &spreadsheet, const CCell *current_cell) :
-        m_spreadsheet(
-                spreadsheet), m_cell(current_cell) {
+CASTExpressionBuilder::CASTExpressionBuilder(CSpreadsheet &spreadsheet, CASTArena &arena) :
+        m_spreadsheet(spreadsheet), m_arena(arena) {
 }
 
 CASTNode *CASTExpressionBuilder::getResult() {
@@ -18,95 +17,98 @@ CASTNode *CASTExpressionBuilder::getResult() {
 
 void CASTExpressionBuilder::opAdd() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new AddNode(first, second);
+    CASTNode *node = m_arena.create<AddNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opSub() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new SubtractNode(first, second);
+    CASTNode *node = m_arena.create<SubtractNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opMul() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new MultiplicationNode(first, second);
+    CASTNode *node = m_arena.create<MultiplicationNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opDiv() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new DivisionNode(first, second);
+    CASTNode *node = m_arena.create<DivisionNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opPow() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new PowerNode(first, second);
+    CASTNode *node = m_arena.create<PowerNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opNeg() {
     auto arg = m_stack.top();
     m_stack.pop();
-    CASTNode *node = new NegationNode(arg);
+    CASTNode *node = m_arena.create<NegationNode>(arg);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opEq() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new EqualNode(first, second);
+    CASTNode *node = m_arena.create<EqualNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opNe() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new NotEqualNode(first, second);
+    CASTNode *node = m_arena.create<NotEqualNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opLt() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new LessThanNode(first, second);
+    CASTNode *node = m_arena.create<LessThanNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opLe() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new LessThanOrEqualNode(first, second);
+    CASTNode *node = m_arena.create<LessThanOrEqualNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opGt() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new GreaterThanNode(first, second);
+    CASTNode *node = m_arena.create<GreaterThanNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::opGe() {
     auto [first, second] = getNodesPairAndPop();
-    CASTNode *node = new GreaterThanOrEqualNode(first, second);
+    CASTNode *node = m_arena.create<GreaterThanOrEqualNode>(first, second);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::valNumber(double val) {
-    CASTNode *node = new CNumberNode(val);
+    CASTNode *node = m_arena.create<CNumberNode>(val);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::valString(string val) {
-    CASTNode *node = new CStringNode(val);
+    CASTNode *node = m_arena.create<CStringNode>(val);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::valReference(string val) {
-    CASTNode *node = new CReferenceNode(val, m_spreadsheet, m_cell->getShift());
+    CASTNode *node = m_arena.create<CReferenceNode>(val, m_spreadsheet);
+    CPos position(val);
+    m_references.emplace_back(position, position);
     m_stack.push(node);
 }
 
 void CASTExpressionBuilder::valRange(string val) {
     auto [from, to] = CRange::splitRange(val);
-    CASTNode *node = new CRangeNode(from, to, m_spreadsheet, m_cell->getShift());
+    CASTNode *node = m_arena.create<CRangeNode>(from, to, m_spreadsheet);
+    m_references.emplace_back(CPos(from), CPos(to));
     m_stack.push(node);
 }
 
@@ -114,22 +116,23 @@ void CASTExpressionBuilder::funcCall(std::string fnName, int paramCount) {
     CASTNode *function_node = nullptr;
     if (fnName == "sum") {
         auto args = getNodesAndPop<1>();
-        function_node = new SumNode(args[0]);
+        function_node = m_arena.create<SumNode>(args[0]);
     } else if (fnName == "count") {
         auto args = getNodesAndPop<1>();
-        function_node = new CountNode(args[0]);
+        function_node = m_arena.create<CountNode>(args[0]);
     } else if (fnName == "min") {
         auto args = getNodesAndPop<1>();
-        function_node = new MinNode(args[0]);
+        function_node = m_arena.create<MinNode>(args[0]);
     } else if (fnName == "max") {
         auto args = getNodesAndPop<1>();
-        function_node = new MaxNode(args[0]);
+        function_node = m_arena.create<MaxNode>(args[0]);
     } else if (fnName == "countval") {
         auto args = getNodesAndPop<2>();
-        function_node = new CountValNode(args[1], args[0]);
+        function_node = m_arena.create<CountValNode>(args[1], args[0]);
     } else if (fnName == "if") {
         auto args = getNodesAndPop<3>();
-        function_node = new ConditionalNode(args[2], args[1], args[0]);
+        function_node = m_arena.create<ConditionalNode>(args[2], args[1], args[0]);
+        m_conditional = true;
     } else {
         throw invalid_argument("No matching function: " + fnName);
     }
@@ -137,6 +140,14 @@ void CASTExpressionBuilder::funcCall(std::string fnName, int paramCount) {
 
 }
 
+const vector<pair<CPos, CPos>> &CASTExpressionBuilder::getReferences() const {
+    return m_references;
+}
+
+bool CASTExpressionBuilder::isConditional() const {
+    return m_conditional;
+}
+
 pair<CASTNode *, CASTNode *> CASTExpressionBuilder::getNodesPairAndPop() {
     auto *second_arg = m_stack.top();
     m_stack.pop();
@@ -146,12 +157,11 @@ pair<CASTNode *, CASTNode *> CASTExpressionBuilder::getNodesPairAndPop() {
 }
 
 template<size_t NArgs>
-vector<CASTNode *> CASTExpressionBuilder::getNodesAndPop() {
-    vector<CASTNode *> nodes;
+array<CASTNode *, NArgs> CASTExpressionBuilder::getNodesAndPop() {
+    array<CASTNode *, NArgs> nodes;
     for (size_t i = 0; i < NArgs; i++) {
-        CASTNode *node = m_stack.top();
+        nodes[i] = m_stack.top();
         m_stack.pop();
-        nodes.push_back(node);
     }
     return nodes;
 }
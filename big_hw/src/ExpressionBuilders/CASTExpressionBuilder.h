@@ -5,16 +5,16 @@
 #ifndef PA2_BIG_TASK_CASTEXPRESSIONBUILDER_H
 #define PA2_BIG_TASK_CASTEXPRESSIONBUILDER_H
 
+#include <array>
 #include <stack>
 #include "CExprBuilder.h"
 #include "ASTNodes/CASTNode.h"
+#include "ASTNodes/CASTArena.h"
 #include "ASTNodes/BinaryOperationNode.h"
 #include "ASTNodes/UnaryOperationNode.h"
 #include "ASTNodes/RelationalOperationNode.h"
 #include "ASTNodes/FunctionNode.h"
 
-class CCell;
-
 /**
  * Expression builder which constructs Abstract Syntactic Tree in expression parsing process.
  */
@@ -23,9 +23,10 @@ public:
     /**
      * Constructs AST expression builder.
      * @param spreadsheet - reference to a spreadsheet.
-     * @param current_cell - cell with expression that is being parsed.
+     * @param arena - arena where nodes are created, also nodes which are not taken as the result
+     * when parsing fails are destroyed with it.
      */
-    explicit CASTExpressionBuilder(CSpreadsheet &spreadsheet, const CCell *current_cell);
+    CASTExpressionBuilder(CSpreadsheet &spreadsheet, CASTArena &arena);
 
     void opAdd() override;
 
@@ -68,6 +69,19 @@ public:
      */
     CASTNode *getResult();
 
+    /**
+     * Returns corners of rectangles of cells referenced by the parsed expression, not shifted.
+     * A single reference is a rectangle with the same corners.
+     * @return referenced rectangles in the order they were parsed.
+     */
+    const vector<pair<CPos, CPos>> &getReferences() const;
+
+    /**
+     * Checks if the parsed expression contains a function that evaluates only some of its arguments.
+     * @return true if the expression contains if function.
+     */
+    bool isConditional() const;
+
 private:
 
     /**
@@ -79,17 +93,21 @@ private:
     /**
      * Get N number of AST nodes and removes them from top of the stack.
      * @tparam NArgs - number of nodes to extract.
-     * @return vector with NArgs nodes.
+     * @return array with NArgs nodes.
      */
     template<size_t NArgs>
-    vector<CASTNode *> getNodesAndPop();
+    array<CASTNode *, NArgs> getNodesAndPop();
 
-    // Stack for storing intermediate nodes.
-    stack<CASTNode *> m_stack;
+    // Stack for storing intermediate nodes, backed by a vector, which does not allocate until a node is pushed.
+    stack<CASTNode *, vector<CASTNode *>> m_stack;
     // Spreadsheet where the parsed cell is located.
     CSpreadsheet &m_spreadsheet;
-    // Cell that is being under the parse process.
-    const CCell *m_cell;
+    // Arena where nodes are created.
+    CASTArena &m_arena;
+    // Corners of rectangles of cells referenced by the expression.
+    vector<pair<CPos, CPos>> m_references;
+    // If the expression contains if function.
+    bool m_conditional = false;
 };
 
 #endif //PA2_BIG_TASK_CASTEXPRESSIONBUILDER_H
@@ -0,0 +1,52 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CASTOptimizer.h"
+
+CASTOptimizer::CASTOptimizer(CASTArena &arena) : m_arena(arena) {
+
+}
+
+CASTNode *CASTOptimizer::optimizeTree(CASTNode *root) {
+    optimize(root);
+    return root;
+}
+
+void CASTOptimizer::optimize(CASTNode *&node) {
+    CASTNode *result = node->optimize(*this);
+    if (result != node) {
+        // the replacement was already optimized and counted
+        m_folded++;
+        node = result;
+        return;
+    }
+    if (!node->isConstant()) {
+        m_occurrences[node->getText()]++;
+    }
+}
+
+CASTNode *CASTOptimizer::fold(CASTNode &node) {
+    // constant operands do not reference any cell, so the visitor is not used
+    CCycleDetectionVisitor visitor;
+    CValue value = node.evaluate(visitor);
+    if (holds_alternative<double>(value)) {
+        return m_arena.create<CNumberNode>(get<double>(value));
+    }
+    if (holds_alternative<string>(value)) {
+        return m_arena.create<CStringNode>(get<string>(value));
+    }
+    return &node;
+}
+
+void CASTOptimizer::share(CBytecode &program) const {
+    for (const auto &[expression, occurrences]: m_occurrences) {
+        if (occurrences > 1) {
+            program.share(expression);
+        }
+    }
+}
+
+size_t CASTOptimizer::getFolded() const {
+    return m_folded;
+}
@@ -0,0 +1,69 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CASTOPTIMIZER_H
+#define PA2_BIG_TASK_CASTOPTIMIZER_H
+
+#include <map>
+#include "ASTNodes/CASTNode.h"
+#include "ASTNodes/CASTArena.h"
+
+/**
+ * Optimization pass over the AST tree, which is run once after an expression is parsed.
+ * Subtrees with only literal operands are folded to a single literal node and if functions
+ * with a constant number condition are replaced by the selected branch. Texts of the other subtrees are counted,
+ * so subexpressions that occur more times can be computed only once by the compiled program.
+ */
+class CASTOptimizer {
+public:
+    /**
+     * Constructs the optimizer.
+     * @param arena - arena where nodes of the tree are created, folded nodes are created there too.
+     */
+    explicit CASTOptimizer(CASTArena &arena);
+
+    /**
+     * Optimizes the whole tree.
+     * @param root - root of the tree.
+     * @return root of the optimized tree.
+     */
+    CASTNode *optimizeTree(CASTNode *root);
+
+    /**
+     * Optimizes a subtree, is called by nodes on their operands.
+     * @param node - root of the subtree, is replaced if the subtree is simplified. Replaced nodes
+     * are destroyed with the arena.
+     */
+    void optimize(CASTNode *&node);
+
+    /**
+     * Folds a node with constant operands to a literal node.
+     * @param node - node to fold.
+     * @return new literal node with the value of the node, or the node itself if its value is undefined.
+     */
+    CASTNode *fold(CASTNode &node);
+
+    /**
+     * Marks subexpressions, which occur more times in the optimized tree, as shared in a program.
+     * @param program - program that will be compiled from the tree.
+     */
+    void share(CBytecode &program) const;
+
+    /**
+     * Gets number of folded nodes.
+     * @return number of nodes replaced by a literal or by a branch of if function.
+     */
+    size_t getFolded() const;
+
+private:
+    // Number of occurrences of texts of subtrees that are not constant.
+    map<string, size_t> m_occurrences;
+    // Number of folded nodes.
+    size_t m_folded = 0;
+    // Arena where folded nodes are created.
+    CASTArena &m_arena;
+};
+
+
+#endif //PA2_BIG_TASK_CASTOPTIMIZER_H
@@ -0,0 +1,122 @@
+//
+// Created by bardanik on 21/05/24.
+//
+
+#include <cstring>
+#include "CExpressionCache.h"
+
+shared_ptr<const CExpressionTemplate> CExpressionCache::get(const string &expression, CSpreadsheet &spreadsheet) {
+    string key = normalize(expression);
+    lock_guard<mutex> lock(m_mutex);
+    if (m_invalid.count(key) != 0) {
+        m_hits++;
+        return nullptr;
+    }
+    auto &entry = m_templates[key];
+    if (auto parsed = entry.lock()) {
+        m_hits++;
+        return parsed;
+    }
+    m_misses++;
+    try {
+        // the normalized text is parsed, so all expressions with the same key have the same meaning
+        auto parsed = make_shared<const CExpressionTemplate>(key, spreadsheet);
+        entry = parsed;
+        if (m_templates.size() > 2 * m_used + 1024) {
+            removeUnused();
+        }
+        return parsed;
+    } catch (invalid_argument &e) {
+        // the parser reports errors by exceptions, so each expression that is not valid is parsed only once
+        m_templates.erase(key);
+        // invalid expressions are not referenced by cells, so they are forgotten all at once when there are many
+        if (m_invalid.size() >= INVALID_EXPRESSIONS) {
+            m_invalid.clear();
+        }
+        m_invalid.insert(std::move(key));
+        return nullptr;
+    }
+}
+
+size_t CExpressionCache::getHits() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_hits;
+}
+
+size_t CExpressionCache::getMisses() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_misses;
+}
+
+size_t CExpressionCache::size() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_templates.size();
+}
+
+size_t CExpressionCache::getInvalid() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_invalid.size();
+}
+
+void CExpressionCache::clear() {
+    lock_guard<mutex> lock(m_mutex);
+    m_templates.clear();
+    m_invalid.clear();
+    m_used = 0;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+string CExpressionCache::normalize(const string &expression) {
+    string normalized;
+    normalized.reserve(expression.size());
+    bool in_string = false;
+    for (size_t i = 0; i < expression.size(); i++) {
+        char c = expression[i];
+        if (c == '"') {
+            // escaped quote inside a string literal toggles twice
+            in_string = !in_string;
+        }
+        if (in_string || !isspace(static_cast<unsigned char>(c))) {
+            normalized.push_back(c);
+            continue;
+        }
+        size_t next = i;
+        while (next < expression.size() && isspace(static_cast<unsigned char>(expression[next]))) {
+            next++;
+        }
+        char before = normalized.empty() ? '\0' : normalized.back();
+        char after = next < expression.size() ? expression[next] : '\0';
+        // a sign after exponent is a part of the number, e.g. "1e -5" must not become "1e-5"
+        bool exponent = (after == '+' || after == '-') && (before == 'e' || before == 'E');
+        bool sign = (before == '+' || before == '-') && normalized.size() >= 2
+                    && (normalized[normalized.size() - 2] == 'e' || normalized[normalized.size() - 2] == 'E');
+        // whitespace is kept where it may separate tokens, e.g. "< =" is not "<=" and "\"a\" \"b\"" is not "\"a\"\"b\""
+        bool separates = (isWordChar(before) && isWordChar(after)) || (isOperatorChar(before) && isOperatorChar(after))
+                         || ((before == '"' || after == '"') && before != '\0' && after != '\0');
+        if (separates || exponent || sign) {
+            normalized.push_back(' ');
+        }
+        i = next - 1;
+    }
+    return normalized;
+}
+
+bool CExpressionCache::isWordChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '$' || c == '.' || c == '_';
+}
+
+bool CExpressionCache::isOperatorChar(char c) {
+    return c != '\0' && strchr("+-*/^<>=!&|%", c) != nullptr;
+}
+
+void CExpressionCache::removeUnused() {
+    for (auto it = m_templates.begin(); it != m_templates.end();) {
+        if (it->second.expired()) {
+            it = m_templates.erase(it);
+        } else {
+            it++;
+        }
+    }
+    m_used = m_templates.size();
+}
@@ -0,0 +1,111 @@
+//
+// Created by bardanik on 21/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CEXPRESSIONCACHE_H
+#define PA2_BIG_TASK_CEXPRESSIONCACHE_H
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "CExpressionTemplate.h"
+
+/**
+ * Cache of parsed expressions of a spreadsheet, keyed by normalized text of the expression,
+ * so cells with the same expression share one parsed template even if they were set or loaded separately.
+ * The cache does not own templates, a template is dropped from the cache when no cell uses it.
+ */
+class CExpressionCache {
+public:
+    CExpressionCache() = default;
+
+    CExpressionCache(const CExpressionCache &) = delete;
+
+    CExpressionCache &operator=(const CExpressionCache &) = delete;
+
+    /**
+     * Finds a parsed expression with the same normalized text, or parses the normalized text and remembers it.
+     * Expressions that cannot be parsed are remembered too, so the parser fails on each of them only once.
+     * @param expression - expression to parse.
+     * @param spreadsheet - spreadsheet where referenced cells are expected.
+     * @return shared parsed expression or nullptr if the expression cannot be parsed.
+     */
+    shared_ptr<const CExpressionTemplate> get(const string &expression, CSpreadsheet &spreadsheet);
+
+    /**
+     * Gets number of expressions which were found in the cache.
+     * @return number of cache hits.
+     */
+    size_t getHits() const;
+
+    /**
+     * Gets number of expressions which had to be parsed, including expressions that are not valid.
+     * Expressions found to be not valid before are counted as hits.
+     * @return number of cache misses.
+     */
+    size_t getMisses() const;
+
+    /**
+     * Gets number of remembered parsed expressions, including the ones that are no longer used.
+     * @return number of cache entries.
+     */
+    size_t size() const;
+
+    /**
+     * Gets number of remembered expressions that cannot be parsed, at most INVALID_EXPRESSIONS.
+     * @return number of invalid expressions.
+     */
+    size_t getInvalid() const;
+
+    /**
+     * Removes all remembered expressions and resets the counters.
+     */
+    void clear();
+
+    /**
+     * Normalizes text of an expression, whitespaces outside string literals are removed unless they separate
+     * two names or numbers, two operator characters or a string literal from another token.
+     * @param expression - expression to normalize.
+     * @return normalized expression.
+     */
+    static string normalize(const string &expression);
+
+private:
+    /**
+     * Checks if a character can be part of a name, cell reference or number.
+     * @param c - character to check.
+     * @return true for letters, digits, '$', '.' and '_'.
+     */
+    static bool isWordChar(char c);
+
+    /**
+     * Checks if a character can be part of an operator.
+     * @param c - character to check.
+     * @return true for characters of arithmetic, relational and logical operators.
+     */
+    static bool isOperatorChar(char c);
+
+    /**
+     * Removes expressions which are no longer used by any cell.
+     */
+    void removeUnused();
+
+    // Maximal number of remembered invalid expressions.
+    static constexpr size_t INVALID_EXPRESSIONS = 4096;
+
+    // Parsed expressions by normalized text.
+    unordered_map<string, weak_ptr<const CExpressionTemplate>> m_templates;
+    // Normalized texts of expressions that cannot be parsed.
+    unordered_set<string> m_invalid;
+    // Number of entries after the last removal of unused expressions.
+    size_t m_used = 0;
+    // Number of cache hits.
+    size_t m_hits = 0;
+    // Number of cache misses.
+    size_t m_misses = 0;
+    // Cells are built in parallel evaluation too.
+    mutable mutex m_mutex;
+};
+
+
+#endif //PA2_BIG_TASK_CEXPRESSIONCACHE_H
@@ -0,0 +1,63 @@
+//
+// Created by bardanik on 20/05/24.
+//
+
+#include <algorithm>
+#include "CExpressionTemplate.h"
+
+CExpressionTemplate::CExpressionTemplate(const string &expression, CSpreadsheet &spreadsheet)
+        : m_program(spreadsheet), m_spreadsheet(&spreadsheet) {
+    CASTExpressionBuilder builder(spreadsheet, m_arena);
+    parseExpression(expression, builder);
+    CASTOptimizer optimizer(m_arena);
+    m_root = optimizer.optimizeTree(builder.getResult());
+    optimizer.share(m_program);
+    m_root->compile(m_program);
+    m_folded = optimizer.getFolded();
+    // repeated references give the same dependencies
+    for (const auto &reference: builder.getReferences()) {
+        if (find(m_references.begin(), m_references.end(), reference) == m_references.end()) {
+            m_references.push_back(reference);
+        }
+    }
+    m_conditional = builder.isConditional();
+}
+
+CASTNode &CExpressionTemplate::getRoot() const {
+    return *m_root;
+}
+
+vector<Rect> CExpressionTemplate::getReferences(const pair<int, int> &shift) const {
+    vector<Rect> references;
+    references.reserve(m_references.size());
+    for (auto [from, to]: m_references) {
+        from.shift(shift);
+        to.shift(shift);
+        references.emplace_back(from.getCoords(), to.getCoords());
+    }
+    return references;
+}
+
+const CASTArena &CExpressionTemplate::getArena() const {
+    return m_arena;
+}
+
+const CBytecode &CExpressionTemplate::getProgram() const {
+    return m_program;
+}
+
+bool CExpressionTemplate::isConditional() const {
+    return m_conditional;
+}
+
+bool CExpressionTemplate::belongsTo(const CSpreadsheet &spreadsheet) const {
+    return m_spreadsheet == &spreadsheet;
+}
+
+string CExpressionTemplate::dump() const {
+    string text = "tree: " + m_root->getText() + "\nfolded: " + to_string(m_folded) + "\n";
+    for (const auto &expression: m_program.getShared()) {
+        text += "shared: " + expression + "\n";
+    }
+    return text;
+}
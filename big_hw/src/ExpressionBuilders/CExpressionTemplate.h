@@ -0,0 +1,94 @@
+//
+// Created by bardanik on 20/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CEXPRESSIONTEMPLATE_H
+#define PA2_BIG_TASK_CEXPRESSIONTEMPLATE_H
+
+#include <memory>
+#include "CASTExpressionBuilder.h"
+#include "CASTOptimizer.h"
+
+/**
+ * Parsed expression shared by all copies of an expression cell. The AST tree is built once
+ * with references relative to the original position of the expression, copied cells store
+ * only their shift from it and the tree is evaluated relative to the shift of the evaluated cell.
+ * The tree is optimized by CASTOptimizer once after parsing and compiled to a program for a stack machine,
+ * which is used to evaluate cells. Nodes of the tree are created in an arena of the template and freed at once with it.
+ * The template is never changed after construction, so it can be evaluated from more threads at once.
+ */
+class CExpressionTemplate {
+public:
+    /**
+     * Parses an expression, builds and optimizes its AST tree and compiles it.
+     * @param expression - expression to parse.
+     * @param spreadsheet - spreadsheet where referenced cells are expected.
+     * @throws invalid_argument if the expression cannot be parsed.
+     */
+    CExpressionTemplate(const string &expression, CSpreadsheet &spreadsheet);
+
+    /**
+     * Gets the root of the AST tree.
+     * @return root node of the tree.
+     */
+    CASTNode &getRoot() const;
+
+    /**
+     * Gets the arena where nodes of the tree were created.
+     * @return the arena.
+     */
+    const CASTArena &getArena() const;
+
+    /**
+     * Gets the compiled program of the expression.
+     * @return program evaluating the expression.
+     */
+    const CBytecode &getProgram() const;
+
+    /**
+     * Gets rectangles of cells referenced by the expression of a cell shifted from the original position.
+     * A single reference is a rectangle with the same corners.
+     * @param shift - shift of the cell from the original position of the expression.
+     * @return referenced rectangles in the order they were parsed.
+     */
+    vector<Rect> getReferences(const pair<int, int> &shift) const;
+
+    /**
+     * Checks if the expression contains a function that evaluates only some of its arguments.
+     * @return true if the expression contains if function.
+     */
+    bool isConditional() const;
+
+    /**
+     * Checks if the tree was built for a given spreadsheet, i.e. its references point to cells of the spreadsheet.
+     * @param spreadsheet - spreadsheet to check.
+     * @return true if the template can be evaluated in the spreadsheet.
+     */
+    bool belongsTo(const CSpreadsheet &spreadsheet) const;
+
+    /**
+     * Dumps the optimized expression for debugging - its tree, number of folded nodes
+     * and subexpressions computed only once.
+     * @return text of the dump, one item per line.
+     */
+    string dump() const;
+
+private:
+    // Arena which owns all nodes of the AST tree.
+    CASTArena m_arena;
+    // Root of the AST tree.
+    CASTNode *m_root;
+    // Program compiled from the AST tree.
+    CBytecode m_program;
+    // Corners of referenced rectangles, not shifted.
+    vector<pair<CPos, CPos>> m_references;
+    // Spreadsheet where referenced cells are expected.
+    const CSpreadsheet *m_spreadsheet;
+    // If the expression contains if function.
+    bool m_conditional;
+    // Number of nodes folded by the optimizer.
+    size_t m_folded;
+};
+
+
+#endif //PA2_BIG_TASK_CEXPRESSIONTEMPLATE_H
@@ -2,16 +2,56 @@
 // Created by bardanik on 03/05/24.
 //
 
+#include "../../SpreadsheetStructure/CCell.h"
 #include "CCycleDetectionVisitor.h"
 
-void CCycleDetectionVisitor::visit(const CCell *cell) {
-    const auto &result = m_opened.insert(cell);
-    bool inserted = result.second;
-    if (!inserted) {
-        throw CCycleDetectedException();
+CCycleDetectionVisitor::CCycleDetectionVisitor() : m_epoch(++s_epoch) {
+    if (!s_free_shifts.empty()) {
+        m_shifts = std::move(s_free_shifts.back());
+        s_free_shifts.pop_back();
     }
 }
 
-void CCycleDetectionVisitor::leave(const CCell *cell) {
-    m_opened.erase(cell);
+CCycleDetectionVisitor::~CCycleDetectionVisitor() {
+    // buffers which never grew would only make the list longer
+    if (m_shifts.capacity() != 0) {
+        m_shifts.clear();
+        s_free_shifts.push_back(std::move(m_shifts));
+    }
+}
+
+bool CCycleDetectionVisitor::visit(const CExprCell *cell, const pair<int, int> &shift) {
+    if (cell->m_epoch.load(memory_order_relaxed) == m_epoch) {
+        m_cycle = true;
+        return false;
+    }
+    cell->m_epoch.store(m_epoch, memory_order_relaxed);
+    m_shifts.push_back(shift);
+    return true;
+}
+
+void CCycleDetectionVisitor::leave(const CExprCell *cell) {
+    cell->m_epoch.store(0, memory_order_relaxed);
+    m_shifts.pop_back();
+}
+
+bool CCycleDetectionVisitor::reach(const CExprCell *cell) {
+    if (cell->m_epoch.load(memory_order_relaxed) == m_epoch) {
+        return false;
+    }
+    cell->m_epoch.store(m_epoch, memory_order_relaxed);
+    return true;
+}
+
+void CCycleDetectionVisitor::reportCycle() {
+    m_cycle = true;
+}
+
+bool CCycleDetectionVisitor::hasCycle() const {
+    return m_cycle;
+}
+
+const pair<int, int> &CCycleDetectionVisitor::getShift() const {
+    static const pair<int, int> no_shift = {0, 0};
+    return m_shifts.empty() ? no_shift : m_shifts.back();
 }
@@ -4,44 +4,104 @@
 #ifndef PA2_BIG_TASK_CCYCLEDETECTIONVISITOR_H
 #define PA2_BIG_TASK_CCYCLEDETECTIONVISITOR_H
 
-#include <unordered_set>
-#include <exception>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 using namespace std;
 
-class CCell;
-
-/**
- * Exception that is thrown when cycle detection visitor detects a cycle in AST tree evaluation.
- */
-class CCycleDetectedException : public exception {
-};
+class CExprCell;
 
 /**
  * Class that visits each cell while AST evaluation. The evaluation is performed in DFS manner,
  * the visitor is passed recursively to next node and every time it arrives at a new cell,
  * it remembers that it was opened, so when the visitor arrives at already opened cell, it means
- * that there is oriented cycle, and throws a cycle detection exception. When evaluation of the cell
- * is done, the visitor leaves the node and marks it as closed/fresh. The node can be again opened from other
- * reference or range node.
+ * that there is oriented cycle, and the visitor remembers that the evaluation ended in a cycle. When evaluation
+ * of the cell is done, the visitor leaves the node and marks it as closed/fresh. The node can be again opened
+ * from other reference or range node.
+ *
+ * A cycle is not thrown as an exception, cells evaluated after the cycle was found have undefined value
+ * and are not cached, so the evaluation ends quickly and its result is undefined.
+ *
+ * Opened cells are not collected, each visitor gets a unique epoch and stamps opened cells by it,
+ * so opening and leaving a cell is one compare and store in the cell. Stamps left by visitors that
+ * found a cycle are different from the epoch of any other visitor, so they do not have to be cleaned.
+ * Epochs are 64-bit, so they do not wrap around and a stale stamp never matches a new visitor.
+ * A cell can be opened only by one visitor at a time - parallel evaluation evaluates different cells
+ * and their precedents are already evaluated, so they are not opened. Visitors of parallel evaluation can still
+ * compare and stamp a shared precedent concurrently, so stamps are atomic with relaxed ordering - a stamp
+ * is only compared with the visitor's own epoch and it does not publish any other data.
+ *
+ * The visitor also remembers shifts of the opened cells, because AST trees are shared by copied cells
+ * and references in them are shifted by the shift of the currently evaluated cell. Buffers of the shifts
+ * are reused by later visitors of the same thread, so constructing a visitor for each evaluation does not allocate.
  */
 class CCycleDetectionVisitor {
 public:
+    /**
+     * Constructs visitor with a new epoch.
+     */
+    CCycleDetectionVisitor();
+
+    CCycleDetectionVisitor(const CCycleDetectionVisitor &) = default;
+
+    CCycleDetectionVisitor &operator=(const CCycleDetectionVisitor &) = default;
+
+    /**
+     * Returns the buffer of shifts to the thread for later visitors.
+     */
+    ~CCycleDetectionVisitor();
+
     /**
      * Visits cell and marks it as opened.
      * @param cell - cell that is being visited.
+     * @param shift - shift of the cell from the original position of its expression.
+     * @return false if the cell is already opened, the cycle is remembered and the cell is not opened again.
      */
-    void visit(const CCell *cell);
+    bool visit(const CExprCell *cell, const pair<int, int> &shift = {0, 0});
 
     /**
      * Leaves cell and marks it as closed/fresh.
      * @param cell - cell that is being left.
      */
-    void leave(const CCell *cell);
+    void leave(const CExprCell *cell);
+
+    /**
+     * Marks cell as reached by a search in the dependency graph, the mark is not removed.
+     * @param cell - cell that is reached.
+     * @return false if the cell was already reached by this visitor.
+     */
+    bool reach(const CExprCell *cell);
+
+    /**
+     * Remembers that the evaluation ends in a cycle, e.g. when a cell marked as cyclic is evaluated.
+     */
+    void reportCycle();
+
+    /**
+     * Checks if the visitor found a cycle, values evaluated since then are not valid.
+     * @return true if a cycle was found.
+     */
+    bool hasCycle() const;
+
+    /**
+     * Gets shift of the cell that is currently evaluated, i.e. the last opened cell.
+     * @return row shift and col shift pair, zero if no cell is opened.
+     */
+    const pair<int, int> &getShift() const;
 
 private:
-    // Stores cells that is currently visited and marked as opened.
-    unordered_set<const CCell *> m_opened;
+    // Epoch of the last constructed visitor.
+    static inline atomic<uint64_t> s_epoch = 0;
+    // Emptied buffers of shifts of destroyed visitors of this thread, they keep their capacity.
+    static inline thread_local vector<vector<pair<int, int>>> s_free_shifts;
+
+    // Stamp of cells opened by this visitor, never 0.
+    uint64_t m_epoch;
+    // Shifts of opened cells in the order they were opened.
+    vector<pair<int, int>> m_shifts;
+    // If a cycle was found.
+    bool m_cycle = false;
 };
 
-#endif //PA2_BIG_TASK_CCYCLEDETECTIONVISITOR_H
\ No newline at end of file
+#endif //PA2_BIG_TASK_CCYCLEDETECTIONVISITOR_H
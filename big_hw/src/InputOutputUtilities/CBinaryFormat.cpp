@@ -0,0 +1,277 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CBinaryFormat.h"
+
+void CBinaryFormat::write(const CCellStorage &cells, string &buffer, CThreadPool *pool) {
+    auto partitions = CPartitions::write(cells, pool, [&cells](const Rect &rows, string &partition) {
+        writePartition(cells, rows, partition);
+    });
+    uint64_t size = 0;
+    string index;
+    for (const auto &partition: partitions) {
+        size += partition.size();
+        put(index, static_cast<uint64_t>(partition.size()));
+    }
+    size_t header = buffer.size(), table_size = 4 * CChecksum::blockCount(size);
+    buffer.reserve(header + HEADER_SIZE + index.size() + table_size + size);
+    buffer.append(HEADER_SIZE, '\0').append(index).append(table_size, '\0');
+    // partitions are freed as soon as they are copied
+    for (auto &partition: partitions) {
+        buffer.append(partition);
+        string().swap(partition);
+    }
+
+    // the header and the checksum table are written when the data are known
+    string table;
+    put(table, CChecksum::computeBlocks(string_view(buffer).substr(buffer.size() - size), pool));
+    string head(MAGIC);
+    put(head, VERSION);
+    put(head, static_cast<uint32_t>(partitions.size()));
+    put(head, size);
+    put(head, CChecksum::update(CChecksum::update(CChecksum::update(0, head), index), table));
+    buffer.replace(header, HEADER_SIZE, head);
+    buffer.replace(header + HEADER_SIZE + index.size(), table_size, table);
+}
+
+void CBinaryFormat::writePartition(const CCellStorage &cells, const Rect &rows, string &buffer) {
+    size_t start = buffer.size();
+    put(buffer, uint32_t(0));
+    uint32_t blocks = 0;
+    Block numbers(CCellType::NUMBER), strings(CCellType::STRING), expressions(CCellType::EXPRESSION);
+    auto added = [&buffer, &blocks](Block &block, const pair<int, int> &coords) {
+        block.rows.push_back(coords.first);
+        block.cols.push_back(coords.second);
+        if (block.size() == BLOCK_CELLS) {
+            block.flush(buffer);
+            blocks++;
+        }
+    };
+
+    cells.forEach(rows, [&](const pair<int, int> &coords, const CCell &cell) {
+        Block &block = cell.getType() == CCellType::STRING ? strings : expressions;
+        const auto &text = std::get<string>(cell.getContents());
+        if (block.type == CCellType::EXPRESSION) {
+            auto [shift_row, shift_col] = cell.getShift();
+            block.shift_rows.push_back(shift_row);
+            block.shift_cols.push_back(shift_col);
+        }
+        block.lengths.push_back(static_cast<uint32_t>(text.size()));
+        block.texts.append(text);
+        added(block, coords);
+    });
+    cells.forEachNumber(rows, [&](const pair<int, int> &coords, double number) {
+        numbers.numbers.push_back(number);
+        added(numbers, coords);
+    });
+    for (Block *block: {&strings, &expressions, &numbers}) {
+        if (block->size() != 0) {
+            block->flush(buffer);
+            blocks++;
+        }
+    }
+    string count;
+    put(count, blocks);
+    buffer.replace(start, count.size(), count);
+}
+
+bool CBinaryFormat::isBinary(string_view data) {
+    return data.substr(0, MAGIC.size()) == MAGIC;
+}
+
+bool CBinaryFormat::read(CHashingReader &reader, CCellStorage &cells, CThreadPool *pool) {
+    istream is(&reader);
+    char header[HEADER_SIZE];
+    if (!is.read(header, COMMON_HEADER_SIZE) || !isBinary({header, COMMON_HEADER_SIZE})) {
+        return false;
+    }
+    auto version = get<uint32_t>(header + 8);
+    // number of blocks, or number of partitions in the current version
+    auto count = get<uint32_t>(header + 12);
+    uint64_t hash = 0;
+    vector<uint64_t> partitions;
+    if (version == HASHED_VERSION) {
+        if (!is.read(header + COMMON_HEADER_SIZE, 8)) {
+            return false;
+        }
+        hash = get<uint64_t>(header + COMMON_HEADER_SIZE);
+        reader.restartHash();
+    } else if ((version != VERSION && version != UNPARTITIONED_VERSION)
+               || !readChecksums(is, reader, header, partitions)) {
+        return false;
+    }
+
+    if (version == VERSION) {
+        auto parse = [](string_view data, CCellStorage &part) {
+            return readPartition(data, part);
+        };
+        if (!CPartitions::read(reader, partitions, pool, cells, parse)) {
+            return false;
+        }
+    } else if (!readBlocks(is, reader, count, cells)) {
+        return false;
+    }
+    if (is.peek() != EOF) {
+        return false;
+    }
+    return reader.drain() && (version != HASHED_VERSION || reader.getHash() == hash);
+}
+
+bool CBinaryFormat::readChecksums(istream &is, CHashingReader &reader, char *header, vector<uint64_t> &partitions) {
+    if (!is.read(header + COMMON_HEADER_SIZE, HEADER_SIZE - COMMON_HEADER_SIZE)) {
+        return false;
+    }
+    auto size = get<uint64_t>(header + COMMON_HEADER_SIZE);
+    uint32_t checksum = CChecksum::update(0, {header, HEADER_SIZE - 4});
+    // the counts are not trusted, the index and the table grow only with values which were really read
+    char bytes[8];
+    uint64_t partitions_size = 0;
+    for (uint32_t i = 0; get<uint32_t>(header + 8) == VERSION && i < get<uint32_t>(header + 12); i++) {
+        if (!is.read(bytes, 8)) {
+            return false;
+        }
+        checksum = CChecksum::update(checksum, {bytes, 8});
+        partitions.push_back(get<uint64_t>(bytes));
+        partitions_size += partitions.back();
+    }
+    vector<uint32_t> checksums;
+    for (size_t i = 0; i < CChecksum::blockCount(size); i++) {
+        if (!is.read(bytes, 4)) {
+            return false;
+        }
+        checksum = CChecksum::update(checksum, {bytes, 4});
+        checksums.push_back(get<uint32_t>(bytes));
+    }
+    if (checksum != get<uint32_t>(header + HEADER_SIZE - 4) || (!partitions.empty() && partitions_size != size)) {
+        return false;
+    }
+    reader.startChecksums(std::move(checksums), size);
+    return true;
+}
+
+bool CBinaryFormat::readBlocks(istream &is, CHashingReader &reader, uint32_t blocks, CCellStorage &cells) {
+    string block;
+    for (uint32_t i = 0; i < blocks; i++) {
+        char block_header[BLOCK_HEADER_SIZE];
+        if (!is.read(block_header, BLOCK_HEADER_SIZE)) {
+            return false;
+        }
+        auto size = get<uint64_t>(block_header + 8);
+        // blocks in memory or in the current chunk are not copied
+        string_view data = reader.peek(size);
+        if (data.size() == size) {
+            reader.consume(size);
+        } else {
+            // the size is not trusted, the block grows only with data which were really read
+            block.clear();
+            while (block.size() < size) {
+                size_t read = block.size();
+                block.resize(read + min<uint64_t>(size - read, 1 << 20));
+                if (!is.read(block.data() + read, static_cast<streamsize>(block.size() - read))) {
+                    return false;
+                }
+            }
+            data = block;
+        }
+        if (!readBlock(get<uint32_t>(block_header), get<uint32_t>(block_header + 4), data, cells)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CBinaryFormat::readPartition(string_view data, CCellStorage &cells) {
+    if (data.size() < 4) {
+        return false;
+    }
+    auto blocks = get<uint32_t>(data.data());
+    size_t offset = 4;
+    for (uint32_t block = 0; block < blocks; block++) {
+        if (data.size() - offset < BLOCK_HEADER_SIZE) {
+            return false;
+        }
+        auto size = get<uint64_t>(data.data() + offset + 8);
+        if (size > data.size() - offset - BLOCK_HEADER_SIZE) {
+            return false;
+        }
+        if (!readBlock(get<uint32_t>(data.data() + offset), get<uint32_t>(data.data() + offset + 4),
+                       data.substr(offset + BLOCK_HEADER_SIZE, size), cells)) {
+            return false;
+        }
+        offset += BLOCK_HEADER_SIZE + size;
+    }
+    return offset == data.size();
+}
+
+bool CBinaryFormat::readBlock(uint32_t stored_type, size_t count, string_view data, CCellStorage &cells) {
+    if (stored_type > static_cast<uint32_t>(CCellType::EXPRESSION)) {
+        return false;
+    }
+    auto type = static_cast<CCellType>(stored_type);
+    // bytes of values of one cell stored in columns with fixed size
+    size_t cell_size = type == CCellType::NUMBER ? 16 : type == CCellType::STRING ? 12 : 20;
+    if (count * cell_size > data.size()) {
+        return false;
+    }
+
+    CCellPool &pool = cells.getPool();
+    const char *rows = data.data();
+    const char *cols = rows + 4 * count;
+    const char *values = cols + 4 * count;
+    const char *lengths = values + (type == CCellType::EXPRESSION ? 8 * count : 0);
+    size_t text = count * cell_size;
+    for (size_t i = 0; i < count; i++) {
+        pair<int, int> coords = {get<int32_t>(rows + 4 * i), get<int32_t>(cols + 4 * i)};
+        if (coords.first < 0 || coords.second < 0) {
+            return false;
+        }
+        if (type == CCellType::NUMBER) {
+            cells.setNumber(coords, get<double>(values + 8 * i));
+            continue;
+        }
+        size_t length = get<uint32_t>(lengths + 4 * i);
+        if (length > data.size() - text) {
+            return false;
+        }
+        string contents(data.data() + text, length);
+        text += length;
+        CCellHandle cell;
+        if (type == CCellType::STRING) {
+            cell = pool.create<CStringCell>(contents);
+        } else {
+            cell = pool.create<CExprCell>(contents);
+            pool.find(cell)->shift({get<int32_t>(values + 4 * i), get<int32_t>(values + 4 * (count + i))});
+        }
+        cells.set(coords, cell);
+    }
+    return text == data.size();
+}
+
+CBinaryFormat::Block::Block(CCellType type) : type(type) {
+}
+
+size_t CBinaryFormat::Block::size() const {
+    return rows.size();
+}
+
+void CBinaryFormat::Block::flush(string &buffer) {
+    size_t data_size = 8 * rows.size() + 8 * numbers.size() + 8 * shift_rows.size() + 4 * lengths.size()
+                       + texts.size();
+    put(buffer, static_cast<uint32_t>(type));
+    put(buffer, static_cast<uint32_t>(rows.size()));
+    put(buffer, static_cast<uint64_t>(data_size));
+    put(buffer, rows);
+    put(buffer, cols);
+    put(buffer, numbers);
+    put(buffer, shift_rows);
+    put(buffer, shift_cols);
+    put(buffer, lengths);
+    buffer.append(texts);
+    for (auto *column: {&rows, &cols, &shift_rows, &shift_cols}) {
+        column->clear();
+    }
+    numbers.clear();
+    lengths.clear();
+    texts.clear();
+}
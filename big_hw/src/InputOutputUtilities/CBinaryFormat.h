@@ -0,0 +1,227 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CBINARYFORMAT_H
+#define PA2_BIG_TASK_CBINARYFORMAT_H
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "../SpreadsheetStructure/CCellStorage.h"
+#include "CChecksum.h"
+#include "CHashingReader.h"
+#include "CPartitions.h"
+
+using namespace std;
+
+/**
+ * Versioned binary format of saved cells. Numbers are stored as exact IEEE doubles and strings
+ * with their lengths, so loading only copies values and does not parse any text.
+ *
+ * All integers are little endian. The file starts by a header: magic "PA2CELLS", uint32 version,
+ * uint32 number of partitions, uint64 size of the data and uint32 checksum of the header, the partition index
+ * and the checksum table. The partition index follows, it contains uint64 sizes of partitions (CPartitions),
+ * then the checksum table with uint32 checksums of all blocks of the data (CChecksum) and then the data.
+ * The data are partitions one after another, each partition is uint32 number of blocks and the blocks.
+ * A block contains cells of one type, it starts by uint32 type of the cells (CCellType),
+ * uint32 number of cells and uint64 size of its data. The data are columns of values of all cells
+ * of the block - int32 rows, int32 columns and then by the type:
+ * - numbers: doubles,
+ * - strings: uint32 lengths, followed by all strings without separators,
+ * - expressions: int32 row shifts, int32 column shifts, uint32 lengths, followed by all expressions.
+ *
+ * Files of older versions are read too. In version 2 the header contains number of blocks instead of
+ * partitions and the data are only the blocks. In version 1 the header contains uint64 hash of the rest
+ * of the file instead of the size and the checksums, and there is no checksum table.
+ */
+class CBinaryFormat {
+public:
+    /**
+     * Serializes cells to the binary format, partitions of cells are serialized in parallel.
+     * @param cells - cells to save.
+     * @param buffer - buffer to which the file is appended.
+     * @param pool - threads serializing partitions and computing checksums, nullptr to use only this thread.
+     */
+    static void write(const CCellStorage &cells, string &buffer, CThreadPool *pool = nullptr);
+
+    /**
+     * Checks if data start by the header of the binary format.
+     * @param data - beginning of a file.
+     * @return true if the data are in the binary format.
+     */
+    static bool isBinary(string_view data);
+
+    /**
+     * Reads cells from the binary format, partitions are parsed in parallel. Data in memory are read
+     * without copying, otherwise only one partition per thread is kept in memory.
+     * @param reader - reader of the whole file, which verifies the read data.
+     * @param cells - storage where cells are loaded, on failure it can contain a part of the cells.
+     * @param pool - threads parsing partitions, nullptr to parse them in this thread.
+     * @return false if the data are damaged or have an unknown version.
+     */
+    static bool read(CHashingReader &reader, CCellStorage &cells, CThreadPool *pool = nullptr);
+
+private:
+    /**
+     * Cells of one block, values are collected in columns.
+     */
+    struct Block {
+        // Type of the cells.
+        CCellType type;
+        // Positions of the cells.
+        vector<int32_t> rows, cols;
+        // Numbers of number cells.
+        vector<double> numbers;
+        // Shifts of expression cells.
+        vector<int32_t> shift_rows, shift_cols;
+        // Lengths of strings or expressions.
+        vector<uint32_t> lengths;
+        // Strings or expressions without separators.
+        string texts;
+
+        /**
+         * Constructs an empty block.
+         * @param type - type of the cells.
+         */
+        explicit Block(CCellType type);
+
+        /**
+         * Gets number of cells in the block.
+         */
+        size_t size() const;
+
+        /**
+         * Appends the block to the buffer and clears it.
+         * @param buffer - buffer where the file is written.
+         */
+        void flush(string &buffer);
+    };
+
+    /**
+     * Serializes cells of a partition.
+     * @param cells - cells to save.
+     * @param rows - rectangle of rows of the partition.
+     * @param buffer - buffer to which the partition is appended.
+     */
+    static void writePartition(const CCellStorage &cells, const Rect &rows, string &buffer);
+
+    /**
+     * Reads the rest of the header, the partition index and the checksum table of a file checked by checksums
+     * and starts checking of the data.
+     * @param is - stream of the file after the version and the number of partitions or blocks.
+     * @param reader - reader of the stream.
+     * @param header - buffer with the beginning of the header, at least HEADER_SIZE bytes.
+     * @param partitions - sizes of partitions from the index, empty for files without partitions.
+     * @return false if the header, the index or the checksum table is damaged.
+     */
+    static bool readChecksums(istream &is, CHashingReader &reader, char *header, vector<uint64_t> &partitions);
+
+    /**
+     * Reads cells of blocks one by one, blocks in memory or in the current chunk of a stream are not copied.
+     * @param is - stream of the file at the first block.
+     * @param reader - reader of the stream.
+     * @param blocks - number of blocks.
+     * @param cells - storage where cells are loaded.
+     * @return false if some block is damaged.
+     */
+    static bool readBlocks(istream &is, CHashingReader &reader, uint32_t blocks, CCellStorage &cells);
+
+    /**
+     * Reads cells of a partition.
+     * @param data - data of the partition.
+     * @param cells - storage where cells are loaded.
+     * @return false if the partition is damaged.
+     */
+    static bool readPartition(string_view data, CCellStorage &cells);
+
+    /**
+     * Reads cells of one block.
+     * @param type - type of the cells stored in the block header.
+     * @param count - number of cells stored in the block header.
+     * @param data - data of the block.
+     * @param cells - storage where cells are loaded.
+     * @return false if the block is damaged.
+     */
+    static bool readBlock(uint32_t type, size_t count, string_view data, CCellStorage &cells);
+
+    /**
+     * Appends an integer or a double in little endian.
+     */
+    template<typename Value>
+    static void put(string &buffer, Value value);
+
+    /**
+     * Appends a column of values in little endian.
+     */
+    template<typename Value>
+    static void put(string &buffer, const vector<Value> &values);
+
+    /**
+     * Reads an integer or a double stored in little endian.
+     * @param data - position of the value, does not have to be aligned.
+     */
+    template<typename Value>
+    static Value get(const char *data);
+
+    // Identifies files in the binary format.
+    static constexpr string_view MAGIC = "PA2CELLS";
+    // Version of the format which is written.
+    static constexpr uint32_t VERSION = 3;
+    // Version of files without partitions.
+    static constexpr uint32_t UNPARTITIONED_VERSION = 2;
+    // Version of files verified by a hash instead of checksums.
+    static constexpr uint32_t HASHED_VERSION = 1;
+    // Size of the file header.
+    static constexpr size_t HEADER_SIZE = 28;
+    // Size of the beginning of the header shared by all versions - magic, version and number of partitions or blocks.
+    static constexpr size_t COMMON_HEADER_SIZE = 16;
+    // Size of the block header.
+    static constexpr size_t BLOCK_HEADER_SIZE = 16;
+    // Maximal number of cells in a block.
+    static constexpr size_t BLOCK_CELLS = 65536;
+};
+
+template<typename Value>
+void CBinaryFormat::put(string &buffer, Value value) {
+    using Bits = conditional_t<sizeof(Value) == 8, uint64_t, uint32_t>;
+    auto bits = bit_cast<Bits>(value);
+    char bytes[sizeof(Bits)];
+    for (char &byte: bytes) {
+        byte = static_cast<char>(bits & 0xFF);
+        bits >>= 8;
+    }
+    buffer.append(bytes, sizeof(Bits));
+}
+
+template<typename Value>
+void CBinaryFormat::put(string &buffer, const vector<Value> &values) {
+    if constexpr (endian::native == endian::little) {
+        buffer.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(Value));
+    } else {
+        for (Value value: values) {
+            put(buffer, value);
+        }
+    }
+}
+
+template<typename Value>
+Value CBinaryFormat::get(const char *data) {
+    using Bits = conditional_t<sizeof(Value) == 8, uint64_t, uint32_t>;
+    Bits bits;
+    memcpy(&bits, data, sizeof(Bits));
+    if constexpr (endian::native != endian::little) {
+        Bits swapped = 0;
+        for (size_t i = 0; i < sizeof(Bits); i++) {
+            swapped = (swapped << 8) | (bits & 0xFF);
+            bits >>= 8;
+        }
+        bits = swapped;
+    }
+    return bit_cast<Value>(bits);
+}
+
+
+#endif //PA2_BIG_TASK_CBINARYFORMAT_H
@@ -0,0 +1,151 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include "CChecksum.h"
+
+#if defined(__x86_64__)
+#define CHECKSUM_X86
+
+#include <nmmintrin.h>
+
+#endif
+
+namespace {
+
+    // Reversed CRC32C polynomial.
+    constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+    /**
+     * Tables of slicing-by-8, the k-th table gives the checksum of a byte followed by k zero bytes.
+     */
+    constexpr array<array<uint32_t, 256>, 8> makeTables() {
+        array<array<uint32_t, 256>, 8> tables{};
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            uint32_t crc = byte;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+            }
+            tables[0][byte] = crc;
+        }
+        for (size_t table = 1; table < 8; table++) {
+            for (size_t byte = 0; byte < 256; byte++) {
+                uint32_t previous = tables[table - 1][byte];
+                tables[table][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+            }
+        }
+        return tables;
+    }
+
+    constexpr auto TABLES = makeTables();
+
+    uint64_t loadWord(const char *data) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        if constexpr (endian::native == endian::big) {
+            word = __builtin_bswap64(word);
+        }
+        return word;
+    }
+
+    uint32_t scalarUpdate(uint32_t crc, const char *data, size_t size) {
+        crc = ~crc;
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word = loadWord(data) ^ crc;
+            crc = TABLES[7][word & 0xFF] ^ TABLES[6][(word >> 8) & 0xFF]
+                  ^ TABLES[5][(word >> 16) & 0xFF] ^ TABLES[4][(word >> 24) & 0xFF]
+                  ^ TABLES[3][(word >> 32) & 0xFF] ^ TABLES[2][(word >> 40) & 0xFF]
+                  ^ TABLES[1][(word >> 48) & 0xFF] ^ TABLES[0][word >> 56];
+        }
+        for (; size > 0; data++, size--) {
+            crc = (crc >> 8) ^ TABLES[0][(crc ^ static_cast<uint8_t>(*data)) & 0xFF];
+        }
+        return ~crc;
+    }
+
+#ifdef CHECKSUM_X86
+
+    __attribute__((target("sse4.2")))
+    uint32_t sse42Update(uint32_t crc, const char *data, size_t size) {
+        uint64_t crc64 = ~crc;
+        for (; size >= 8; data += 8, size -= 8) {
+            crc64 = _mm_crc32_u64(crc64, loadWord(data));
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; size > 0; data++, size--) {
+            crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+        }
+        return ~crc;
+    }
+
+#endif
+
+}
+
+uint32_t CChecksum::update(uint32_t checksum, string_view data) {
+#ifdef CHECKSUM_X86
+    if (current() == SSE42) {
+        return sse42Update(checksum, data.data(), data.size());
+    }
+#endif
+    return scalarUpdate(checksum, data.data(), data.size());
+}
+
+size_t CChecksum::blockCount(uint64_t size) {
+    return static_cast<size_t>((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+vector<uint32_t> CChecksum::computeBlocks(string_view data, CThreadPool *pool) {
+    vector<uint32_t> checksums(blockCount(data.size()));
+    CThreadPool::runOn(pool, checksums.size(), [&data, &checksums](size_t block) {
+        checksums[block] = update(0, data.substr(block * BLOCK_SIZE, BLOCK_SIZE));
+    });
+    return checksums;
+}
+
+optional<size_t> CChecksum::findDamaged(string_view data, span<const uint32_t> checksums, CThreadPool *pool) {
+    size_t blocks = blockCount(data.size());
+    // blocks which are missing or have no checksum are damaged too
+    vector<char> damaged(max(blocks, checksums.size()), true);
+    CThreadPool::runOn(pool, min(blocks, checksums.size()), [&data, &checksums, &damaged](size_t block) {
+        damaged[block] = update(0, data.substr(block * BLOCK_SIZE, BLOCK_SIZE)) != checksums[block];
+    });
+    for (size_t block = 0; block < damaged.size(); block++) {
+        if (damaged[block]) {
+            return block;
+        }
+    }
+    return nullopt;
+}
+
+CChecksum::Implementation CChecksum::implementation() {
+    return current();
+}
+
+vector<CChecksum::Implementation> CChecksum::supported() {
+    vector<Implementation> implementations = {SCALAR};
+#ifdef CHECKSUM_X86
+    if (__builtin_cpu_supports("sse4.2")) {
+        implementations.push_back(SSE42);
+    }
+#endif
+    return implementations;
+}
+
+bool CChecksum::use(Implementation implementation) {
+    for (auto supported_implementation: supported()) {
+        if (supported_implementation == implementation) {
+            current() = implementation;
+            return true;
+        }
+    }
+    return false;
+}
+
+CChecksum::Implementation &CChecksum::current() {
+    static Implementation implementation = supported().back();
+    return implementation;
+}
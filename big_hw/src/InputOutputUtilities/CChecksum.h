@@ -0,0 +1,99 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CCHECKSUM_H
+#define PA2_BIG_TASK_CCHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "../Evaluation/CThreadPool.h"
+
+using namespace std;
+
+/**
+ * CRC32C (Castagnoli) checksums of saved data. Data are split into blocks of BLOCK_SIZE bytes,
+ * each block has its own checksum, so blocks are checked independently - in parallel,
+ * and a damaged block is found precisely.
+ *
+ * The checksum is computed by the SSE4.2 crc32 instruction or by a table-driven slicing-by-8 fallback,
+ * which processes 8 bytes per step. The implementation is chosen at runtime by features of the CPU.
+ */
+class CChecksum {
+public:
+    /**
+     * Implementations of the checksum.
+     */
+    enum Implementation {
+        SCALAR,
+        SSE42
+    };
+
+    /**
+     * Updates a checksum by following data.
+     * @param checksum - checksum of the previous data, 0 for no data.
+     * @param data - following data.
+     * @return checksum of all the data.
+     */
+    static uint32_t update(uint32_t checksum, string_view data);
+
+    /**
+     * Gets number of blocks of data.
+     * @param size - size of the data.
+     * @return the number of blocks, the last one can be shorter.
+     */
+    static size_t blockCount(uint64_t size);
+
+    /**
+     * Computes checksums of all blocks of data.
+     * @param data - data to check.
+     * @param pool - threads computing checksums of blocks in parallel, nullptr to compute them in this thread.
+     * @return checksums of the blocks.
+     */
+    static vector<uint32_t> computeBlocks(string_view data, CThreadPool *pool = nullptr);
+
+    /**
+     * Finds the first block of data which does not match its checksum.
+     * @param data - data to check.
+     * @param checksums - expected checksums of all blocks of the data.
+     * @param pool - threads checking blocks in parallel, nullptr to check them in this thread.
+     * @return index of the damaged block or nothing if all blocks match.
+     */
+    static optional<size_t> findDamaged(string_view data, span<const uint32_t> checksums, CThreadPool *pool = nullptr);
+
+    /**
+     * Gets the implementation used, the best supported one unless changed by use().
+     * @return used implementation.
+     */
+    static Implementation implementation();
+
+    /**
+     * Finds implementations supported by the CPU.
+     * @return supported implementations, scalar is always supported.
+     */
+    static vector<Implementation> supported();
+
+    /**
+     * Changes the used implementation, is meant for testing and benchmarks.
+     * Must not be called while checksums are computed by other threads.
+     * @param implementation - implementation to use.
+     * @return true if the implementation is supported and is used from now.
+     */
+    static bool use(Implementation implementation);
+
+    // Size of checked blocks of data.
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+private:
+    /**
+     * Gets variable holding the used implementation.
+     */
+    static Implementation &current();
+};
+
+
+#endif //PA2_BIG_TASK_CCHECKSUM_H
@@ -0,0 +1,175 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CHashingReader.h"
+
+CHashingReader::CHashingReader(istream &source) : m_source(&source), m_chunk(CHUNK_SIZE), m_hashed(nullptr) {
+    setg(m_chunk.data(), m_chunk.data(), m_chunk.data());
+    m_hashed = gptr();
+}
+
+CHashingReader::CHashingReader(string_view data, CThreadPool *pool) : m_source(nullptr), m_hashed(data.data()),
+                                                                     m_pool(pool) {
+    // the get area is only read, streambuf just does not have a const interface
+    char *begin = const_cast<char *>(data.data());
+    setg(begin, begin, begin + data.size());
+}
+
+string_view CHashingReader::peek(size_t size) {
+    if (gptr() == egptr()) {
+        underflow();
+    }
+    return {gptr(), min(size, static_cast<size_t>(egptr() - gptr()))};
+}
+
+bool CHashingReader::read(uint64_t size, string &buffer, string_view &data) {
+    if (m_source == nullptr) {
+        data = peek(size);
+        consume(data.size());
+        return data.size() == size;
+    }
+    buffer.clear();
+    while (buffer.size() < size) {
+        size_t read = buffer.size();
+        buffer.resize(read + min<uint64_t>(size - read, 1 << 20));
+        auto count = static_cast<streamsize>(buffer.size() - read);
+        if (sgetn(buffer.data() + read, count) != count) {
+            return false;
+        }
+    }
+    data = buffer;
+    return true;
+}
+
+void CHashingReader::consume(size_t size) {
+    setg(eback(), gptr() + size, egptr());
+}
+
+void CHashingReader::restartHash() {
+    m_hashing = true;
+    m_hash = INITIAL_HASH;
+    m_hashed = gptr();
+}
+
+void CHashingReader::startChecksums(vector<uint32_t> checksums, uint64_t size) {
+    m_checking = true;
+    m_hashing = false;
+    m_checksums = std::move(checksums);
+    m_block = 0;
+    m_block_checksum = 0;
+    m_block_read = 0;
+    m_remaining = size;
+    m_trailing = false;
+    m_damaged = nullopt;
+    check({gptr(), static_cast<size_t>(egptr() - gptr())});
+}
+
+optional<size_t> CHashingReader::getDamagedBlock() const {
+    return m_damaged;
+}
+
+uint64_t CHashingReader::getHash() {
+    hashConsumed();
+    return m_hash;
+}
+
+bool CHashingReader::drain() {
+    while (underflow() != traits_type::eof()) {
+        setg(eback(), egptr(), egptr());
+    }
+    hashConsumed();
+    if (m_source != nullptr && m_source->bad()) {
+        return false;
+    }
+    if (!m_checking) {
+        return true;
+    }
+    if (m_source != nullptr && m_remaining == 0 && !m_damaged && !m_trailing) {
+        m_trailing = m_source->peek() != EOF;
+    }
+    return !m_damaged && !m_trailing && m_remaining == 0 && m_block == m_checksums.size();
+}
+
+uint64_t CHashingReader::hash(uint64_t hash, string_view data) {
+    for (char c: data) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash;
+}
+
+CHashingReader::int_type CHashingReader::underflow() {
+    if (gptr() != egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    hashConsumed();
+    if (m_checking && (m_remaining == 0 || m_damaged)) {
+        return traits_type::eof();
+    }
+    size_t read = 0;
+    if (m_source != nullptr) {
+        m_source->read(m_chunk.data(), static_cast<streamsize>(m_chunk.size()));
+        read = static_cast<size_t>(m_source->gcount());
+        setg(m_chunk.data(), m_chunk.data(), m_chunk.data() + read);
+        m_hashed = gptr();
+    }
+    if (m_checking) {
+        check({gptr(), read});
+        // the block where the data end too early is damaged
+        if (read == 0 && !m_damaged) {
+            m_damaged = m_block;
+        }
+    }
+    if (gptr() == egptr()) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+void CHashingReader::check(string_view data) {
+    if (data.size() > m_remaining) {
+        m_trailing = true;
+        data = data.substr(0, m_remaining);
+    }
+    m_remaining -= data.size();
+    span<const uint32_t> checksums(m_checksums);
+    size_t offset = 0;
+    while (offset < data.size() && !m_damaged) {
+        size_t whole_blocks = (data.size() - offset) / CChecksum::BLOCK_SIZE;
+        if (m_block_read == 0 && whole_blocks > 0) {
+            // whole blocks are checked together, so they can be checked in parallel
+            size_t first = min(m_block, checksums.size());
+            auto damaged = CChecksum::findDamaged(data.substr(offset, whole_blocks * CChecksum::BLOCK_SIZE),
+                                                  checksums.subspan(first, min(whole_blocks, checksums.size() - first)),
+                                                  m_pool);
+            if (damaged) {
+                m_damaged = m_block + *damaged;
+            }
+            m_block += whole_blocks;
+            offset += whole_blocks * CChecksum::BLOCK_SIZE;
+            continue;
+        }
+        size_t size = min(CChecksum::BLOCK_SIZE - m_block_read, data.size() - offset);
+        m_block_checksum = CChecksum::update(m_block_checksum, data.substr(offset, size));
+        m_block_read += size;
+        offset += size;
+        if (m_block_read == CChecksum::BLOCK_SIZE || m_remaining == 0) {
+            if (m_block >= checksums.size() || m_block_checksum != checksums[m_block]) {
+                m_damaged = m_block;
+            }
+            m_block++;
+            m_block_checksum = 0;
+            m_block_read = 0;
+        }
+    }
+    // damaged data are not parsed at all
+    setg(eback(), gptr(), m_damaged ? gptr() : gptr() + data.size());
+}
+
+void CHashingReader::hashConsumed() {
+    if (!m_hashing) {
+        return;
+    }
+    m_hash = hash(m_hash, string_view(m_hashed, static_cast<size_t>(gptr() - m_hashed)));
+    m_hashed = gptr();
+}
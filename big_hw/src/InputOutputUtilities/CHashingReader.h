@@ -0,0 +1,160 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CHASHINGREADER_H
+#define PA2_BIG_TASK_CHASHINGREADER_H
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CChecksum.h"
+
+using namespace std;
+
+/**
+ * Stream buffer which reads an input stream in chunks of fixed size and verifies the data incrementally,
+ * so loaded data are verified while they are parsed and do not have to be kept in memory.
+ * Data in memory can be read the same way without copying them.
+ *
+ * Data are verified by checksums of their blocks (CChecksum), which are checked when the data are read,
+ * before they are parsed, or by a hash of the whole consumed data, which is used by files of old versions.
+ */
+class CHashingReader : public streambuf {
+public:
+    /**
+     * Constructs reader of an input stream.
+     * @param source - stream from which the data are read.
+     */
+    explicit CHashingReader(istream &source);
+
+    /**
+     * Constructs reader of data in memory, the data must live as long as the reader.
+     * @param data - data to read.
+     * @param pool - threads checking blocks of the data in parallel, nullptr to check them in this thread.
+     */
+    explicit CHashingReader(string_view data, CThreadPool *pool = nullptr);
+
+    /**
+     * Gets next bytes without consuming them.
+     * @param size - number of bytes.
+     * @return at most size bytes, less only if the data end or the bytes are split between two chunks.
+     */
+    string_view peek(size_t size);
+
+    /**
+     * Reads next bytes. Data in memory are not copied, data of a stream are copied to a buffer.
+     * @param size - number of bytes, the buffer grows only with bytes which were really read.
+     * @param buffer - buffer for data of a stream.
+     * @param data - the read bytes, valid as long as the data in memory or the buffer.
+     * @return false if the data end before size bytes.
+     */
+    bool read(uint64_t size, string &buffer, string_view &data);
+
+    /**
+     * Consumes next bytes, which were already processed by the caller.
+     * @param size - number of bytes, at most the size returned by peek().
+     */
+    void consume(size_t size);
+
+    /**
+     * Starts a new hash from the current position, e.g. after a header containing the hash.
+     * Data are not hashed until the hash is started.
+     */
+    void restartHash();
+
+    /**
+     * Starts checking data from the current position by checksums of their blocks, the data end after size bytes.
+     * Reading stops at the first damaged block, so damaged data are never parsed.
+     * @param checksums - checksums of all blocks of the data.
+     * @param size - size of the data, the source must not contain anything after them.
+     */
+    void startChecksums(vector<uint32_t> checksums, uint64_t size);
+
+    /**
+     * Gets the first block of checked data which does not match its checksum.
+     * @return index of the block or nothing if no damaged block was read.
+     */
+    optional<size_t> getDamagedBlock() const;
+
+    /**
+     * Gets hash of data consumed since the hash was started.
+     * @return hash of the data.
+     */
+    uint64_t getHash();
+
+    /**
+     * Consumes the rest of the data, so the hash contains them too.
+     * @return false if reading of the source stream failed or checked data are damaged, incomplete
+     * or followed by other data.
+     */
+    bool drain();
+
+    /**
+     * Updates a hash by following data.
+     * @param hash - hash of the previous data, INITIAL_HASH for no data.
+     * @param data - following data.
+     * @return hash of all the data.
+     */
+    static uint64_t hash(uint64_t hash, string_view data);
+
+    // Hash of empty data.
+    static constexpr uint64_t INITIAL_HASH = 5381;
+
+protected:
+    /**
+     * Hashes the consumed chunk and reads the next one, which is checked if checksums were started.
+     */
+    int_type underflow() override;
+
+private:
+    /**
+     * Adds data consumed since the last call to the hash.
+     */
+    void hashConsumed();
+
+    /**
+     * Checks read data by checksums and limits the get area to the checked data.
+     * @param data - data which were read, the data start at the beginning of the get area.
+     */
+    void check(string_view data);
+
+    // Size of chunks read from the source stream.
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    // Stream from which data are read, nullptr if the data are in memory.
+    istream *m_source;
+    // The last read chunk.
+    vector<char> m_chunk;
+    // Beginning of consumed data which are not hashed yet.
+    const char *m_hashed;
+    // If the consumed data are hashed.
+    bool m_hashing = false;
+    // Hash of the consumed data before m_hashed.
+    uint64_t m_hash = INITIAL_HASH;
+    // Threads checking blocks in parallel.
+    CThreadPool *m_pool = nullptr;
+    // If the data are checked by checksums instead of the hash.
+    bool m_checking = false;
+    // Expected checksums of blocks of the checked data.
+    vector<uint32_t> m_checksums;
+    // Index of the block which is being checked.
+    size_t m_block = 0;
+    // Checksum of the read part of the block which is being checked.
+    uint32_t m_block_checksum = 0;
+    // Size of the read part of the block which is being checked.
+    size_t m_block_read = 0;
+    // Size of the checked data which were not read yet.
+    uint64_t m_remaining = 0;
+    // If the source contains something after the checked data.
+    bool m_trailing = false;
+    // The first damaged block.
+    optional<size_t> m_damaged;
+};
+
+
+#endif //PA2_BIG_TASK_CHASHINGREADER_H
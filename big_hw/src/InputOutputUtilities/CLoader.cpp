@@ -2,6 +2,7 @@
 // Created by bardanik on 28/04/24.
 //
 
+#include <charconv>
 #include "../CSpreadsheet.h"
 
 CLoader::CLoader(istream &is) : m_is(&is), m_os(nullptr) {
@@ -12,78 +13,233 @@ CLoader::CLoader(ostream &os) : m_is(nullptr), m_os(&os) {
 
 }
 
-bool CLoader::save(const Cells &cells) {
-    loadBuffer(cells);
+CLoader::CLoader(const string &filename) : m_is(nullptr), m_os(nullptr), m_filename(filename) {
 
-    m_hash = getHash();
-    m_os->write(m_hash.data(), static_cast<long>(HASH_SIZE));
-    m_os->write(m_buffer.data(), static_cast<long>(m_buffer.size()));
+}
+
+void CLoader::setThreadPool(CThreadPool *pool) {
+    m_pool = pool;
+}
+
+optional<size_t> CLoader::getDamagedBlock() const {
+    return m_damaged;
+}
+
+bool CLoader::save(const CCellStorage &cells, EFormat format) {
+    // each save serializes the cells again, so the buffer is not kept between saves
+    string buffer;
+    if (format == BINARY) {
+        CBinaryFormat::write(cells, buffer, m_pool);
+        m_os->write(buffer.data(), static_cast<long>(buffer.size()));
+        return !m_os->fail();
+    }
+    auto partitions = CPartitions::write(cells, m_pool, [&cells](const Rect &rows, string &partition) {
+        loadBuffer(cells, rows, partition);
+    });
+    string index;
+    for (auto &partition: partitions) {
+        index.append(index.empty() ? "" : " ").append(to_string(partition.size()));
+        buffer.append(partition);
+        string().swap(partition);
+    }
+
+    string table;
+    for (uint32_t checksum: CChecksum::computeBlocks(buffer, m_pool)) {
+        table.append(formatChecksum(checksum));
+    }
+    string header = string(TEXT_MAGIC) + to_string(buffer.size()) + ' '
+                    + formatChecksum(CChecksum::update(0, table + '\n' + index)) + ' '
+                    + to_string(partitions.size()) + '\n';
+    *m_os << header << table << '\n' << index << '\n';
+    m_os->write(buffer.data(), static_cast<long>(buffer.size()));
     if (m_os->fail()) {
         return false;
     }
     return true;
 }
 
-string CLoader::getHash() const {
-    unsigned long hash = 5381;
-    for (char c: m_buffer) {
-        hash = ((hash << 5) + hash) + c;
-    };
+string CLoader::formatChecksum(uint32_t checksum) {
+    string digits(CHECKSUM_DIGITS, '0');
+    for (size_t i = CHECKSUM_DIGITS; i-- > 0; checksum >>= 4) {
+        digits[i] = "0123456789abcdef"[checksum & 0xF];
+    }
+    return digits;
+}
+
+bool CLoader::parseChecksum(string_view text, uint32_t &checksum) {
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), checksum, 16);
+    return text.size() == CHECKSUM_DIGITS && error == errc() && end == text.data() + text.size();
+}
+
+bool CLoader::parseIndex(string_view text, size_t count, uint64_t size, vector<uint64_t> &partitions) {
+    const char *position = text.data(), *end = text.data() + text.size();
+    uint64_t partitions_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && (position == end || *position++ != ' ')) {
+            return false;
+        }
+        uint64_t partition;
+        auto [next, error] = from_chars(position, end, partition);
+        if (error != errc()) {
+            return false;
+        }
+        position = next;
+        partitions.push_back(partition);
+        partitions_size += partition;
+    }
+    return position == end && partitions_size == size;
+}
+
+string CLoader::getHash(uint64_t hash) {
     string string_hash = to_string(hash);
     size_t to_pad_size = HASH_SIZE - string_hash.size();
-    return string("0", to_pad_size) + string_hash;
+    return string(to_pad_size, '0') + string_hash;
+}
+
+void CLoader::loadBuffer(const CCellStorage &cells, const Rect &rows, string &buffer) {
+    cells.forEach(rows, [&buffer](const pair<int, int> &coords, const CCell &cell) {
+        buffer.append(to_string(coords.first) + ',' + to_string(coords.second) + ',');
+        buffer.append(cell.toString());
+    });
+    cells.forEachNumber(rows, [&buffer](const pair<int, int> &coords, double number) {
+        buffer.append(to_string(coords.first) + ',' + to_string(coords.second) + ',');
+        buffer.append(CNumberCell(number).toString());
+    });
 }
 
-void CLoader::loadBuffer(const Cells &cells) {
-    for (auto &[row_pos, column]: cells) {
-        for (auto &[col_pos, cell]: column) {
-            m_buffer.append(to_string(row_pos) + ',' + to_string(col_pos) + ',');
-            m_buffer.append(cell->toString());
+bool CLoader::load(CCellStorage &cells) {
+    // cells are parsed before the data are verified, so they are committed to the container only at the end
+    CCellStorage loaded;
+    loaded.setRangeIndex(cells.hasRangeIndex());
+    m_damaged = nullopt;
+    if (m_is != nullptr) {
+        CHashingReader reader(*m_is);
+        if (!loadData(reader, loaded) || m_is->bad() || (!m_is->good() && !m_is->eof())) {
+            return false;
+        }
+    } else {
+        CMappedFile file;
+        if (!file.open(m_filename)) {
+            return false;
+        }
+        CHashingReader reader(file.getData(), m_pool);
+        if (!loadData(reader, loaded)) {
+            return false;
         }
     }
+    cells = std::move(loaded);
+    return true;
 }
 
-bool CLoader::load(Cells &cells) {
-    if (!verify()) {
-        return false;
+bool CLoader::loadData(CHashingReader &reader, CCellStorage &cells) {
+    bool loaded = CBinaryFormat::isBinary(reader.peek(HASH_SIZE)) ? CBinaryFormat::read(reader, cells, m_pool)
+                                                                  : loadText(reader, cells, m_pool);
+    m_damaged = reader.getDamagedBlock();
+    return loaded;
+}
+
+bool CLoader::loadText(CHashingReader &reader, CCellStorage &cells, CThreadPool *pool) {
+    istream is(&reader);
+    bool checked = reader.peek(TEXT_MAGIC.size()) == TEXT_MAGIC;
+    string hash(HASH_SIZE, '\0');
+    vector<uint64_t> partitions;
+    if (checked) {
+        if (!readChecksums(is, reader, partitions)) {
+            return false;
+        }
+    } else {
+        if (!is.read(hash.data(), HASH_SIZE)) {
+            return false;
+        }
+        reader.restartHash();
     }
-    istringstream iss(m_buffer);
 
+    // partitions are worth copying from a stream only to parse them in parallel
+    if (pool != nullptr && !partitions.empty()) {
+        auto parse = [](string_view data, CCellStorage &part) {
+            CHashingReader part_reader(data);
+            istream part_is(&part_reader);
+            parseCells(part_is, part);
+            return true;
+        };
+        if (!CPartitions::read(reader, partitions, pool, cells, parse)) {
+            return false;
+        }
+    } else {
+        parseCells(is, cells);
+    }
+    return reader.drain() && (checked || hash == getHash(reader.getHash()));
+}
+
+void CLoader::parseCells(istream &is, CCellStorage &cells) {
     char sep;
     int row_pos, col_pos, cell_type;
+    CCellPool &pool = cells.getPool();
+
+    // cells are parsed as long as they are valid, the rest is only verified
+    while (is.peek() != EOF) {
+        if (!(is >> row_pos >> sep
+                 >> col_pos >> sep
+                 >> cell_type >> sep)) {
+            break;
+        }
 
-    while (iss.peek() != EOF) {
-        iss >> row_pos >> sep
-            >> col_pos >> sep
-            >> cell_type >> sep;
-
-        CCell *cell = nullptr;
+        CCellHandle cell;
         if (cell_type == CCellType::NUMBER) {
-            cell = new CNumberCell();
+            cell = pool.create<CNumberCell>();
         } else if (cell_type == CCellType::STRING) {
-            cell = new CStringCell();
+            cell = pool.create<CStringCell>();
         } else {
-            cell = new CExprCell();
+            cell = pool.create<CExprCell>();
         }
-        iss >> cell;
-        auto shared_ptr_cell = shared_ptr<CCell>(cell);
-        CSpreadsheet::setCell(cells, CPos(row_pos, col_pos), shared_ptr_cell);
+        if (!(is >> pool.find(cell))) {
+            pool.release(cell);
+            break;
+        }
+        CSpreadsheet::setCell(cells, CPos(row_pos, col_pos), cell);
 
     }
-    return true;
 }
 
-bool CLoader::verify() {
-    m_hash.resize(HASH_SIZE);
-    m_is->read(m_hash.data(), HASH_SIZE);
-
-    m_buffer.assign(istreambuf_iterator<char>(*m_is), istreambuf_iterator<char>());
-    if (!m_is->good() && (m_is->bad() || !m_is->eof())) {
+bool CLoader::readChecksums(istream &is, CHashingReader &reader, vector<uint64_t> &partitions) {
+    string magic(TEXT_MAGIC.size(), '\0');
+    uint64_t size;
+    string digits(CHECKSUM_DIGITS, '\0');
+    uint32_t table_checksum;
+    if (!is.read(magic.data(), static_cast<streamsize>(magic.size())) || !(is >> size) || is.get() != ' '
+        || !is.read(digits.data(), CHECKSUM_DIGITS) || !parseChecksum(digits, table_checksum)) {
+        return false;
+    }
+    // files saved before partitions were added end the header here
+    size_t count = 0;
+    bool partitioned = is.peek() == ' ';
+    if ((partitioned && (is.get() != ' ' || !(is >> count))) || is.get() != '\n') {
+        return false;
+    }
+    // the size is not trusted, the table grows only with checksums which were really read
+    string table;
+    vector<uint32_t> checksums;
+    for (size_t i = 0; i < CChecksum::blockCount(size); i++) {
+        uint32_t checksum;
+        if (!is.read(digits.data(), CHECKSUM_DIGITS) || !parseChecksum(digits, checksum)) {
+            return false;
+        }
+        table.append(digits);
+        checksums.push_back(checksum);
+    }
+    if (is.get() != '\n') {
         return false;
     }
-    if (m_hash != getHash()) {
+    if (partitioned) {
+        string index;
+        if (!getline(is, index) || !parseIndex(index, count, size, partitions)) {
+            return false;
+        }
+        table.append("\n").append(index);
+    }
+    if (CChecksum::update(0, table) != table_checksum) {
         return false;
     }
+    reader.startChecksums(std::move(checksums), size);
     return true;
 }
-
@@ -4,15 +4,36 @@
 #ifndef PA2_BIG_TASK_CLOADER_H
 #define PA2_BIG_TASK_CLOADER_H
 
-#include "../SpreadsheetStructure/CCell.h"
+#include "../SpreadsheetStructure/CCellStorage.h"
+#include "CBinaryFormat.h"
+#include "CChecksum.h"
+#include "CHashingReader.h"
+#include "CMappedFile.h"
+#include "CPartitions.h"
 
 /**
  * Class that is used to save/load spreadsheet cells to/from a file or any other stream.
  * Loader can be constructed for loading or saving, but not for both operations.
- * Uses hashing for checking if stream data are not damaged.
+ * Uses checksums of blocks of data (CChecksum) for checking if stream data are not damaged,
+ * files saved with a hash of all data are still loaded.
+ *
+ * Cells are saved in the text format or in the binary format (CBinaryFormat), the format
+ * of loaded data is recognized by their beginning.
  */
 class CLoader {
 public:
+    /**
+     * Formats in which cells can be saved.
+     */
+    enum EFormat {
+        // Line "#crc32c <data size> <checksum of the table and the index> <number of partitions>",
+        // line with the checksum table in hex, line with sizes of partitions separated by spaces
+        // and cells in text, numbers are saved with 6 decimal places.
+        TEXT,
+        // Typed columns of cells, numbers are saved exactly.
+        BINARY
+    };
+
     /**
      * Constructs loader for loading cells.
      * @param is - input stream from which to load cells.
@@ -25,55 +46,142 @@ public:
      */
     explicit CLoader(ostream &os);
 
+    /**
+     * Constructs loader for loading cells from a file, which is mapped to memory, so cells in the binary format
+     * are read directly from the file without copying it.
+     * @param filename - path of the file.
+     */
+    explicit CLoader(const string &filename);
+
+    /**
+     * Sets threads which serialize and parse partitions of cells and compute checksums of blocks of data in parallel.
+     * @param pool - the threads, nullptr to do everything in the calling thread.
+     */
+    void setThreadPool(CThreadPool *pool);
+
+    /**
+     * Gets the first block of the data of the last load which did not match its checksum.
+     * @return index of the block or nothing if no damaged block was found, e.g. when only the header is damaged.
+     */
+    optional<size_t> getDamagedBlock() const;
+
     /**
      * Save cells to current output stream.
      * @param cells - cells to save to output stream.
+     * @param format - format of saved data.
      * @return true if data were successfully saved.
      */
-    bool save(const Cells &cells);
+    bool save(const CCellStorage &cells, EFormat format = TEXT);
 
     /**
-     * Load cells from current input stream.
+     * Load cells from current input stream or file. The stream is parsed in chunks which are checked
+     * before they are parsed, so the data are not kept in memory.
      * @param cells - cells container where data will be loaded from input stream.
      * @return true if data were successfully loaded. If fails to load, original data are not touched.
      */
-    bool load(Cells &cells);
+    bool load(CCellStorage &cells);
 
 private:
 
     /**
-     * Used for verification if data are damaged by reading hash, the data, computing the data hash,
-     * and comparing both hashes if they are the same.
-     * @return true if data hashes are same.
+     * Loads cells from data in any format, the cells must be loaded to an empty container like in loadText.
+     * @param reader - reader of the data.
+     * @param cells - cells container where data will be loaded.
+     * @return true if data are not damaged.
+     */
+    bool loadData(CHashingReader &reader, CCellStorage &cells);
+
+    /**
+     * Loads cells from data in the text format. Used for verification if data are damaged by reading
+     * the checksums, which are checked before the data are parsed. Data of old files are verified
+     * by a hash computed while they are parsed and compared with the hash at their beginning.
+     * Cells are parsed before the data are verified, so they must be loaded to a container
+     * which is used only if the loading succeeds.
+     * @param reader - reader of the data.
+     * @param cells - cells container where data will be loaded.
+     * @param pool - threads parsing partitions, nullptr to parse the data in this thread.
+     * @return true if data are not damaged.
+     */
+    static bool loadText(CHashingReader &reader, CCellStorage &cells, CThreadPool *pool);
+
+    /**
+     * Parses cells in the text format as long as they are valid.
+     * @param is - stream of the cells.
+     * @param cells - cells container where cells will be loaded.
+     */
+    static void parseCells(istream &is, CCellStorage &cells);
+
+    /**
+     * Reads the header lines of the text format - the checksum table and the partition index,
+     * and starts checking of the data.
+     * @param is - stream of the data at the beginning.
+     * @param reader - reader of the stream.
+     * @param partitions - sizes of partitions, empty for files without partitions.
+     * @return false if the header, the checksum table or the partition index is damaged.
+     */
+    static bool readChecksums(istream &is, CHashingReader &reader, vector<uint64_t> &partitions);
+
+    /**
+     * Parses the partition index of the text format.
+     * @param text - sizes of partitions separated by spaces.
+     * @param count - number of partitions.
+     * @param size - size of all data.
+     * @param partitions - the parsed sizes.
+     * @return false if the index is damaged.
+     */
+    static bool parseIndex(string_view text, size_t count, uint64_t size, vector<uint64_t> &partitions);
+
+    /**
+     * Parses a checksum written in hex.
+     * @param text - exactly CHECKSUM_DIGITS hex digits.
+     * @param checksum - the parsed checksum.
+     * @return false if the text is not a checksum.
+     */
+    static bool parseChecksum(string_view text, uint32_t &checksum);
+
+    /**
+     * Writes a checksum in hex.
+     * @param checksum - the checksum.
+     * @return CHECKSUM_DIGITS hex digits.
      */
-    bool verify();
+    static string formatChecksum(uint32_t checksum);
 
     /**
-     * Loads provided cells for saving into string data buffer,
+     * Loads provided cells of a partition for saving into string data buffer,
      * which will be written to output stream later when all cells are saved in buffer.
+     * Partitions are loaded to their own buffers concurrently.
      * @param cells - cells to be loaded into saving buffer.
+     * @param rows - rectangle of rows of the partition.
+     * @param buffer - buffer of the partition.
      */
-    void loadBuffer(const Cells &cells);
+    static void loadBuffer(const CCellStorage &cells, const Rect &rows, string &buffer);
 
     /**
-     * Computes hash of data stored currently in the buffer.
-     * The computed hash is then padded with zeros from the left
+     * Converts hash of data in old text files to text.
+     * The hash is padded with zeros from the left
      * to keep consistent hash length.
-     * @return hash of the data.
+     * @param hash - hash of the data.
+     * @return hash of the data as text.
      */
-    string getHash() const;
+    static string getHash(uint64_t hash);
 
     // Maximum hash length.
     static constexpr size_t HASH_SIZE = 20;
+    // Beginning of the text format with checksums.
+    static constexpr string_view TEXT_MAGIC = "#crc32c ";
+    // Number of hex digits of a checksum.
+    static constexpr size_t CHECKSUM_DIGITS = 8;
 
     // Input stream.
     istream *m_is;
     // Output stream.
     ostream *m_os;
-    // Buffer where data are temporarily stored when loading or saved.
-    string m_buffer;
-    // Hash, loaded from a stream or stored while saving.
-    string m_hash;
+    // File from which cells are loaded if there is no input stream.
+    string m_filename;
+    // Threads computing checksums.
+    CThreadPool *m_pool = nullptr;
+    // The first damaged block of the last load.
+    optional<size_t> m_damaged;
 };
 
 
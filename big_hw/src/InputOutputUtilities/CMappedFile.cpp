@@ -0,0 +1,53 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CMappedFile.h"
+
+CMappedFile::~CMappedFile() {
+    close();
+}
+
+bool CMappedFile::open(const string &filename) {
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    // empty files cannot be mapped, but they are valid
+    if (info.st_size > 0) {
+        void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        m_data = data;
+        m_size = static_cast<size_t>(info.st_size);
+        // the file is read once from the beginning to the end
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return true;
+}
+
+string_view CMappedFile::getData() const {
+    return {static_cast<const char *>(m_data), m_size};
+}
+
+void CMappedFile::close() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
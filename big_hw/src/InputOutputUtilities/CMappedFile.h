@@ -0,0 +1,57 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CMAPPEDFILE_H
+#define PA2_BIG_TASK_CMAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * Read-only memory mapping of a whole file, so the file is read by the system on demand
+ * without copying it into a buffer. The mapping is removed when the object is destroyed.
+ */
+class CMappedFile {
+public:
+    CMappedFile() = default;
+
+    CMappedFile(const CMappedFile &) = delete;
+
+    CMappedFile &operator=(const CMappedFile &) = delete;
+
+    /**
+     * Unmaps the file.
+     */
+    ~CMappedFile();
+
+    /**
+     * Maps a file, previously mapped file is unmapped.
+     * @param filename - path of the file.
+     * @return false if the file cannot be opened or mapped.
+     */
+    bool open(const string &filename);
+
+    /**
+     * Gets contents of the mapped file.
+     * @return bytes of the file, empty if no file is mapped.
+     */
+    string_view getData() const;
+
+private:
+    /**
+     * Unmaps the mapped file.
+     */
+    void close();
+
+    // Address of the mapping, nullptr if nothing is mapped.
+    void *m_data = nullptr;
+    // Size of the file.
+    size_t m_size = 0;
+};
+
+
+#endif //PA2_BIG_TASK_CMAPPEDFILE_H
@@ -0,0 +1,49 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CPartitions.h"
+
+vector<string> CPartitions::write(const CCellStorage &cells, CThreadPool *pool,
+                                  const function<void(const Rect &, string &)> &write) {
+    auto ranges = cells.partitionRows(PARTITION_CELLS);
+    vector<string> partitions(ranges.size());
+    CThreadPool::runOn(pool, ranges.size(), [&ranges, &partitions, &write](size_t partition) {
+        write({{ranges[partition].first, INT_MIN}, {ranges[partition].second, INT_MAX}}, partitions[partition]);
+    });
+    return partitions;
+}
+
+bool CPartitions::read(CHashingReader &reader, const vector<uint64_t> &sizes, CThreadPool *pool, CCellStorage &cells,
+                       const function<bool(string_view, CCellStorage &)> &parse) {
+    size_t batch = pool != nullptr ? pool->getThreadCount() : 1;
+    vector<string> buffers(batch);
+    vector<string_view> data(batch);
+    vector<CCellStorage> parts(batch);
+    vector<char> parsed(batch);
+    for (size_t first = 0; first < sizes.size(); first += batch) {
+        size_t count = min(batch, sizes.size() - first);
+        for (size_t i = 0; i < count; i++) {
+            if (!reader.read(sizes[first + i], buffers[i], data[i])) {
+                return false;
+            }
+        }
+        if (count == 1) {
+            if (!parse(data[0], cells)) {
+                return false;
+            }
+            continue;
+        }
+        CThreadPool::runOn(pool, count, [&data, &parts, &parsed, &parse](size_t i) {
+            parsed[i] = parse(data[i], parts[i]);
+        });
+        // storages are merged in the order of the partitions, so later cells rewrite earlier ones
+        for (size_t i = 0; i < count; i++) {
+            if (!parsed[i]) {
+                return false;
+            }
+            cells.merge(std::move(parts[i]));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CPARTITIONS_H
+#define PA2_BIG_TASK_CPARTITIONS_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../SpreadsheetStructure/CCellStorage.h"
+#include "../Evaluation/CThreadPool.h"
+#include "CHashingReader.h"
+
+using namespace std;
+
+/**
+ * Partitions of saved cells - ranges of whole tile rows with about PARTITION_CELLS cells, which are saved
+ * one after another and files keep their sizes in an index, so partitions are processed in parallel.
+ *
+ * Each partition is serialized by one thread to its own buffer. Loaded partitions are read in batches
+ * of one partition per thread, each is parsed to its own cell storage and the storages are merged
+ * in the order of the partitions. Partitions cover different tiles, so the merge only moves tiles.
+ */
+class CPartitions {
+public:
+    /**
+     * Serializes partitions of cells in parallel.
+     * @param cells - cells to save.
+     * @param pool - threads serializing partitions, nullptr to serialize them in the calling thread.
+     * @param write - function serializing cells in a rectangle of rows to a buffer, is called concurrently.
+     * @return serialized partitions from the top.
+     */
+    static vector<string> write(const CCellStorage &cells, CThreadPool *pool,
+                                const function<void(const Rect &, string &)> &write);
+
+    /**
+     * Reads partitions and parses them in parallel. Partitions of a stream are copied,
+     * so at most one partition per thread is kept in memory.
+     * @param reader - reader of the data at the beginning of the first partition.
+     * @param sizes - sizes of the partitions.
+     * @param pool - threads parsing partitions, nullptr to parse them in the calling thread.
+     * @param cells - storage where cells are loaded, on failure it can contain a part of the cells.
+     * @param parse - function parsing a partition to a storage, returns false if the partition is damaged,
+     * is called concurrently.
+     * @return false if some partition is damaged or incomplete.
+     */
+    static bool read(CHashingReader &reader, const vector<uint64_t> &sizes, CThreadPool *pool, CCellStorage &cells,
+                     const function<bool(string_view, CCellStorage &)> &parse);
+
+    // Number of cells in one partition.
+    static constexpr size_t PARTITION_CELLS = 1 << 16;
+};
+
+
+#endif //PA2_BIG_TASK_CPARTITIONS_H
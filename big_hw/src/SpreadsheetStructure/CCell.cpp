@@ -1,24 +1,29 @@
 //
 // Created by bardanik on 11/04/24.
 //
+#include "../CSpreadsheet.h"
 #include "CCell.h"
 
+#include <cstdlib>
 #include <utility>
 
 CCell::CCell(CValue value) : m_value(std::move(value)) {
 
 }
 
-CCell *CCell::createCell(const string &contents) {
-    try {
-        double number = stod(contents);
-        return new CNumberCell(number);
-    } catch (invalid_argument &e) {
-        if (!contents.empty() && contents[0] == '=') {
-            return new CExprCell(contents);
-        } else {
-            return new CStringCell(contents);
-        }
+CCellHandle CCell::createCell(CCellPool &pool, const string &contents) {
+    // contents starting by a number are number cells, as they were parsed by stod, but without an exception
+    // for every other cell, numbers out of range of double are rounded instead of throwing
+    const char *begin = contents.c_str();
+    char *end = nullptr;
+    double number = strtod(begin, &end);
+    if (end != begin) {
+        return pool.create<CNumberCell>(number);
+    }
+    if (!contents.empty() && contents[0] == '=') {
+        return pool.create<CExprCell>(contents);
+    } else {
+        return pool.create<CStringCell>(contents);
     }
 }
 
@@ -39,29 +44,51 @@ CStringCell::CStringCell() : CCell("") {
 }
 
 
-CExprCell::CExprCell(const string &expression) : CCell(expression), m_shift({0, 0}) {
+CExprCell::CExprCell(const string &expression) : CCell(expression), m_shift({0, 0}), m_cyclic(false) {
 
 }
 
 
-CExprCell::CExprCell() : CCell("="), m_shift({0, 0}) {
+CExprCell::CExprCell() : CCell("="), m_shift({0, 0}), m_cyclic(false) {
 
 }
 
 
-CCell *CStringCell::copy() const {
-    return new CStringCell(get<string>(m_value));
+CCellHandle CStringCell::copy(CCellPool &pool) const {
+    return pool.create<CStringCell>(get<string>(m_value));
 }
 
 
-CCell *CNumberCell::copy() const {
-    return new CNumberCell(get<double>(m_value));
+double CNumberCell::getNumber() const {
+    return get<double>(m_value);
+}
+
+CCellHandle CNumberCell::copy(CCellPool &pool) const {
+    return pool.create<CNumberCell>(get<double>(m_value));
 }
 
-CCell *CExprCell::copy() const {
-    auto *copy = new CExprCell(get<string>(m_value));
+CCellHandle CExprCell::copy(CCellPool &pool) const {
+    CCellHandle handle = pool.create<CExprCell>(get<string>(m_value));
+    auto *copy = static_cast<CExprCell *>(pool.find(handle));
+    copy->m_template = m_template;
     copy->m_shift = m_shift;
-    return copy;
+    return handle;
+}
+
+const CValue &CCell::getContents() const {
+    return m_value;
+}
+
+CCellType CNumberCell::getType() const {
+    return CCellType::NUMBER;
+}
+
+CCellType CStringCell::getType() const {
+    return CCellType::STRING;
+}
+
+CCellType CExprCell::getType() const {
+    return CCellType::EXPRESSION;
 }
 
 string CStringCell::toString() const {
@@ -116,33 +143,127 @@ string CExprCell::toString() const {
 
 
 CValue CCell::getValue(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) {
+    return evaluate(spreadsheet, visitor);
+}
+
+const CValue &CCell::evaluate(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) {
     return m_value;
 }
 
 
-CValue CExprCell::getValue(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) {
-    if (m_root == nullptr) {
-        try {
-            CASTExpressionBuilder builder(spreadsheet, this);
-            parseExpression(get<string>(m_value), builder);
-            m_root = unique_ptr<CASTNode>(builder.getResult());
-        } catch (invalid_argument &e) {
-            return m_value;
+const CValue &CExprCell::evaluate(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) {
+    if (m_cache) {
+        return *m_cache;
+    }
+    // values evaluated after a cycle was found are not valid, so they are not cached
+    static const CValue undefined;
+    if (m_cyclic) {
+        visitor.reportCycle();
+        return undefined;
+    }
+    if (visitor.hasCycle()) {
+        return undefined;
+    }
+    if (!isBuilt(spreadsheet)) {
+        build(spreadsheet);
+        if (m_template == nullptr) {
+            return m_cache.emplace(m_value);
         }
     }
-    visitor.visit(this);
-    auto evaluation = m_root->evaluate(visitor);
+    if (!visitor.visit(this, m_shift)) {
+        return undefined;
+    }
+    auto evaluation = m_template->getProgram().evaluate(visitor);
     visitor.leave(this);
-    return evaluation;
+    if (visitor.hasCycle()) {
+        return undefined;
+    }
+    return m_cache.emplace(std::move(evaluation));
+}
+
+vector<Rect> CCell::build(CSpreadsheet &spreadsheet) {
+    return {};
+}
+
+vector<Rect> CExprCell::build(CSpreadsheet &spreadsheet) {
+    if (isBuilt(spreadsheet)) {
+        return m_template->getReferences(m_shift);
+    }
+    m_template = spreadsheet.getExpressionCache().get(get<string>(m_value), spreadsheet);
+    if (m_template == nullptr) {
+        return {};
+    }
+    return m_template->getReferences(m_shift);
+}
+
+vector<Rect> CCell::getReferences() const {
+    return {};
+}
+
+vector<Rect> CExprCell::getReferences() const {
+    if (m_template == nullptr) {
+        return {};
+    }
+    return m_template->getReferences(m_shift);
+}
+
+void CCell::prepare(CSpreadsheet &spreadsheet) {
+}
+
+void CExprCell::prepare(CSpreadsheet &spreadsheet) {
+    if (!isBuilt(spreadsheet) && !m_cache) {
+        build(spreadsheet);
+    }
+}
+
+bool CCell::invalidate() {
+    return false;
+}
+
+bool CExprCell::invalidate() {
+    bool had_value = m_cache.has_value() || m_cyclic;
+    m_cache.reset();
+    m_cyclic = false;
+    return had_value;
+}
+
+bool CCell::isEvaluated() const {
+    return true;
+}
+
+bool CExprCell::isEvaluated() const {
+    return m_cache.has_value() || m_cyclic;
+}
+
+bool CCell::isConditional() const {
+    return false;
+}
+
+bool CExprCell::isConditional() const {
+    return m_template != nullptr && m_template->isConditional();
+}
+
+void CCell::markCyclic() {
+}
+
+void CExprCell::markCyclic() {
+    m_cyclic = true;
+}
+
+bool CCell::isCyclic() const {
+    return false;
+}
+
+bool CExprCell::isCyclic() const {
+    return m_cyclic;
 }
 
 void CCell::shift(const pair<int, int> &offset) {
 }
 
 void CExprCell::shift(const pair<int, int> &offset) {
-    if (m_root != nullptr) {
-        m_root = nullptr;
-    }
+    m_cache.reset();
+    m_cyclic = false;
     m_shift.first += offset.first;
     m_shift.second += offset.second;
 }
@@ -181,3 +302,10 @@ pair<int, int> CExprCell::getShift() const {
     return m_shift;
 }
 
+const CExpressionTemplate *CExprCell::getTemplate() const {
+    return m_template.get();
+}
+
+bool CExprCell::isBuilt(const CSpreadsheet &spreadsheet) const {
+    return m_template != nullptr && m_template->belongsTo(spreadsheet);
+}
@@ -5,14 +5,14 @@
 #ifndef BARDANIK_CCELL_H
 #define BARDANIK_CCELL_H
 
+#include <atomic>
 #include <memory>
 #include <iostream>
 #include <sstream>
 #include <map>
-#include "../ExpressionBuilders/CASTExpressionBuilder.h"
-
-// Container to store cells - sparse matrix.
-using Cells = map<int, map<int, shared_ptr<CCell>>>;
+#include <optional>
+#include "../ExpressionBuilders/CExpressionTemplate.h"
+#include "CCellPool.h"
 
 /**
  * Cells type - used for Loader to save information about cell type.
@@ -32,6 +32,7 @@ enum CCellType {
  * updated on each move (shift). This design is weird, but allows to not construct AST tree everytime
  * it is copied, which is much faster  (and the given expression parser is a static library and
  * and its use is limited, if its source code was given, it could be used to reconstruct the expression).
+ * The AST tree is parsed once into CExpressionTemplate and is shared by all copies of the cell.
  */
 class CCell {
 public:
@@ -46,10 +47,11 @@ public:
     /**
      * Factory method, creates specific cells type based on the contents,
      * if it is a number, string or expression.
+     * @param pool - pool where the cell is created.
      * @param contents - stores string representation of value.
-     * @return new cell with stored and parses contents.
+     * @return handle of new cell with stored and parses contents.
      */
-    static CCell *createCell(const string &contents);
+    static CCellHandle createCell(CCellPool &pool, const string &contents);
 
     /**
      * Calculates value of the cell as CValue object - double, string or monostate (undefined).
@@ -59,11 +61,72 @@ public:
      */
     virtual CValue getValue(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor);
 
+    /**
+     * Calculates value of the cell like getValue, but returns reference to the value stored in the cell,
+     * so the value is not copied. The reference is valid until the cell is changed or invalidated.
+     * @param spreadsheet - reference to spreadsheet where the cell is stored.
+     * @param visitor - cycle detection visitor object, which watches cycles while evaluation of the cell.
+     * @return reference to the value of the cell.
+     */
+    virtual const CValue &evaluate(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor);
+
+    /**
+     * Prepares the cell for evaluation in the spreadsheet, i.e. builds the AST tree of an expression.
+     * Is used by the spreadsheet to find out which cells the cell depends on.
+     * @param spreadsheet - reference to spreadsheet where the cell is stored.
+     * @return rectangles of cells the cell references, empty for literal cells.
+     */
+    virtual vector<Rect> build(CSpreadsheet &spreadsheet);
+
+    /**
+     * Gets references of a cell which was built before, e.g. of a copy of a built cell.
+     * @return rectangles of cells the cell references, empty for literal cells and invalid expressions.
+     */
+    virtual vector<Rect> getReferences() const;
+
+    /**
+     * Builds the cell for evaluation only if it was not built yet.
+     * @param spreadsheet - reference to spreadsheet where the cell is stored.
+     */
+    virtual void prepare(CSpreadsheet &spreadsheet);
+
+    /**
+     * Drops the value computed by the last evaluation, so it is computed again on the next evaluation.
+     * Is called by the spreadsheet when some cell the cell depends on was changed.
+     * @return true if the cell had a computed value, false if there was nothing to drop.
+     */
+    virtual bool invalidate();
+
+    /**
+     * Checks if the value of the cell is known without evaluation of other cells.
+     * @return true for literal cells and for expression cells with a computed value.
+     */
+    virtual bool isEvaluated() const;
+
+    /**
+     * Checks if evaluation of the cell may skip some of its references (e.g. branches of if function).
+     * @return true if not all references are always evaluated.
+     */
+    virtual bool isConditional() const;
+
+    /**
+     * Marks that evaluation of the cell certainly ends in a cycle, so it is not evaluated again
+     * until it is invalidated.
+     */
+    virtual void markCyclic();
+
+    /**
+     * Checks if the cell is marked as cyclic.
+     * @return true if evaluation of the cell certainly ends in a cycle.
+     */
+    virtual bool isCyclic() const;
+
     /**
      * Copies this cell and returns new cell of the same type.
-     * @return new copy of this cell.
+     * @param pool - pool where the copy is created.
+     * @return handle of new copy of this cell.
      */
-    virtual CCell *copy() const = 0;
+    virtual CCellHandle copy(CCellPool &pool) const = 0;
 
     /**
      * Shifts cell's position. Is used when copying this cell and changing relative references
@@ -72,6 +135,18 @@ public:
      */
     virtual void shift(const pair<int, int> &offset);
 
+    /**
+     * Gets type of the cell, is used by Loader to save the cell.
+     * @return type of the cell.
+     */
+    virtual CCellType getType() const = 0;
+
+    /**
+     * Gets the value the cell was set to - number, string or text of the expression.
+     * @return stored value of the cell.
+     */
+    const CValue &getContents() const;
+
     /**
      * Converts cell to string representation.
      * Is used by Loader to save cell in the output stream.
@@ -123,11 +198,19 @@ public:
      */
     explicit CNumberCell(double value);
 
+    /**
+     * Gets the number stored in the cell.
+     * @return value of the cell.
+     */
+    double getNumber() const;
+
     istream &readCell(istream &is) override;
 
+    CCellType getType() const override;
+
     string toString() const override;
 
-    CCell *copy() const override;
+    CCellHandle copy(CCellPool &pool) const override;
 
 };
 
@@ -147,9 +230,11 @@ public:
      */
     explicit CStringCell(const string &value);
 
+    CCellType getType() const override;
+
     string toString() const override;
 
-    CCell *copy() const override;
+    CCellHandle copy(CCellPool &pool) const override;
 
     istream &readCell(istream &is) override;
 };
@@ -170,9 +255,27 @@ public:
      */
     explicit CExprCell(const string &expression);
 
-    CValue getValue(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) override;
+    const CValue &evaluate(CSpreadsheet &spreadsheet, CCycleDetectionVisitor &visitor) override;
+
+    vector<Rect> build(CSpreadsheet &spreadsheet) override;
+
+    vector<Rect> getReferences() const override;
 
-    CCell *copy() const override;
+    void prepare(CSpreadsheet &spreadsheet) override;
+
+    bool invalidate() override;
+
+    bool isEvaluated() const override;
+
+    bool isConditional() const override;
+
+    void markCyclic() override;
+
+    bool isCyclic() const override;
+
+    CCellHandle copy(CCellPool &pool) const override;
+
+    CCellType getType() const override;
 
     string toString() const override;
 
@@ -182,11 +285,33 @@ public:
 
     pair<int, int> getShift() const override;
 
+    /**
+     * Gets the parsed expression, which is shared with copies of the cell.
+     * @return the parsed expression or nullptr if the cell was not built yet or the expression is not valid.
+     */
+    const CExpressionTemplate *getTemplate() const;
+
 private:
-    // Root of the constructed AST tree when getting the cell value.
-    unique_ptr<CASTNode> m_root;
-    // Offset from the original position of the cell to shift expression when building the AST tree.
+    /**
+     * Checks if the cell has a parsed expression that can be evaluated in a given spreadsheet.
+     * @param spreadsheet - spreadsheet where the cell is stored.
+     * @return true if the cell does not have to be built.
+     */
+    bool isBuilt(const CSpreadsheet &spreadsheet) const;
+
+    // Parsed expression shared with copies of the cell, constructed when getting the cell value.
+    shared_ptr<const CExpressionTemplate> m_template;
+    // Value computed by the last evaluation, empty if the cell has to be evaluated again.
+    optional<CValue> m_cache;
+    // Offset from the original position of the cell to shift expression when evaluating the AST tree.
     pair<int, int> m_shift;
+    // If evaluation of the cell certainly ends in a cycle.
+    bool m_cyclic;
+    // Epoch of the cycle detection visitor that has the cell opened or reached, 0 if no visitor has.
+    // Visitors of parallel evaluation can stamp a shared precedent concurrently, so the stamp is atomic.
+    mutable atomic<uint64_t> m_epoch = 0;
+
+    friend class CCycleDetectionVisitor;
 
 };
 
@@ -0,0 +1,141 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#include "CCell.h"
+#include "CCellPool.h"
+
+CCellPool::CCellPool(CCellPool &&src) noexcept: m_slots(std::move(src.m_slots)), m_free_slot(src.m_free_slot),
+                                                 m_free(src.m_free), m_blocks(std::move(src.m_blocks)),
+                                                 m_size(src.m_size) {
+    src.m_slots.clear();
+    src.m_free_slot = NO_SLOT;
+    src.m_free = {};
+    src.m_blocks.clear();
+    src.m_size = 0;
+}
+
+CCellPool &CCellPool::operator=(CCellPool &&src) noexcept {
+    swap(m_slots, src.m_slots);
+    swap(m_free_slot, src.m_free_slot);
+    swap(m_free, src.m_free);
+    swap(m_blocks, src.m_blocks);
+    swap(m_size, src.m_size);
+    return *this;
+}
+
+CCellPool::~CCellPool() {
+    clear();
+    for (void *block: m_blocks) {
+        ::operator delete(block);
+    }
+}
+
+void CCellPool::release(CCellHandle handle) {
+    CCell *cell = find(handle);
+    if (cell == nullptr) {
+        return;
+    }
+    Slot &slot = m_slots[handle.index];
+    size_t size_class = slot.next;
+    cell->~CCell();
+    deallocate(cell, size_class);
+    slot.cell = nullptr;
+    // generation 0 marks empty handles, so it is skipped when the generation overflows
+    if (++slot.generation == 0) {
+        slot.generation = 1;
+    }
+    slot.next = m_free_slot;
+    m_free_slot = handle.index;
+    m_size--;
+}
+
+void CCellPool::clear() {
+    for (uint32_t index = 0; index < m_slots.size(); index++) {
+        if (m_slots[index].cell != nullptr) {
+            release({index, m_slots[index].generation});
+        }
+    }
+}
+
+uint32_t CCellPool::merge(CCellPool &&src) {
+    auto offset = static_cast<uint32_t>(m_slots.size());
+    m_slots.reserve(m_slots.size() + src.m_slots.size() + 1);
+    m_blocks.reserve(m_blocks.size() + src.m_blocks.size());
+    for (uint32_t index = 0; index < src.m_slots.size(); index++) {
+        Slot slot = src.m_slots[index];
+        if (slot.cell == nullptr) {
+            slot.next = m_free_slot;
+            m_free_slot = offset + index;
+        }
+        m_slots.push_back(slot);
+    }
+    // free memory of the merged pool is linked before free memory of this pool
+    for (size_t size_class = 0; size_class < SIZE_CLASSES; size_class++) {
+        void *last = src.m_free[size_class];
+        if (last == nullptr) {
+            continue;
+        }
+        while (*static_cast<void **>(last) != nullptr) {
+            last = *static_cast<void **>(last);
+        }
+        *static_cast<void **>(last) = m_free[size_class];
+        m_free[size_class] = src.m_free[size_class];
+    }
+    m_blocks.insert(m_blocks.end(), src.m_blocks.begin(), src.m_blocks.end());
+    m_size += src.m_size;
+    src.m_slots.clear();
+    src.m_free_slot = NO_SLOT;
+    src.m_free = {};
+    src.m_blocks.clear();
+    src.m_size = 0;
+    return offset;
+}
+
+size_t CCellPool::size() const {
+    return m_size;
+}
+
+size_t CCellPool::getBlocks() const {
+    return m_blocks.size();
+}
+
+void *CCellPool::allocate(size_t size_class) {
+    if (m_free_slot == NO_SLOT && m_slots.size() == m_slots.capacity()) {
+        m_slots.reserve(max<size_t>(BLOCK_CELLS, m_slots.size() * 2));
+    }
+    if (m_free[size_class] == nullptr) {
+        size_t size = (size_class + 1) * ALIGNMENT;
+        m_blocks.reserve(m_blocks.size() + 1);
+        char *block = static_cast<char *>(::operator new(size * BLOCK_CELLS));
+        m_blocks.push_back(block);
+        // cells of the new block are linked in the order of their addresses
+        for (size_t i = BLOCK_CELLS; i-- > 0;) {
+            deallocate(block + i * size, size_class);
+        }
+    }
+    void *memory = m_free[size_class];
+    m_free[size_class] = *static_cast<void **>(memory);
+    return memory;
+}
+
+void CCellPool::deallocate(void *memory, size_t size_class) {
+    *static_cast<void **>(memory) = m_free[size_class];
+    m_free[size_class] = memory;
+}
+
+CCellHandle CCellPool::insert(CCell *cell, size_t size_class) {
+    uint32_t index;
+    if (m_free_slot != NO_SLOT) {
+        index = m_free_slot;
+        m_free_slot = m_slots[index].next;
+    } else {
+        index = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back({nullptr, 1, 0});
+    }
+    Slot &slot = m_slots[index];
+    slot.cell = cell;
+    slot.next = static_cast<uint32_t>(size_class);
+    m_size++;
+    return {index, slot.generation};
+}
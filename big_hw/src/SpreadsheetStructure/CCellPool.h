@@ -0,0 +1,204 @@
+//
+// Created by bardanik on 23/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CCELLPOOL_H
+#define PA2_BIG_TASK_CCELLPOOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class CCell;
+
+/**
+ * Handle of a cell in a cell pool - index of the slot of the cell and generation of the slot.
+ * The generation is changed each time the slot is released, so a handle of a released cell
+ * is not valid anymore even if the slot is reused. Handle with generation 0 is empty.
+ */
+struct CCellHandle {
+    // Index of the slot in the pool.
+    uint32_t index = 0;
+    // Generation of the slot when the cell was created.
+    uint32_t generation = 0;
+
+    /**
+     * Checks if the handle refers to some cell.
+     * @return false for the empty handle.
+     */
+    explicit operator bool() const {
+        return generation != 0;
+    }
+
+    bool operator==(const CCellHandle &other) const = default;
+};
+
+static_assert(sizeof(CCellHandle) == 8, "handles are stored instead of pointers in tiles");
+
+/**
+ * Slot map of cells of one cell storage. Cells are referenced by handles, which are plain integers,
+ * so they are copied without any reference counting, and each access checks generation of the slot,
+ * so a handle of a released cell is detected instead of reading freed memory.
+ *
+ * Memory of cells is allocated from pools of size classes - cells of the same size class are placed
+ * in blocks of memory and freed memory is kept in a free list of its class, so creating and releasing
+ * cells mostly does not call the global allocator.
+ */
+class CCellPool {
+public:
+    CCellPool() = default;
+
+    CCellPool(const CCellPool &) = delete;
+
+    CCellPool &operator=(const CCellPool &) = delete;
+
+    CCellPool(CCellPool &&src) noexcept;
+
+    CCellPool &operator=(CCellPool &&src) noexcept;
+
+    /**
+     * Destroys all cells and frees the blocks.
+     */
+    ~CCellPool();
+
+    /**
+     * Constructs a cell in the pool.
+     * @tparam Cell - type of the cell.
+     * @param args - arguments of the constructor of the cell.
+     * @return handle of the cell, the cell lives until the handle is released.
+     */
+    template<typename Cell, typename... Args>
+    CCellHandle create(Args &&... args);
+
+    /**
+     * Finds a cell by its handle.
+     * @param handle - handle of the cell.
+     * @return the cell or nullptr if the handle is empty or the cell was released.
+     */
+    CCell *find(CCellHandle handle) const {
+        // slots never have generation 0, so the empty handle is not found
+        if (handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation) {
+            return nullptr;
+        }
+        return m_slots[handle.index].cell;
+    }
+
+    /**
+     * Destroys a cell and makes its slot free. Releasing an invalid handle does nothing.
+     * @param handle - handle of the cell.
+     */
+    void release(CCellHandle handle);
+
+    /**
+     * Destroys all cells, the blocks are kept for new cells.
+     */
+    void clear();
+
+    /**
+     * Moves all cells and blocks of another pool to this pool without moving the cells in memory,
+     * e.g. to merge cells loaded in parallel. Slots of the other pool are appended after slots of this pool,
+     * so its handles stay valid when the offset is added to their indices.
+     * @param src - pool to merge, it is empty afterwards.
+     * @return offset of indices of handles of the merged pool.
+     */
+    uint32_t merge(CCellPool &&src);
+
+    /**
+     * Gets number of living cells.
+     * @return the number of cells.
+     */
+    size_t size() const;
+
+    /**
+     * Gets number of blocks allocated for cells of all size classes.
+     * @return the number of blocks.
+     */
+    size_t getBlocks() const;
+
+private:
+    /**
+     * Slot of a cell, free slots are linked by their next field.
+     */
+    struct Slot {
+        // The cell or nullptr if the slot is free.
+        CCell *cell;
+        // Generation of the slot, 0 is never used.
+        uint32_t generation;
+        // Size class of the cell if the slot is used, otherwise index of the next free slot.
+        uint32_t next;
+    };
+
+    /**
+     * Allocates memory for a cell from a free list of its size class, a new block is allocated if it is empty.
+     * Makes sure that a slot for the cell can be assigned without allocation.
+     * @param size_class - size class of the cell.
+     * @return memory for the cell.
+     */
+    void *allocate(size_t size_class);
+
+    /**
+     * Returns memory of a cell to the free list of its size class.
+     * @param memory - memory of the cell.
+     * @param size_class - size class of the cell.
+     */
+    void deallocate(void *memory, size_t size_class);
+
+    /**
+     * Assigns a free slot to a created cell, does not throw after allocate().
+     * @param cell - the cell.
+     * @param size_class - size class of the cell.
+     * @return handle of the cell.
+     */
+    CCellHandle insert(CCell *cell, size_t size_class);
+
+    /**
+     * Gets size class of a cell, cells are rounded up to multiples of the alignment.
+     */
+    static constexpr size_t sizeClass(size_t size) {
+        return (size + ALIGNMENT - 1) / ALIGNMENT - 1;
+    }
+
+    // Alignment of all cells and step between size classes.
+    static constexpr size_t ALIGNMENT = alignof(max_align_t);
+    // Number of size classes, the largest class is for cells of SIZE_CLASSES * ALIGNMENT bytes.
+    static constexpr size_t SIZE_CLASSES = 16;
+    // Number of cells in one block.
+    static constexpr size_t BLOCK_CELLS = 256;
+    // Marks the end of the list of free slots.
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    // Slots of cells, indexed by handles.
+    vector<Slot> m_slots;
+    // First free slot.
+    uint32_t m_free_slot = NO_SLOT;
+    // For each size class the first free memory of a cell, free memory holds pointer to the next one.
+    array<void *, SIZE_CLASSES> m_free = {};
+    // Allocated blocks of all size classes.
+    vector<void *> m_blocks;
+    // Number of living cells.
+    size_t m_size = 0;
+};
+
+template<typename Cell, typename... Args>
+CCellHandle CCellPool::create(Args &&... args) {
+    static_assert(alignof(Cell) <= ALIGNMENT);
+    constexpr size_t size_class = sizeClass(sizeof(Cell));
+    static_assert(size_class < SIZE_CLASSES, "cell is larger than the largest size class");
+    void *memory = allocate(size_class);
+    Cell *cell;
+    try {
+        cell = new(memory) Cell(std::forward<Args>(args)...);
+    } catch (...) {
+        deallocate(memory, size_class);
+        throw;
+    }
+    return insert(cell, size_class);
+}
+
+
+#endif //PA2_BIG_TASK_CCELLPOOL_H
@@ -0,0 +1,417 @@
+//
+// Created by bardanik on 14/05/24.
+//
+
+#include "CCellStorage.h"
+
+CCellStorage::Tile::Tile(const Tile &src) : m_numbers(src.m_numbers), m_number_rows(src.m_number_rows),
+                                            m_count(src.m_count) {
+    if (src.m_cells != nullptr) {
+        m_cells = make_unique<TileCells>(*src.m_cells);
+    }
+}
+
+CCellStorage::CCellStorage(const CCellStorage &src) : m_size(src.m_size), m_range_index(src.m_range_index),
+                                                      m_indexes(src.m_indexes) {
+    bool shared = false;
+    for (const auto &[coords, tile]: src.m_tiles) {
+        if (tile->m_cells == nullptr) {
+            m_tiles.emplace(coords, tile);
+            shared = true;
+            continue;
+        }
+        auto &copy = m_tiles.emplace(coords, make_shared<Tile>(*tile)).first->second;
+        copy->m_owner = m_owner.load(memory_order_relaxed);
+        // handles of the source pool are replaced by handles of copies in this pool
+        for (auto &handle: *copy->m_cells) {
+            if (handle) {
+                handle = src.m_pool.find(handle)->copy(m_pool);
+            }
+        }
+    }
+    // the source gives up writing to the shared tiles, it copies them on its next write like this storage
+    if (shared) {
+        src.m_owner.store(newOwner(), memory_order_relaxed);
+    }
+}
+
+CCellStorage::CCellStorage(CCellStorage &&src) noexcept : m_pool(std::move(src.m_pool)), m_tiles(std::move(src.m_tiles)),
+                                                          m_size(src.m_size), m_range_index(src.m_range_index),
+                                                          m_indexes(std::move(src.m_indexes)),
+                                                          m_owner(src.m_owner.load(memory_order_relaxed)) {
+    src.m_tiles.clear();
+    src.m_size = 0;
+    src.m_owner.store(newOwner(), memory_order_relaxed);
+}
+
+CCellStorage &CCellStorage::operator=(CCellStorage src) {
+    swap(m_pool, src.m_pool);
+    swap(m_tiles, src.m_tiles);
+    swap(m_size, src.m_size);
+    swap(m_range_index, src.m_range_index);
+    swap(m_indexes, src.m_indexes);
+    uint64_t owner = m_owner.load(memory_order_relaxed);
+    m_owner.store(src.m_owner.load(memory_order_relaxed), memory_order_relaxed);
+    src.m_owner.store(owner, memory_order_relaxed);
+    return *this;
+}
+
+CCell *CCellStorage::find(const pair<int, int> &coords) const {
+    auto [tile_coords, index] = locate(coords);
+    auto tile = m_tiles.find(tile_coords);
+    if (tile == m_tiles.end() || tile->second->m_cells == nullptr) {
+        return nullptr;
+    }
+    return m_pool.find((*tile->second->m_cells)[index]);
+}
+
+const double *CCellStorage::findNumber(const pair<int, int> &coords) const {
+    auto [tile_coords, index] = locate(coords);
+    auto tile = m_tiles.find(tile_coords);
+    if (tile == m_tiles.end()) {
+        return nullptr;
+    }
+    size_t row = index / TILE_COLS, col = index % TILE_COLS;
+    if (!(tile->second->m_number_rows[col] >> row & 1)) {
+        return nullptr;
+    }
+    return &tile->second->m_numbers[numberIndex(index)];
+}
+
+void CCellStorage::set(const pair<int, int> &coords, CCellHandle cell) {
+    // number cells are kept only as their value, the cell object is released
+    if (auto *number = dynamic_cast<CNumberCell *>(m_pool.find(cell)); number != nullptr) {
+        double value = number->getNumber();
+        m_pool.release(cell);
+        setNumber(coords, value);
+        return;
+    }
+    auto [tile, index] = prepareSet(coords);
+    if (tile->m_cells == nullptr) {
+        tile->m_cells = make_unique<TileCells>();
+    }
+    (*tile->m_cells)[index] = cell;
+    if (m_range_index) {
+        updateIndex(locate(coords).first, static_cast<int>(index % TILE_COLS));
+    }
+}
+
+void CCellStorage::setNumber(const pair<int, int> &coords, double number) {
+    auto [tile, index] = prepareSet(coords);
+    tile->m_numbers[numberIndex(index)] = number;
+    tile->m_number_rows[index % TILE_COLS] |= uint64_t(1) << (index / TILE_COLS);
+    if (m_range_index) {
+        updateIndex(locate(coords).first, static_cast<int>(index % TILE_COLS));
+    }
+}
+
+void CCellStorage::erase(const Rect &area) {
+    vector<pair<int, int>> to_erase;
+    forEachTile(area, [&area, &to_erase](const pair<int, int> &tile_coords, const Tile &tile) {
+        auto [rows, cols] = clamp(area, tile_coords);
+        for (int row = rows.first; row <= rows.second; row++) {
+            for (int col = cols.first; col <= cols.second; col++) {
+                size_t index = static_cast<size_t>(row) * TILE_COLS + col;
+                if ((tile.m_number_rows[col] >> row & 1) || (tile.m_cells != nullptr && (*tile.m_cells)[index])) {
+                    to_erase.emplace_back(tile_coords.first * TILE_ROWS + row, tile_coords.second * TILE_COLS + col);
+                }
+            }
+        }
+    });
+    // set() would be the member function here
+    std::set<pair<pair<int, int>, int>> changed_segments;
+    for (const auto &coords: to_erase) {
+        auto [tile_coords, index] = locate(coords);
+        auto tile = m_tiles.find(tile_coords);
+        Tile *tile_data = own(tile->second);
+        uint64_t &number_rows = tile_data->m_number_rows[index % TILE_COLS];
+        uint64_t row_bit = uint64_t(1) << (index / TILE_COLS);
+        if (m_range_index && (number_rows & row_bit)) {
+            changed_segments.insert({tile_coords, static_cast<int>(index % TILE_COLS)});
+        }
+        number_rows &= ~row_bit;
+        if (tile_data->m_cells != nullptr) {
+            m_pool.release((*tile_data->m_cells)[index]);
+            (*tile_data->m_cells)[index] = {};
+        }
+        m_size--;
+        if (--tile_data->m_count == 0) {
+            m_tiles.erase(tile);
+        }
+    }
+    for (const auto &[tile_coords, col]: changed_segments) {
+        updateIndex(tile_coords, col);
+    }
+}
+
+bool CCellStorage::aggregate(const Rect &area, CNumberAggregate &aggregate) const {
+    auto [from, to] = area;
+    if (!m_range_index) {
+        return false;
+    }
+    auto index_beg = m_indexes.lower_bound(from.second), index_end = m_indexes.upper_bound(to.second);
+    for (auto index = index_beg; index != index_end; index++) {
+        if (index->second.isDirty()) {
+            return false;
+        }
+    }
+    if (from.first > to.first) {
+        return true;
+    }
+    int tile_row_from = floorDiv(from.first, TILE_ROWS), tile_row_to = floorDiv(to.first, TILE_ROWS);
+    // blocks covered by the rectangle only partially are read from the tiles
+    int first_full = from.first == tile_row_from * TILE_ROWS ? tile_row_from : tile_row_from + 1;
+    int last_full = to.first - tile_row_to * TILE_ROWS == TILE_ROWS - 1 ? tile_row_to : tile_row_to - 1;
+    CNumberAggregate result;
+    for (auto index = index_beg; index != index_end; index++) {
+        int column = index->first;
+        int tile_col = floorDiv(column, TILE_COLS), col = column - tile_col * TILE_COLS;
+        if (first_full <= last_full) {
+            result.merge(index->second.query(first_full, last_full));
+        }
+        auto partial = [&](int tile_row) {
+            auto tile = m_tiles.find({tile_row, tile_col});
+            auto [rows, cols] = clamp(area, {tile_row, tile_col});
+            uint64_t row_mask = ~uint64_t(0);
+            if (rows.second - rows.first + 1 < TILE_ROWS) {
+                row_mask = ((uint64_t(1) << (rows.second - rows.first + 1)) - 1) << rows.first;
+            }
+            result.merge(segmentAggregate(tile == m_tiles.end() ? nullptr : tile->second.get(), col, row_mask));
+        };
+        if (tile_row_from < first_full) {
+            partial(tile_row_from);
+        }
+        if (tile_row_to > last_full && tile_row_to != tile_row_from) {
+            partial(tile_row_to);
+        }
+    }
+    aggregate.merge(result);
+    return true;
+}
+
+void CCellStorage::setRangeIndex(bool enabled) {
+    m_range_index = enabled;
+    m_indexes.clear();
+    if (!enabled) {
+        return;
+    }
+    for (const auto &[tile_coords, tile]: m_tiles) {
+        for (int col = 0; col < TILE_COLS; col++) {
+            if (tile->m_number_rows[col] != 0) {
+                m_indexes[tile_coords.second * TILE_COLS + col].markDirty();
+            }
+        }
+    }
+}
+
+bool CCellStorage::hasRangeIndex() const {
+    return m_range_index;
+}
+
+void CCellStorage::refreshIndexes() {
+    map<int, vector<pair<int, CNumberAggregate>>> blocks;
+    for (const auto &[column, index]: m_indexes) {
+        if (index.isDirty()) {
+            blocks[column];
+        }
+    }
+    if (blocks.empty()) {
+        return;
+    }
+    // tiles are ordered by the tile row, so blocks of each column are collected sorted
+    for (const auto &[tile_coords, tile]: m_tiles) {
+        for (int col = 0; col < TILE_COLS; col++) {
+            auto column_blocks = blocks.find(tile_coords.second * TILE_COLS + col);
+            if (column_blocks != blocks.end()) {
+                column_blocks->second.emplace_back(tile_coords.first, segmentAggregate(tile.get(), col, ~uint64_t(0)));
+            }
+        }
+    }
+    for (const auto &[column, column_blocks]: blocks) {
+        m_indexes[column].rebuild(column_blocks);
+    }
+}
+
+size_t CCellStorage::getSharedTiles() const {
+    size_t shared = 0;
+    for (const auto &[tile_coords, tile]: m_tiles) {
+        if (tile.use_count() > 1) {
+            shared++;
+        }
+    }
+    return shared;
+}
+
+size_t CCellStorage::size() const {
+    return m_size;
+}
+
+bool CCellStorage::empty() const {
+    return m_size == 0;
+}
+
+CCellPool &CCellStorage::getPool() {
+    return m_pool;
+}
+
+void CCellStorage::clear() {
+    m_tiles.clear();
+    m_pool.clear();
+    m_size = 0;
+    m_indexes.clear();
+}
+
+void CCellStorage::merge(CCellStorage &&src) {
+    uint32_t offset = m_pool.merge(std::move(src.m_pool));
+    for (auto &[tile_coords, tile]: src.m_tiles) {
+        if (tile->m_cells != nullptr) {
+            for (auto &handle: *tile->m_cells) {
+                if (handle) {
+                    handle.index += offset;
+                }
+            }
+        }
+        auto [position, inserted] = m_tiles.try_emplace(tile_coords, tile);
+        if (inserted) {
+            // tiles written by the source can be written by this storage, tiles it shared are still shared
+            if (tile->m_owner == src.m_owner.load(memory_order_relaxed)) {
+                tile->m_owner = m_owner.load(memory_order_relaxed);
+            }
+            m_size += tile->m_count;
+            for (int col = 0; m_range_index && col < TILE_COLS; col++) {
+                if (tile->m_number_rows[col] != 0) {
+                    m_indexes[tile_coords.second * TILE_COLS + col].markDirty();
+                }
+            }
+            continue;
+        }
+        // both storages have cells in the tile, so the cells are set one by one
+        int first_row = tile_coords.first * TILE_ROWS, first_col = tile_coords.second * TILE_COLS;
+        for (size_t index = 0; index < TILE_ROWS * TILE_COLS; index++) {
+            pair<int, int> coords = {first_row + static_cast<int>(index / TILE_COLS),
+                                     first_col + static_cast<int>(index % TILE_COLS)};
+            if (tile->m_number_rows[index % TILE_COLS] >> (index / TILE_COLS) & 1) {
+                setNumber(coords, tile->m_numbers[numberIndex(index)]);
+            } else if (tile->m_cells != nullptr && (*tile->m_cells)[index]) {
+                set(coords, (*tile->m_cells)[index]);
+            }
+        }
+    }
+    src.m_tiles.clear();
+    src.m_size = 0;
+    src.m_indexes.clear();
+}
+
+vector<pair<int, int>> CCellStorage::partitionRows(size_t cells) const {
+    vector<pair<int, int>> ranges;
+    size_t range_cells = 0;
+    for (auto tile = m_tiles.begin(); tile != m_tiles.end();) {
+        int tile_row = tile->first.first;
+        if (range_cells == 0) {
+            ranges.emplace_back(tile_row * TILE_ROWS, 0);
+        }
+        for (; tile != m_tiles.end() && tile->first.first == tile_row; tile++) {
+            range_cells += tile->second->m_count;
+        }
+        ranges.back().second = tile_row * TILE_ROWS + TILE_ROWS - 1;
+        if (range_cells >= cells) {
+            range_cells = 0;
+        }
+    }
+    return ranges;
+}
+
+void CCellStorage::updateIndex(const pair<int, int> &tile_coords, int col) {
+    auto tile = m_tiles.find(tile_coords);
+    auto aggregate = segmentAggregate(tile == m_tiles.end() ? nullptr : tile->second.get(), col, ~uint64_t(0));
+    int column = tile_coords.second * TILE_COLS + col;
+    auto index = m_indexes.find(column);
+    if (index == m_indexes.end()) {
+        // columns without numbers have no index
+        if (aggregate.count == 0) {
+            return;
+        }
+        index = m_indexes.emplace(column, CColumnIndex()).first;
+    }
+    index->second.setBlock(tile_coords.first, aggregate);
+}
+
+CNumberAggregate CCellStorage::segmentAggregate(const Tile *tile, int col, uint64_t row_mask) {
+    CNumberAggregate aggregate;
+    if (tile != nullptr) {
+        aggregate.add(tile->m_numbers.data() + col * TILE_ROWS, tile->m_number_rows[col] & row_mask);
+    }
+    return aggregate;
+}
+
+pair<CCellStorage::Tile *, size_t> CCellStorage::prepareSet(const pair<int, int> &coords) {
+    auto [tile_coords, index] = locate(coords);
+    auto &tile_data = m_tiles[tile_coords];
+    if (tile_data == nullptr) {
+        tile_data = make_shared<Tile>();
+        tile_data->m_owner = m_owner.load(memory_order_relaxed);
+    }
+    Tile *tile = own(tile_data);
+    uint64_t &number_rows = tile->m_number_rows[index % TILE_COLS];
+    uint64_t row_bit = uint64_t(1) << (index / TILE_COLS);
+    bool has_cell = tile->m_cells != nullptr && (*tile->m_cells)[index];
+    if (number_rows & row_bit) {
+        number_rows &= ~row_bit;
+    } else if (has_cell) {
+        m_pool.release((*tile->m_cells)[index]);
+        (*tile->m_cells)[index] = {};
+    } else {
+        tile->m_count++;
+        m_size++;
+    }
+    return {tile, index};
+}
+
+CCellStorage::Tile *CCellStorage::own(shared_ptr<Tile> &tile) {
+    // the count of references is not synchronized between copies, so tags decide instead
+    uint64_t owner = m_owner.load(memory_order_relaxed);
+    if (tile->m_owner != owner) {
+        tile = make_shared<Tile>(*tile);
+        tile->m_owner = owner;
+    }
+    return tile.get();
+}
+
+uint64_t CCellStorage::newOwner() {
+    return ++s_owners;
+}
+
+pair<pair<int, int>, size_t> CCellStorage::locate(const pair<int, int> &coords) {
+    auto [row, col] = coords;
+    int tile_row = floorDiv(row, TILE_ROWS), tile_col = floorDiv(col, TILE_COLS);
+    size_t index = static_cast<size_t>(row - tile_row * TILE_ROWS) * TILE_COLS + (col - tile_col * TILE_COLS);
+    return {{tile_row, tile_col}, index};
+}
+
+size_t CCellStorage::numberIndex(size_t index) {
+    return index % TILE_COLS * TILE_ROWS + index / TILE_COLS;
+}
+
+pair<pair<int, int>, pair<int, int>> CCellStorage::clamp(const Rect &area, const pair<int, int> &tile_coords) {
+    auto [from, to] = area;
+    // offsets in the tile are computed in long long, so coordinates near the int limits cannot overflow
+    long long first_row = static_cast<long long>(tile_coords.first) * TILE_ROWS;
+    long long first_col = static_cast<long long>(tile_coords.second) * TILE_COLS;
+    auto range = [](long long value_from, long long value_to, long long first, int size) -> pair<int, int> {
+        long long range_from = max<long long>(value_from - first, 0);
+        long long range_to = min<long long>(value_to - first, size - 1);
+        if (range_from > range_to) {
+            return {0, -1};
+        }
+        return {static_cast<int>(range_from), static_cast<int>(range_to)};
+    };
+    return {range(from.first, to.first, first_row, TILE_ROWS), range(from.second, to.second, first_col, TILE_COLS)};
+}
+
+int CCellStorage::floorDiv(int value, int divisor) {
+    int quotient = value / divisor;
+    if (value % divisor < 0) {
+        quotient--;
+    }
+    return quotient;
+}
@@ -0,0 +1,445 @@
+//
+// Created by bardanik on 14/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CCELLSTORAGE_H
+#define PA2_BIG_TASK_CCELLSTORAGE_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <set>
+#include <vector>
+#include "CCell.h"
+#include "CColumnIndex.h"
+
+/**
+ * Container to store cells of the spreadsheet - sparse matrix split into tiles.
+ *
+ * Tile is a dense block of TILE_ROWS x TILE_COLS positions, only tiles with at least one cell exist
+ * and they are kept in a directory keyed by tile coordinates. Cell in a found tile is accessed directly
+ * by its index, and cells of a rectangle are iterated over consecutive positions of the tiles it covers,
+ * without walking a tree for each cell.
+ *
+ * Number cells are not stored as objects. Each tile column is a segment of TILE_ROWS packed doubles
+ * with a bitmap of rows where a number is present, so scans over numbers read only contiguous doubles.
+ * String and expression cells are owned by a pool of the storage and tiles store their handles row by row
+ * in an array, which is allocated only for tiles containing such cells.
+ *
+ * Tiles with numbers only are shared by copies of the storage and are copied when one of the storages writes
+ * to them, so copying a storage with mostly numbers costs only copying of the tile directory. Every tile is
+ * tagged by the storage which may write to it, a copy and its source both get new tags, so none of them writes
+ * to a shared tile and copies can be changed from different threads. Tiles with
+ * string or expression cells are copied with their cells, because expression cells keep values computed
+ * in their spreadsheet.
+ *
+ * Optionally every column with numbers has an index of aggregates of its tile segments, which is updated
+ * with each change of numbers, so aggregates of large ranges are computed without reading all numbers.
+ */
+class CCellStorage {
+public:
+    // Number of rows in one tile.
+    static constexpr int TILE_ROWS = 64;
+    // Number of columns in one tile.
+    static constexpr int TILE_COLS = 16;
+
+    /**
+     * Constructs empty storage.
+     */
+    CCellStorage() = default;
+
+    /**
+     * Copy constructor - shares tiles with numbers only, other tiles are copied with their cells
+     * to the pool of this storage.
+     * @param src - storage to copy.
+     */
+    CCellStorage(const CCellStorage &src);
+
+    /**
+     * Move constructor - takes tiles of the source together with the right to write to them.
+     * @param src - storage to move.
+     */
+    CCellStorage(CCellStorage &&src) noexcept;
+
+    /**
+     * Copy-assignment operator - shares or copies tiles like the copy constructor.
+     * @param src - storage to copy.
+     * @return reference to this storage.
+     */
+    CCellStorage &operator=(CCellStorage src);
+
+    /**
+     * Finds a string or expression cell on a given position.
+     * @param coords - coordinates of the cell.
+     * @return pointer to the cell or nullptr if there is no such cell.
+     */
+    CCell *find(const pair<int, int> &coords) const;
+
+    /**
+     * Finds a number on a given position.
+     * @param coords - coordinates of the cell.
+     * @return pointer to the number or nullptr if there is no number cell.
+     */
+    const double *findNumber(const pair<int, int> &coords) const;
+
+    /**
+     * Sets a cell on a given position, rewriting previous cell. Number cells are stored as packed numbers
+     * and their cell objects are released.
+     * @param coords - coordinates of the cell.
+     * @param cell - handle of a cell created in the pool of this storage, the storage becomes its owner.
+     */
+    void set(const pair<int, int> &coords, CCellHandle cell);
+
+    /**
+     * Sets a number on a given position, rewriting previous cell.
+     * @param coords - coordinates of the cell.
+     * @param number - value of the number cell.
+     */
+    void setNumber(const pair<int, int> &coords, double number);
+
+    /**
+     * Removes all cells in a rectangle.
+     * @param area - rectangle of positions.
+     */
+    void erase(const Rect &area);
+
+    /**
+     * Calls a function for each string and expression cell in a rectangle, row by row,
+     * in each row from the left to the right. Numbers are skipped.
+     * @tparam Function - callable with coordinates and reference to a cell.
+     * @param area - rectangle of positions.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEach(const Rect &area, Function function) const;
+
+    /**
+     * Calls a function for each string and expression cell in the storage, in the same order as forEach for rectangle.
+     * @tparam Function - callable with coordinates and reference to a cell.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEach(Function function) const;
+
+    /**
+     * Calls a function for each segment of a tile column, which intersects a rectangle and contains numbers.
+     * Segments are visited tile by tile, in each tile column by column.
+     * @tparam Function - callable with pointer to the first number of the segment and the bitmap of valid numbers,
+     * the i-th bit is set if the i-th number is in the rectangle and the cell is a number.
+     * @param area - rectangle of positions.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEachNumbers(const Rect &area, Function function) const;
+
+    /**
+     * Calls a function for each number in a rectangle, in the same order as forEachNumbers.
+     * @tparam Function - callable with coordinates and the number.
+     * @param area - rectangle of positions.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEachNumber(const Rect &area, Function function) const;
+
+    /**
+     * Calls a function for each number in the storage.
+     * @tparam Function - callable with coordinates and the number.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEachNumber(Function function) const;
+
+    /**
+     * Aggregates numbers in a rectangle using column indexes.
+     * @param area - rectangle of positions.
+     * @param aggregate - aggregate to which numbers are added.
+     * @return false if indexes are disabled or some of them has to be rebuilt, aggregate is not changed then.
+     */
+    bool aggregate(const Rect &area, CNumberAggregate &aggregate) const;
+
+    /**
+     * Enables or disables column indexes of numbers. Enabled indexes are built by refreshIndexes().
+     * @param enabled - true to maintain indexes.
+     */
+    void setRangeIndex(bool enabled);
+
+    /**
+     * Checks if column indexes are maintained.
+     */
+    bool hasRangeIndex() const;
+
+    /**
+     * Rebuilds column indexes which were invalidated by adding numbers to new tiles.
+     * Must not be called while other threads read the storage.
+     */
+    void refreshIndexes();
+
+    /**
+     * Gets number of tiles shared with other copies of the storage.
+     * @return the number of tiles, which are copied on the next write to them.
+     */
+    size_t getSharedTiles() const;
+
+    /**
+     * Gets number of stored cells.
+     * @return number of cells.
+     */
+    size_t size() const;
+
+    /**
+     * Checks if there are no cells.
+     * @return true if the storage is empty.
+     */
+    bool empty() const;
+
+    /**
+     * Removes all cells.
+     */
+    void clear();
+
+    /**
+     * Moves all cells of another storage to this storage, cells of the other storage rewrite cells
+     * on the same positions. Tiles which are not in this storage are moved without moving their cells,
+     * so storages with cells in different rows, e.g. loaded in parallel, are merged quickly.
+     * @param src - storage to merge, it is empty afterwards.
+     */
+    void merge(CCellStorage &&src);
+
+    /**
+     * Splits rows with cells into ranges, each range consists of whole tile rows and contains
+     * about the given number of cells, so the ranges can be processed in parallel.
+     * @param cells - number of cells in one range.
+     * @return first and last rows of the ranges from the top, ranges without cells are skipped.
+     */
+    vector<pair<int, int>> partitionRows(size_t cells) const;
+
+    /**
+     * Gets the pool, which owns string and expression cells of this storage and where new cells are created.
+     * @return the pool of cells.
+     */
+    CCellPool &getPool();
+
+private:
+
+    // Handles of string and expression cells of a tile, stored row by row.
+    using TileCells = array<CCellHandle, TILE_ROWS * TILE_COLS>;
+
+    /**
+     * Dense block of positions.
+     */
+    struct Tile {
+        Tile() = default;
+
+        Tile(const Tile &src);
+
+        // Handles of string and expression cells, empty positions have empty handles. Allocated with the first such cell.
+        unique_ptr<TileCells> m_cells;
+        // Numbers stored column by column, each tile column is one segment.
+        array<double, TILE_ROWS * TILE_COLS> m_numbers;
+        // For each tile column bitmap of rows where a number is stored.
+        array<uint64_t, TILE_COLS> m_number_rows = {};
+        // Number of non-empty positions.
+        size_t m_count = 0;
+        // Tag of the storage which can write to the tile, other storages copy it first. Is not copied.
+        uint64_t m_owner = 0;
+    };
+
+    static_assert(TILE_ROWS == 64, "number bitmap of a tile column is a 64-bit mask");
+
+    /**
+     * Finds a tile, where a cell can be set, creating it if it does not exist,
+     * and removes previous cell on the position.
+     * @param coords - coordinates of the position.
+     * @return the tile and index of the position in the tile.
+     */
+    pair<Tile *, size_t> prepareSet(const pair<int, int> &coords);
+
+    /**
+     * Makes a tile writable by this storage, the tile is copied if it is not tagged by this storage.
+     * Shared tiles have no cells, so only numbers are copied.
+     * @param tile - the tile in the directory.
+     * @return the writable tile.
+     */
+    Tile *own(shared_ptr<Tile> &tile);
+
+    /**
+     * Gets a tag no storage has used yet.
+     */
+    static uint64_t newOwner();
+
+    /**
+     * Updates aggregate of a tile segment in the column index.
+     * @param tile_coords - coordinates of the tile.
+     * @param col - column in the tile.
+     */
+    void updateIndex(const pair<int, int> &tile_coords, int col);
+
+    /**
+     * Aggregates numbers of a tile segment.
+     * @param tile - the tile, nullptr if the tile does not exist.
+     * @param col - column in the tile.
+     * @param row_mask - bitmap of rows to aggregate.
+     */
+    static CNumberAggregate segmentAggregate(const Tile *tile, int col, uint64_t row_mask);
+
+    /**
+     * Calls a function for each tile intersecting a rectangle, tile row by tile row.
+     * @tparam Function - callable with coordinates of the tile and the tile.
+     * @param area - rectangle of positions.
+     * @param function - function to call.
+     */
+    template<typename Function>
+    void forEachTile(const Rect &area, Function function) const;
+
+    /**
+     * Splits coordinates into coordinates of the tile and index of the position in the tile.
+     * @param coords - coordinates of the position.
+     * @return tile coordinates and index in the tile.
+     */
+    static pair<pair<int, int>, size_t> locate(const pair<int, int> &coords);
+
+    /**
+     * Gets index of a position in the numbers of the tile from its index in the cells of the tile.
+     */
+    static size_t numberIndex(size_t index);
+
+    /**
+     * Clamps a rectangle to a tile.
+     * @param area - rectangle of positions.
+     * @param tile_coords - coordinates of the tile.
+     * @return first and last row, first and last column of the rectangle as offsets in the tile,
+     * an empty range {0, -1} if the rectangle does not reach the tile in that dimension.
+     */
+    static pair<pair<int, int>, pair<int, int>> clamp(const Rect &area, const pair<int, int> &tile_coords);
+
+    /**
+     * Integer division rounding down, so negative coordinates are mapped to tiles too.
+     */
+    static int floorDiv(int value, int divisor);
+
+    // Owner of string and expression cells.
+    CCellPool m_pool;
+    // Tiles with at least one cell, keyed by the tile row and the tile column.
+    map<pair<int, int>, shared_ptr<Tile>> m_tiles;
+    // Number of stored cells.
+    size_t m_size = 0;
+    // If column indexes are maintained.
+    bool m_range_index = false;
+    // Indexes of columns with numbers, keyed by the column.
+    map<int, CColumnIndex> m_indexes;
+    // Tag of tiles this storage can write to, is changed by copying, which is a const operation of the source.
+    mutable atomic<uint64_t> m_owner = newOwner();
+    // Last used tag.
+    static inline atomic<uint64_t> s_owners = 0;
+};
+
+template<typename Function>
+void CCellStorage::forEachTile(const Rect &area, Function function) const {
+    auto [from, to] = area;
+    if (from.first > to.first || from.second > to.second) {
+        return;
+    }
+    int tile_row_from = floorDiv(from.first, TILE_ROWS), tile_row_to = floorDiv(to.first, TILE_ROWS);
+    int tile_col_from = floorDiv(from.second, TILE_COLS), tile_col_to = floorDiv(to.second, TILE_COLS);
+
+    auto tile = m_tiles.lower_bound({tile_row_from, tile_col_from});
+    while (tile != m_tiles.end() && tile->first.first <= tile_row_to) {
+        int tile_row = tile->first.first;
+        if (tile->first.second < tile_col_from) {
+            // the tile row continues left of the rectangle
+            tile = m_tiles.lower_bound({tile_row, tile_col_from});
+            continue;
+        }
+        for (; tile != m_tiles.end() && tile->first.first == tile_row && tile->first.second <= tile_col_to; tile++) {
+            function(tile->first, *tile->second);
+        }
+        if (tile_row == tile_row_to) {
+            break;
+        }
+        tile = m_tiles.lower_bound({tile_row + 1, tile_col_from});
+    }
+}
+
+template<typename Function>
+void CCellStorage::forEach(const Rect &area, Function function) const {
+    // tiles of one tile row, which intersect the rectangle columns
+    vector<pair<pair<int, int>, const TileCells *>> band;
+    auto flush = [this, &area, &band, &function]() {
+        if (band.empty()) {
+            return;
+        }
+        auto [rows, cols] = clamp(area, band.front().first);
+        int first_row = band.front().first.first * TILE_ROWS;
+        for (int row = rows.first; row <= rows.second; row++) {
+            for (const auto &[tile_coords, tile_cells]: band) {
+                auto [row_range, col_range] = clamp(area, tile_coords);
+                int first_col = tile_coords.second * TILE_COLS;
+                const auto *cells = tile_cells->data() + row * TILE_COLS;
+                for (int col = col_range.first; col <= col_range.second; col++) {
+                    if (cells[col]) {
+                        function(pair<int, int>{first_row + row, first_col + col}, *m_pool.find(cells[col]));
+                    }
+                }
+            }
+        }
+        band.clear();
+    };
+    forEachTile(area, [&band, &flush](const pair<int, int> &tile_coords, const Tile &tile) {
+        if (!band.empty() && band.front().first.first != tile_coords.first) {
+            flush();
+        }
+        if (tile.m_cells != nullptr) {
+            band.emplace_back(tile_coords, tile.m_cells.get());
+        }
+    });
+    flush();
+}
+
+template<typename Function>
+void CCellStorage::forEach(Function function) const {
+    forEach({{INT_MIN, INT_MIN}, {INT_MAX, INT_MAX}}, function);
+}
+
+template<typename Function>
+void CCellStorage::forEachNumbers(const Rect &area, Function function) const {
+    forEachTile(area, [&area, &function](const pair<int, int> &tile_coords, const Tile &tile) {
+        auto [rows, cols] = clamp(area, tile_coords);
+        // rows of the rectangle in the tile, shifting by 64 is undefined, so the full mask is special
+        uint64_t row_mask = ~uint64_t(0);
+        if (rows.second - rows.first + 1 < TILE_ROWS) {
+            row_mask = ((uint64_t(1) << (rows.second - rows.first + 1)) - 1) << rows.first;
+        }
+        for (int col = cols.first; col <= cols.second; col++) {
+            uint64_t mask = tile.m_number_rows[col] & row_mask;
+            if (mask != 0) {
+                function(tile.m_numbers.data() + col * TILE_ROWS, mask);
+            }
+        }
+    });
+}
+
+template<typename Function>
+void CCellStorage::forEachNumber(const Rect &area, Function function) const {
+    forEachTile(area, [&area, &function](const pair<int, int> &tile_coords, const Tile &tile) {
+        auto [rows, cols] = clamp(area, tile_coords);
+        for (int col = cols.first; col <= cols.second; col++) {
+            const double *numbers = tile.m_numbers.data() + col * TILE_ROWS;
+            for (uint64_t mask = tile.m_number_rows[col]; mask != 0; mask &= mask - 1) {
+                int row = countr_zero(mask);
+                if (row >= rows.first && row <= rows.second) {
+                    function(pair<int, int>{tile_coords.first * TILE_ROWS + row, tile_coords.second * TILE_COLS + col},
+                             numbers[row]);
+                }
+            }
+        }
+    });
+}
+
+template<typename Function>
+void CCellStorage::forEachNumber(Function function) const {
+    forEachNumber({{INT_MIN, INT_MIN}, {INT_MAX, INT_MAX}}, function);
+}
+
+#endif //PA2_BIG_TASK_CCELLSTORAGE_H
@@ -0,0 +1,63 @@
+//
+// Created by bardanik on 18/05/24.
+//
+
+#include <algorithm>
+#include "CColumnIndex.h"
+
+void CColumnIndex::setBlock(int block, const CNumberAggregate &aggregate) {
+    if (m_dirty) {
+        return;
+    }
+    auto found = lower_bound(m_blocks.begin(), m_blocks.end(), block);
+    if (found == m_blocks.end() || *found != block) {
+        m_dirty = true;
+        return;
+    }
+    size_t node = m_blocks.size() + (found - m_blocks.begin());
+    m_tree[node] = aggregate;
+    for (node /= 2; node >= 1; node /= 2) {
+        m_tree[node] = m_tree[2 * node];
+        m_tree[node].merge(m_tree[2 * node + 1]);
+    }
+}
+
+void CColumnIndex::rebuild(const vector<pair<int, CNumberAggregate>> &blocks) {
+    size_t size = blocks.size();
+    m_blocks.resize(size);
+    m_tree.assign(2 * size, {});
+    for (size_t i = 0; i < size; i++) {
+        m_blocks[i] = blocks[i].first;
+        m_tree[size + i] = blocks[i].second;
+    }
+    for (size_t node = size - 1; node >= 1 && node < size; node--) {
+        m_tree[node] = m_tree[2 * node];
+        m_tree[node].merge(m_tree[2 * node + 1]);
+    }
+    m_dirty = false;
+}
+
+void CColumnIndex::markDirty() {
+    m_dirty = true;
+}
+
+bool CColumnIndex::isDirty() const {
+    return m_dirty;
+}
+
+CNumberAggregate CColumnIndex::query(int block_from, int block_to) const {
+    CNumberAggregate result;
+    size_t size = m_blocks.size();
+    // half-open range of leaves, bottom-up traversal of the segment tree
+    size_t left = size + (lower_bound(m_blocks.begin(), m_blocks.end(), block_from) - m_blocks.begin());
+    size_t right = size + (upper_bound(m_blocks.begin(), m_blocks.end(), block_to) - m_blocks.begin());
+    for (; left < right; left /= 2, right /= 2) {
+        if (left & 1) {
+            result.merge(m_tree[left++]);
+        }
+        if (right & 1) {
+            result.merge(m_tree[--right]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+//
+// Created by bardanik on 18/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CCOLUMNINDEX_H
+#define PA2_BIG_TASK_CCOLUMNINDEX_H
+
+#include <vector>
+#include "../Evaluation/CNumberKernels.h"
+
+/**
+ * Index of numbers in one column of the spreadsheet, answers aggregates (sum, count, minimum and maximum)
+ * of row ranges in logarithmic time.
+ *
+ * The column is split into blocks of rows (the rows of one tile of the cell storage), the index is
+ * a segment tree over aggregates of the blocks. Aggregate of a changed block is replaced and its
+ * ancestors are recomputed from their children, so no rounding error accumulates with updates.
+ * When a block, which is not in the tree yet, is changed, the index becomes dirty and has to be rebuilt.
+ */
+class CColumnIndex {
+public:
+    /**
+     * Replaces aggregate of a block, marks the index dirty if the block is not in the index.
+     * Updates of dirty index are ignored, the index has to be rebuilt from all blocks anyway.
+     * @param block - index of the block.
+     * @param aggregate - aggregate of numbers in the block.
+     */
+    void setBlock(int block, const CNumberAggregate &aggregate);
+
+    /**
+     * Builds the index from aggregates of all blocks of the column.
+     * @param blocks - blocks and their aggregates, sorted by the block.
+     */
+    void rebuild(const vector<pair<int, CNumberAggregate>> &blocks);
+
+    /**
+     * Marks the index dirty, so it has to be rebuilt before it is used.
+     */
+    void markDirty();
+
+    /**
+     * Checks if the index has to be rebuilt before it is used.
+     */
+    bool isDirty() const;
+
+    /**
+     * Aggregates numbers of blocks in a range.
+     * @param block_from - first block of the range.
+     * @param block_to - last block of the range.
+     * @return aggregate of the blocks.
+     */
+    CNumberAggregate query(int block_from, int block_to) const;
+
+private:
+    // Blocks in the index, sorted.
+    vector<int> m_blocks;
+    // Segment tree, leaves are aggregates of the blocks starting at index m_blocks.size().
+    vector<CNumberAggregate> m_tree;
+    // If some changed block is not in the index.
+    bool m_dirty = true;
+};
+
+
+#endif //PA2_BIG_TASK_CCOLUMNINDEX_H
@@ -0,0 +1,149 @@
+//
+// Created by bardanik on 12/05/24.
+//
+
+#include <climits>
+#include "CDependencyGraph.h"
+
+void CDependencyGraph::setReferences(const pair<int, int> &cell, const vector<Rect> &references) {
+    auto precedents = m_precedents.find(cell);
+    if (precedents != m_precedents.end()) {
+        updateIndex(cell, precedents->second, false);
+        m_precedents.erase(precedents);
+    }
+    if (references.empty()) {
+        return;
+    }
+    m_precedents.emplace(cell, references);
+    updateIndex(cell, references, true);
+}
+
+void CDependencyGraph::removeReferences(const Rect &area) {
+    auto [from, to] = area;
+    if (from.first > to.first) {
+        return;
+    }
+    // cells of each row are found by a lookup, so cells of other columns in the rows are not visited
+    forEachInRows(m_precedents, area, [this](auto &it) {
+        updateIndex(it->first, it->second, false);
+        it = m_precedents.erase(it);
+    });
+}
+
+vector<pair<int, int>> CDependencyGraph::dependentsOf(const Rect &area) const {
+    auto [from, to] = area;
+    vector<pair<int, int>> dependents;
+    if (from.first > to.first || from.second > to.second) {
+        return dependents;
+    }
+
+    forEachInRows(m_dependents, area, [&dependents](auto &it) {
+        dependents.insert(dependents.end(), it->second.begin(), it->second.end());
+        it++;
+    });
+
+    // ranges indexed by a column cover it, so only the rows have to intersect
+    auto column = m_range_dependents.lower_bound(from.second);
+    auto column_end = m_range_dependents.upper_bound(to.second);
+    for (; column != column_end; column++) {
+        auto found = [&dependents](const Rect &, const pair<int, int> &cell) {
+            dependents.push_back(cell);
+        };
+        column->second.forEachIntersecting(from.first, to.first, found);
+    }
+
+    m_wide_range_dependents.forEachIntersecting(from.first, to.first,
+                                                [&area, &dependents](const Rect &range, const pair<int, int> &cell) {
+        if (intersects(range, area)) {
+            dependents.push_back(cell);
+        }
+    });
+    return dependents;
+}
+
+const vector<Rect> &CDependencyGraph::precedentsOf(const pair<int, int> &cell) const {
+    static const vector<Rect> no_precedents;
+    auto precedents = m_precedents.find(cell);
+    if (precedents == m_precedents.end()) {
+        return no_precedents;
+    }
+    return precedents->second;
+}
+
+void CDependencyGraph::clear() {
+    m_precedents.clear();
+    m_dependents.clear();
+    m_range_dependents.clear();
+    m_wide_range_dependents = {};
+}
+
+void CDependencyGraph::updateIndex(const pair<int, int> &cell, const vector<Rect> &references, bool insert) {
+    for (const auto &reference: references) {
+        auto [from, to] = reference;
+        if (from == to) {
+            if (insert) {
+                m_dependents[from].insert(cell);
+            } else if (auto dependents = m_dependents.find(from); dependents != m_dependents.end()) {
+                dependents->second.erase(cell);
+                if (dependents->second.empty()) {
+                    m_dependents.erase(dependents);
+                }
+            }
+        } else if (to.second - from.second >= WIDE_RANGE_COLUMNS) {
+            if (insert) {
+                m_wide_range_dependents.insert({reference, cell});
+            } else {
+                m_wide_range_dependents.erase({reference, cell});
+            }
+        } else {
+            for (int col = from.second; col <= to.second; col++) {
+                if (insert) {
+                    m_range_dependents[col].insert({reference, cell});
+                } else if (auto ranges = m_range_dependents.find(col); ranges != m_range_dependents.end()) {
+                    ranges->second.erase({reference, cell});
+                    if (ranges->second.empty()) {
+                        m_range_dependents.erase(ranges);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CDependencyGraph::RowIntervals::insert(const Entry &entry) {
+    auto &block = m_blocks[RowIntervals::block(entry.first)];
+    block.by_first.insert(entry);
+    block.by_last.insert({entry.first.second.first, entry});
+}
+
+void CDependencyGraph::RowIntervals::erase(const Entry &entry) {
+    auto block = m_blocks.find(RowIntervals::block(entry.first));
+    if (block == m_blocks.end()) {
+        return;
+    }
+    block->second.by_first.erase(entry);
+    block->second.by_last.erase({entry.first.second.first, entry});
+    if (block->second.by_first.empty()) {
+        m_blocks.erase(block);
+    }
+}
+
+bool CDependencyGraph::RowIntervals::empty() const {
+    return m_blocks.empty();
+}
+
+uint64_t CDependencyGraph::RowIntervals::offset(int row) {
+    return static_cast<uint64_t>(static_cast<int64_t>(row) - INT_MIN);
+}
+
+pair<int, uint64_t> CDependencyGraph::RowIntervals::block(const Rect &range) {
+    uint64_t first = offset(range.first.first), last = offset(range.second.first);
+    // the first and the last row are in the same block from the level of their highest different bit
+    int level = static_cast<int>(bit_width(first ^ last));
+    return {level, first >> level};
+}
+
+bool CDependencyGraph::intersects(const Rect &first, const Rect &second) {
+    return first.first.first <= second.second.first && second.first.first <= first.second.first
+           && first.first.second <= second.second.second && second.first.second <= first.second.second;
+}
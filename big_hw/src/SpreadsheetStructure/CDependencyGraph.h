@@ -0,0 +1,206 @@
+//
+// Created by bardanik on 12/05/24.
+//
+
+#ifndef PA2_BIG_TASK_CDEPENDENCYGRAPH_H
+#define PA2_BIG_TASK_CDEPENDENCYGRAPH_H
+
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+#include "CPos.h"
+
+/**
+ * Graph of references between cells in the spreadsheet. For every expression cell stores rectangles
+ * of positions it references (its precedents) and keeps a reverse index, so cells that reference
+ * some position (its dependents) can be found without scanning the whole spreadsheet.
+ *
+ * The graph works only with coordinates, not with the cells, so it stays valid when cells are copied
+ * and can be copied together with the cells container. References to single cells are indexed by the
+ * referenced position, ranges are indexed by each column they cover by their rows, so ranges intersecting
+ * some rows are found in logarithmic time. Very wide ranges are indexed by their rows only.
+ */
+class CDependencyGraph {
+public:
+    /**
+     * Sets references of a cell, replacing references stored for that position before.
+     * @param cell - coordinates of the cell.
+     * @param references - rectangles referenced by the cell, single reference has both corners the same.
+     */
+    void setReferences(const pair<int, int> &cell, const vector<Rect> &references);
+
+    /**
+     * Removes references of all cells placed in some rectangle.
+     * Is used when cells are deleted or rewritten.
+     * @param area - rectangle of positions.
+     */
+    void removeReferences(const Rect &area);
+
+    /**
+     * Finds cells that directly reference some position in a given rectangle.
+     * @param area - rectangle of referenced positions.
+     * @return coordinates of dependent cells, the same cell can be returned more times.
+     */
+    vector<pair<int, int>> dependentsOf(const Rect &area) const;
+
+    /**
+     * Gets rectangles referenced by a cell.
+     * @param cell - coordinates of the cell.
+     * @return referenced rectangles, empty if the cell references nothing.
+     */
+    const vector<Rect> &precedentsOf(const pair<int, int> &cell) const;
+
+    /**
+     * Removes all references.
+     */
+    void clear();
+
+private:
+
+    /**
+     * Ranges with positions of the cells referencing them, indexed by their rows. A range is stored in the smallest
+     * aligned block of rows of a power of two size containing it, so all ranges of a block except single rows
+     * cross the middle of the block. Ranges of a block are ordered by their first and by their last row,
+     * the ranges intersecting some rows are read from the start of one of the orders.
+     */
+    struct RowIntervals {
+        using Entry = pair<Rect, pair<int, int>>;
+
+        /**
+         * Adds a range referenced by a cell.
+         */
+        void insert(const Entry &entry);
+
+        /**
+         * Removes a range referenced by a cell.
+         */
+        void erase(const Entry &entry);
+
+        /**
+         * Calls a function for each range which has a common row with given rows.
+         * @tparam Function - callable with the range and the referencing cell.
+         * @param row_from - first row.
+         * @param row_to - last row.
+         * @param function - function to call.
+         */
+        template<typename Function>
+        void forEachIntersecting(int row_from, int row_to, Function function) const;
+
+        /**
+         * Checks if there are no ranges.
+         */
+        bool empty() const;
+
+        /**
+         * Maps a row to an unsigned offset keeping the order, so blocks of negative rows are aligned too.
+         */
+        static uint64_t offset(int row);
+
+        /**
+         * Gets the level and the index of the smallest block containing a range.
+         */
+        static pair<int, uint64_t> block(const Rect &range);
+
+        /**
+         * Ranges of one block, ordered by the first and by the last row.
+         */
+        struct Block {
+            set<Entry> by_first;
+            set<pair<int, Entry>> by_last;
+        };
+
+        // Blocks with some ranges, keyed by the level, i.e. the logarithm of the block size, and the block index.
+        map<pair<int, uint64_t>, Block> m_blocks;
+    };
+
+    /**
+     * Adds or removes cell from the reverse index of all its references.
+     * @param cell - coordinates of the cell.
+     * @param references - references of the cell.
+     * @param insert - true to add the cell, false to remove it.
+     */
+    void updateIndex(const pair<int, int> &cell, const vector<Rect> &references, bool insert);
+
+    /**
+     * Calls a function for each entry of a map keyed by positions, whose position is in a rectangle.
+     * Entries of each row outside the columns of the rectangle are skipped by a lookup, not one by one.
+     * @tparam Map - map keyed by positions.
+     * @tparam Function - callable with iterator to the entry, which moves the iterator past the entry.
+     * @param cells - the map.
+     * @param area - rectangle of positions, must not be empty.
+     * @param function - function to call.
+     */
+    template<typename Map, typename Function>
+    static void forEachInRows(Map &cells, const Rect &area, Function function);
+
+    /**
+     * Checks if two rectangles have some common position.
+     */
+    static bool intersects(const Rect &first, const Rect &second);
+
+    // Ranges covering more columns than this are not indexed by columns.
+    static constexpr int WIDE_RANGE_COLUMNS = 64;
+
+    // References of each expression cell, keyed by the cell position.
+    map<pair<int, int>, vector<Rect>> m_precedents;
+    // Cells referencing some position directly, keyed by the referenced position.
+    map<pair<int, int>, set<pair<int, int>>> m_dependents;
+    // Ranges keyed by the covered column, each range is stored with position of the cell which references it.
+    map<int, RowIntervals> m_range_dependents;
+    // Ranges which are too wide to be indexed by columns, stored with position of the referencing cell.
+    RowIntervals m_wide_range_dependents;
+};
+
+template<typename Function>
+void CDependencyGraph::RowIntervals::forEachIntersecting(int row_from, int row_to, Function function) const {
+    uint64_t from = offset(row_from), to = offset(row_to);
+    // blocks of each level intersecting the rows are adjacent, only the first and the last of them
+    // can contain ranges outside the rows, the others contain just the ranges which are returned
+    for (int level = 0; level <= 32; level++) {
+        auto block = m_blocks.lower_bound({level, from >> level});
+        for (; block != m_blocks.end() && block->first.first == level && block->first.second <= to >> level; block++) {
+            const auto &[by_first, by_last] = block->second;
+            // ranges of level 0 are single rows, they are all in the rows
+            uint64_t middle = level == 0 ? 0 : (block->first.second << level) + (uint64_t(1) << (level - 1));
+            if (level > 0 && to < middle) {
+                // ranges end in the upper half, the ones starting up to the last row intersect
+                for (auto it = by_first.begin(); it != by_first.end() && offset(it->first.first.first) <= to; it++) {
+                    function(it->first, it->second);
+                }
+            } else if (level > 0 && from >= middle) {
+                // ranges start in the lower half, the ones ending from the first row intersect
+                for (auto it = by_last.rbegin(); it != by_last.rend() && offset(it->first) >= from; it++) {
+                    function(it->second.first, it->second.second);
+                }
+            } else {
+                for (const auto &[range, cell]: by_first) {
+                    function(range, cell);
+                }
+            }
+        }
+    }
+}
+
+template<typename Map, typename Function>
+void CDependencyGraph::forEachInRows(Map &cells, const Rect &area, Function function) {
+    auto [from, to] = area;
+    auto it = cells.lower_bound(from);
+    auto end = cells.lower_bound({to.first, INT_MAX});
+    while (it != end) {
+        auto [row, col] = it->first;
+        if (col < from.second) {
+            it = cells.lower_bound({row, from.second});
+        } else if (col > to.second) {
+            // the last row of the rectangle ends at the end iterator
+            it = row == to.first ? end : cells.lower_bound({row + 1, from.second});
+        } else {
+            function(it);
+        }
+    }
+}
+
+
+#endif //PA2_BIG_TASK_CDEPENDENCYGRAPH_H
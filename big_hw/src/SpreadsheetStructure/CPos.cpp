@@ -17,6 +17,19 @@ CPos::CPos(int row, int col) : m_row(row), m_absolute_row(false), m_col(col), m_
 
 }
 
+bool CPos::operator==(const CPos &other) const {
+    return m_row == other.m_row && m_col == other.m_col && m_absolute_row == other.m_absolute_row
+           && m_absolute_col == other.m_absolute_col;
+}
+
+string CPos::toString() const {
+    string label;
+    for (int col = m_col + 1; col > 0; col = (col - 1) / 26) {
+        label.insert(label.begin(), static_cast<char>('A' + (col - 1) % 26));
+    }
+    return (m_absolute_col ? "$" : "") + label + (m_absolute_row ? "$" : "") + to_string(m_row);
+}
+
 string CPos::toUpperCase(const string_view &str) {
     string lower_cased;
     for (char c: str) {
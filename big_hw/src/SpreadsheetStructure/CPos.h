@@ -10,6 +10,9 @@
 
 using namespace std;
 
+// Rectangle of positions - coordinates of the upper left and the bottom right corner.
+using Rect = pair<pair<int, int>, pair<int, int>>;
+
 /**
  * Class that represents position in the spreadsheet.
  * Is used to parse string representation of position and operate with it.
@@ -56,6 +59,19 @@ public:
      */
     void shift(const pair<int, int> &offset);
 
+    /**
+     * Compares positions including which of their parts are absolute, so equal positions stay equal when shifted.
+     * @param other - position to compare with.
+     * @return true if both positions are equal.
+     */
+    bool operator==(const CPos &other) const;
+
+    /**
+     * Converts the position back to its string representation, absolute parts are prefixed by $.
+     * @return string representation of the position, e.g. $A1.
+     */
+    string toString() const;
+
     /**
      * Static function to convert string to upper case.
      * @param str - string to convert to upper case.
@@ -6,10 +6,7 @@
 #define PA2_BIG_TASK_CRANGE_H
 
 #include <vector>
-#include "CCell.h"
-
-// Container to store selection - array of position and defined cells.
-using Range = vector<pair<pair<int, int>, shared_ptr<CCell>>>;
+#include "CCellStorage.h"
 
 /**
  * Represents rectangular selection of cells in the spreadsheet cells container.
@@ -25,7 +22,7 @@ public:
     explicit CRange(CSpreadsheet &spreadsheet);
 
     /**
-     * Select cells.
+     * Select cells. Only the rectangle is remembered, cells are read when the selection is used.
      * @param src - upper left corner of the rectangular selection.
      * @param w - w >= 1, width of the rectangular.
      * @param h - h >= 1, height of the rectangular.
@@ -40,18 +37,29 @@ public:
     void select(const CPos &from, const CPos &to);
 
     /**
-     * Paste current selection to some another point.
+     * Paste current selection to some another point, the paste is recorded by copyRect of the spreadsheet.
      * Pasting without using select() - with empty selection - is undefined behaviour.
      * @param dst represents upper left corner from which to paste current selection.
      */
     void paste(const CPos &dst);
 
     /**
-     * Evaluates cells in the selection.
+     * Evaluates cells in the selection and passes them to consumers. Cells are read in place
+     * in the spreadsheet, values are neither collected nor copied.
+     * @param visitor - cycle detection object for evaluation.
+     * @param values - function receiving values of string and expression cells.
+     * @param numbers - function receiving segments of packed number cells and bitmaps of valid numbers.
+     */
+    void evaluate(CCycleDetectionVisitor &visitor, const ValuesConsumer &values, const NumbersConsumer &numbers);
+
+    /**
+     * Evaluates cells in the selection like evaluate with consumers, but number cells are only aggregated,
+     * using column indexes if they are enabled in the spreadsheet.
      * @param visitor - cycle detection object for evaluation.
-     * @return vector of evaluated cells in the selection.
+     * @param values - function receiving values of string and expression cells.
+     * @param numbers - aggregate to which number cells are added.
      */
-    vector<CValue> evaluate(CCycleDetectionVisitor &visitor);
+    void evaluate(CCycleDetectionVisitor &visitor, const ValuesConsumer &values, CNumberAggregate &numbers);
 
     /**
      * Parses range of cells.
@@ -64,27 +72,20 @@ public:
 private:
 
     /**
-     * Delete cells stored in the rectangle form from some position in the spreadsheet.
-     * @param dst upper left corner of the rectangular.
-     */
-    void deleteCells(const CPos &dst);
-
-    /**
-     * Shifts current cells positions in selection.
-     * Is used for relative references to be shifted and to update selection positions.
-     * @param offset - offset by which the rectangular selection is moved from one position to another.
+     * Evaluates string and expression cells in the selection.
+     * @param visitor - cycle detection object for evaluation.
+     * @param values - function receiving values of the cells.
      */
-    void shiftSelection(const pair<int, int> &offset);
+    void evaluateCells(CCycleDetectionVisitor &visitor, const ValuesConsumer &values);
 
     /**
-     * Assigns current selection non-empty cells to their current positions in the selection.
+     * Gets rectangle of the current selection.
+     * @return selected rectangle of positions.
      */
-    void pasteCells();
+    Rect selectedArea() const;
 
     // Reference to a spreadsheet.
     CSpreadsheet &m_spreadsheet;
-    // Current selection container. Stored cells and their current positions.
-    Range m_selection;
     // Upper left corner position - pivot -  where the last selection was made.
     CPos m_selection_position;
     // Width and height of the selection.
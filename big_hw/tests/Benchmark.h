@@ -0,0 +1,483 @@
+//
+// Created by bardanik on 19/05/24.
+//
+
+#ifndef PA2_BIG_TASK_BENCHMARK_H
+#define PA2_BIG_TASK_BENCHMARK_H
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include "../src/CSpreadsheet.h"
+
+/**
+ * Benchmarks, which are used to compare speed of different evaluation strategies.
+ * Each benchmark prints time of each measured variant.
+ */
+struct Benchmark {
+
+    // Number of heap allocations, is counted by operator new of the benchmark program.
+    static inline atomic<size_t> allocations = 0;
+    // Bytes of heap memory in use and their maximum, are counted by operator new and delete of the benchmark program.
+    static inline atomic<size_t> used = 0, peak = 0;
+
+    /**
+     * Counts allocated memory, is called by operator new of the benchmark program.
+     */
+    static void allocate(size_t size) {
+        size_t now = used += size;
+        size_t before = peak;
+        while (now > before && !peak.compare_exchange_weak(before, now)) {
+        }
+    }
+
+    /**
+     * Measures time of a function.
+     * @param function - function to measure.
+     * @return time in milliseconds.
+     */
+    template<typename Function>
+    static double measure(Function function) {
+        auto start = chrono::steady_clock::now();
+        function();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Prints result of one measured variant.
+     */
+    static void report(const string &benchmark, const string &variant, double milliseconds) {
+        cout << left << setw(24) << benchmark << setw(16) << variant << right << fixed << setprecision(2)
+             << setw(12) << milliseconds << " ms" << endl;
+    }
+
+    /**
+     * Prints result of one measured variant with number of heap allocations made by it.
+     */
+    static void report(const string &benchmark, const string &variant, double milliseconds, size_t allocated) {
+        cout << left << setw(24) << benchmark << setw(16) << variant << right << fixed << setprecision(2)
+             << setw(12) << milliseconds << " ms" << setw(12) << allocated << " allocations" << endl;
+    }
+
+    /**
+     * Prints how much the peak heap memory grew.
+     */
+    static void reportMemory(const string &benchmark, const string &variant, size_t bytes) {
+        cout << left << setw(24) << benchmark << setw(16) << variant << right << setw(12) << (bytes >> 20)
+             << " MB peak" << endl;
+    }
+
+    /**
+     * Run all benchmarks.
+     */
+    static void runAll() {
+        rangeIndexBenchmark();
+        filledRangeBenchmark();
+        bytecodeBenchmark();
+        parseBenchmark();
+        snapshotBenchmark();
+        blockCopyBenchmark();
+        cycleDetectionBenchmark();
+        errorValuesBenchmark();
+        binaryFormatBenchmark();
+        streamingLoadBenchmark();
+        checksumBenchmark();
+        parallelLoadBenchmark();
+    }
+
+    /**
+     * Repeatedly changes one cell of a 1M-row number column and evaluates min, max and sum of the whole column,
+     * with and without column indexes.
+     */
+    static void rangeIndexBenchmark() {
+        const int rows = 1000000, changes = 50;
+        vector<CValue> results[2];
+        for (bool indexed: {false, true}) {
+            CSpreadsheet x;
+            x.setRangeIndex(indexed);
+            double fill = measure([&x]() {
+                for (int row = 0; row < rows; row++) {
+                    x.setCell(CPos("A" + to_string(row)), to_string((row * 7919) % 1000003));
+                }
+                x.setCell(CPos("B1"), "=min(A0:A" + to_string(rows - 1) + ")");
+                x.setCell(CPos("B2"), "=max(A0:A" + to_string(rows - 1) + ")");
+                x.setCell(CPos("B3"), "=sum(A0:A" + to_string(rows - 1) + ")");
+                x.getValue(CPos("B1"));
+            });
+            auto &variant_results = results[indexed];
+            double evaluate = measure([&x, &variant_results]() {
+                for (int change = 0; change < changes; change++) {
+                    x.setCell(CPos("A" + to_string(change * 19997)), to_string(change * 1000 - 20000));
+                    for (auto pos: {"B1", "B2", "B3"}) {
+                        variant_results.push_back(x.getValue(CPos(pos)));
+                    }
+                }
+            });
+            string variant = indexed ? "index" : "scan";
+            report(__func__, variant + " fill", fill);
+            report(__func__, variant + " evaluate", evaluate);
+        }
+        assert(results[0] == results[1]);
+    }
+
+    /**
+     * Fills a 1M-row column by copying one expression cell and evaluates the sum of the filled column.
+     */
+    static void filledRangeBenchmark() {
+        const int rows = 1000000;
+        CSpreadsheet x;
+        for (int row = 0; row < rows; row++) {
+            x.setCell(CPos("A" + to_string(row)), to_string(row % 1000));
+        }
+        double copy = measure([&x]() {
+            x.setCell(CPos("B0"), "=A0 * 2 + $A$1");
+            for (int filled = 1; filled < rows; filled *= 2) {
+                x.copyRect(CPos("B" + to_string(filled)), CPos("B0"), 1, min(filled, rows - filled));
+            }
+            // pastes are applied before the cells are read
+            x.getCells();
+        });
+        CValue result;
+        double evaluate = measure([&x, &result]() {
+            x.setCell(CPos("C0"), "=sum(B0:B" + to_string(rows - 1) + ")");
+            result = x.getValue(CPos("C0"));
+        });
+        report(__func__, "copy", copy);
+        report(__func__, "evaluate", evaluate);
+        assert(result == CValue(999.0 * 1000 * 1000 + rows));
+    }
+
+    /**
+     * Evaluates a numeric expression many times by walking its AST tree, by its compiled program
+     * with the generic stack of variant values and by the double-only path.
+     */
+    static void bytecodeBenchmark() {
+        const int repeats = 1000000;
+        CSpreadsheet x;
+        x.setCell(CPos("A1"), "3");
+        x.setCell(CPos("A2"), "4");
+        x.setCell(CPos("B1"), "=if(A1 > 2, (A1 * A2 + 1) / (A2 - A1) ^ 2, -A1) + (A1 + A2) * (A1 - A2) - A2 / 4 + 7");
+        x.getValue(CPos("B1"));
+        auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos("B1").getCoords()));
+        const CExpressionTemplate &parsed = *cell->getTemplate();
+        assert(parsed.getProgram().isNumeric());
+        CValue results[3];
+        CCycleDetectionVisitor visitor;
+        visitor.visit(cell);
+        double tree = measure([&parsed, &visitor, &results]() {
+            for (int i = 0; i < repeats; i++) {
+                results[0] = parsed.getRoot().evaluate(visitor);
+            }
+        });
+        double program = measure([&parsed, &visitor, &results]() {
+            for (int i = 0; i < repeats; i++) {
+                results[1] = parsed.getProgram().evaluateGeneric(visitor);
+            }
+        });
+        double numeric = measure([&parsed, &visitor, &results]() {
+            for (int i = 0; i < repeats; i++) {
+                results[2] = parsed.getProgram().evaluate(visitor);
+            }
+        });
+        report(__func__, "tree", tree);
+        report(__func__, "bytecode", program);
+        report(__func__, "numeric", numeric);
+        assert(results[0] == results[1] && results[1] == results[2]);
+    }
+
+    /**
+     * Sets many cells with distinct expressions, so each of them is parsed, and destroys the spreadsheet.
+     */
+    static void parseBenchmark() {
+        const int rows = 200000;
+        auto spreadsheet = make_unique<CSpreadsheet>();
+        size_t before = allocations;
+        double parse = measure([&spreadsheet]() {
+            for (int row = 0; row < rows; row++) {
+                string r = to_string(row);
+                spreadsheet->setCell(CPos("F" + r), "=A" + r + " * 2 + (B" + r + " - 3) / if(A" + r + " > 5, C" + r
+                                                     + ", 4) + sum(D" + r + ":E" + r + ") - -A" + r);
+            }
+        });
+        size_t parse_allocations = allocations - before;
+        before = allocations;
+        double destroy = measure([&spreadsheet]() {
+            spreadsheet.reset();
+        });
+        report(__func__, "parse", parse, parse_allocations);
+        report(__func__, "destroy", destroy, allocations - before);
+    }
+
+    /**
+     * Copies a spreadsheet with 5M numbers and a column of expressions, changes one number in the copy
+     * and evaluates the expressions in both spreadsheets.
+     */
+    static void snapshotBenchmark() {
+        const int rows = 1000000, cols = 5;
+        CSpreadsheet x;
+        for (int col = 0; col < cols; col++) {
+            string column(1, static_cast<char>('A' + col));
+            for (int row = 0; row < rows; row++) {
+                x.setCell(CPos(column + to_string(row)), to_string(row % 100));
+            }
+        }
+        for (int row = 0; row < 1000; row++) {
+            x.setCell(CPos("G" + to_string(row)), "=sum(A" + to_string(row) + ":E" + to_string(row + 999) + ")");
+        }
+        x.getValue(CPos("G0"));
+        unique_ptr<CSpreadsheet> copy;
+        double snapshot = measure([&x, &copy]() {
+            copy = make_unique<CSpreadsheet>(x);
+        });
+        CValue results[2];
+        double write = measure([&x, &copy, &results]() {
+            copy->setCell(CPos("A500"), "1000");
+            results[0] = x.getValue(CPos("G0"));
+            results[1] = copy->getValue(CPos("G0"));
+        });
+        double destroy = measure([&copy]() {
+            copy.reset();
+        });
+        report(__func__, "copy", snapshot);
+        report(__func__, "write", write);
+        report(__func__, "destroy", destroy);
+        assert(results[1] == CValue(get<double>(results[0]) + 1000));
+    }
+
+    /**
+     * Fills 1000 rows of 200 columns of expressions by copying one column, copies the whole block twice
+     * to the same place, writes a cell of a pending copy of the block and evaluates a sum of the copied block.
+     */
+    static void blockCopyBenchmark() {
+        const int rows = 1000, cols = 200;
+        CSpreadsheet x;
+        for (int row = 0; row < rows; row++) {
+            x.setCell(CPos(row, 0), to_string(row % 10));
+            x.setCell(CPos(row, 1), "=A" + to_string(row) + " * 2 + $A$1");
+        }
+        double fill = measure([&x]() {
+            for (int col = 2; col < cols; col++) {
+                x.copyRect(CPos(0, col), CPos(0, 1), 1, rows);
+            }
+            x.getCells();
+        });
+        CValue result;
+        double copy = measure([&x]() {
+            x.copyRect(CPos(rows, 0), CPos(0, 0), cols, rows);
+            x.copyRect(CPos(rows, 0), CPos(0, 0), cols, rows);
+            x.getCells();
+        });
+        // a pasted cell is written while the paste is pending, so the paste is not applied yet
+        double written = measure([&x]() {
+            x.copyRect(CPos(rows, 0), CPos(0, 0), cols, rows);
+            x.setCell(CPos(rows + 1, 1), "=A" + to_string(rows + 1) + " * 2 + $A$1");
+        });
+        double evaluate = measure([&x, &result]() {
+            x.setCell(CPos(0, cols + 1), "=sum(B" + to_string(rows) + ":B" + to_string(2 * rows - 1) + ")");
+            result = x.getValue(CPos(0, cols + 1));
+        });
+        report(__func__, "fill", fill);
+        report(__func__, "copy", copy);
+        report(__func__, "write", written);
+        report(__func__, "evaluate", evaluate);
+        assert(result == CValue(2.0 * 4500 + rows));
+    }
+
+    /**
+     * Sets a chain of expressions, where each cell is searched for a cycle, and repeatedly evaluates
+     * cells depending on one changed number, where each evaluated cell is visited by cycle detection.
+     */
+    static void cycleDetectionBenchmark() {
+        const int rows = 100000, changes = 4;
+        CSpreadsheet x;
+        x.setCell(CPos("A0"), "1");
+        double set = measure([&x]() {
+            for (int row = 1; row < rows; row++) {
+                x.setCell(CPos(row, 0), "=A" + to_string(row - 1) + " + $B$0");
+            }
+        });
+        for (int row = 0; row < rows; row++) {
+            x.setCell(CPos(row, 2), "=A" + to_string(row) + " * $B$0");
+        }
+        x.setCell(CPos("D0"), "=sum(C0:C" + to_string(rows - 1) + ")");
+        CValue result;
+        size_t allocated = allocations;
+        double evaluate = measure([&x, &result]() {
+            for (int change = 0; change < changes; change++) {
+                x.setCell(CPos("B0"), to_string(change % 2));
+                result = x.getValue(CPos("D0"));
+            }
+        });
+        allocated = allocations - allocated;
+        report(__func__, "set", set);
+        report(__func__, "evaluate", evaluate, allocated);
+        assert(result == CValue(double(rows) * (rows + 1) / 2));
+    }
+
+    /**
+     * Sets and evaluates a column of expressions that cannot be parsed and a column of cells,
+     * which end in conditional cycles, so they are found only by evaluation.
+     */
+    static void errorValuesBenchmark() {
+        const int rows = 100000;
+        CSpreadsheet x;
+        x.setCell(CPos("Z0"), "1");
+        double set = measure([&x]() {
+            for (int row = 0; row < rows; row++) {
+                x.setCell(CPos(row, 0), "=B" + to_string(row) + " +* 2");
+                x.setCell(CPos(row, 1), "=if($Z$0 > 0, C" + to_string(row) + ", 1)");
+                x.setCell(CPos(row, 2), "=B" + to_string(row) + " + 1");
+            }
+        });
+        size_t undefined = 0;
+        double evaluate = measure([&x, &undefined]() {
+            for (int row = 0; row < rows; row++) {
+                x.getValue(CPos(row, 0));
+                undefined += holds_alternative<monostate>(x.getValue(CPos(row, 2)));
+            }
+        });
+        report(__func__, "set", set);
+        report(__func__, "evaluate", evaluate);
+        assert(undefined == rows);
+    }
+
+    /**
+     * Saves and loads a sheet of 1M numbers, 100k strings and 100k expressions in the text format,
+     * in the binary format and from a mapped file in the binary format.
+     */
+    static void binaryFormatBenchmark() {
+        const int rows = 100000, cols = 10;
+        CSpreadsheet x;
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                x.setCell(CPos(row, col), to_string(row * 0.25 + col));
+            }
+            x.setCell(CPos(row, cols), "string " + to_string(row));
+            x.setCell(CPos(row, cols + 1), "=A" + to_string(row) + " * 2 + $B$1");
+        }
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            string variant = format == CLoader::TEXT ? "text " : "binary ";
+            ostringstream oss;
+            double save = measure([&x, &oss, format]() {
+                x.save(oss, format);
+            });
+            istringstream iss(oss.str());
+            CSpreadsheet loaded;
+            double load = measure([&loaded, &iss]() {
+                assert(loaded.load(iss));
+            });
+            report(__func__, variant + "save", save);
+            report(__func__, variant + "load", load);
+            if (format == CLoader::BINARY) {
+                auto file = filesystem::temp_directory_path() / "pa2_binary_format_benchmark.bin";
+                ofstream(file, ios::binary) << oss.str();
+                double mapped = measure([&loaded, &file]() {
+                    assert(loaded.loadFile(file));
+                });
+                report(__func__, "binary mapped", mapped);
+                filesystem::remove(file);
+            }
+            assert(loaded.getValue(CPos(rows - 1, cols + 1)) == CValue((rows - 1) * 0.5 + 1.25));
+        }
+    }
+
+    /**
+     * Loads a saved text stream of 400k strings of 200 characters (80 MB) and reports how much
+     * the peak heap memory grows, the stream itself is allocated before.
+     */
+    static void streamingLoadBenchmark() {
+        const int rows = 400000;
+        string data;
+        {
+            CSpreadsheet x;
+            for (int row = 0; row < rows; row++) {
+                x.setCell(CPos(row, 0), string(200, static_cast<char>('a' + row % 26)));
+            }
+            ostringstream oss;
+            x.save(oss);
+            data = oss.str();
+        }
+        istringstream iss(std::move(data));
+        CSpreadsheet loaded;
+        size_t before = used;
+        peak = before;
+        double load = measure([&loaded, &iss]() {
+            assert(loaded.load(iss));
+        });
+        report(__func__, "load", load);
+        reportMemory(__func__, "load", peak - before);
+        assert(loaded.getValue(CPos(rows - 1, 0)) == CValue(string(200, static_cast<char>('a' + (rows - 1) % 26))));
+    }
+
+    /**
+     * Verifies 256 MB of data by the hash of old files and by checksums of blocks
+     * computed by each implementation and by 4 threads.
+     */
+    static void checksumBenchmark() {
+        string data(256 << 20, '\0');
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<char>(i * 7919 >> 3);
+        }
+        uint64_t hash = 0;
+        double hashed = measure([&data, &hash]() {
+            hash = CHashingReader::hash(CHashingReader::INITIAL_HASH, data);
+        });
+        report(__func__, "hash", hashed);
+        auto original = CChecksum::implementation();
+        vector<uint32_t> checksums;
+        for (auto implementation: CChecksum::supported()) {
+            CChecksum::use(implementation);
+            double computed = measure([&data, &checksums]() {
+                checksums = CChecksum::computeBlocks(data);
+            });
+            report(__func__, implementation == CChecksum::SSE42 ? "crc32c sse4.2" : "crc32c scalar", computed);
+        }
+        CChecksum::use(original);
+        CThreadPool pool(4);
+        optional<size_t> damaged;
+        double parallel = measure([&data, &checksums, &pool, &damaged]() {
+            damaged = CChecksum::findDamaged(data, checksums, &pool);
+        });
+        report(__func__, "crc32c 4 threads", parallel);
+        assert(!damaged && hash != 0);
+    }
+    /**
+     * Saves and loads a sheet of 1M numbers, 100k strings and 100k expressions in both formats
+     * by one thread and by 4 threads, which save and parse partitions of rows in parallel.
+     */
+    static void parallelLoadBenchmark() {
+        const int rows = 100000, cols = 10;
+        CSpreadsheet x;
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                x.setCell(CPos(row, col), to_string(row * 0.25 + col));
+            }
+            x.setCell(CPos(row, cols), "string " + to_string(row));
+            x.setCell(CPos(row, cols + 1), "=A" + to_string(row) + " * 2 + $B$1");
+        }
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            for (unsigned threads: {1U, 4U}) {
+                string variant = (format == CLoader::TEXT ? "text " : "binary ") + to_string(threads) + "t ";
+                ostringstream oss;
+                x.setThreadCount(threads);
+                double save = measure([&x, &oss, format]() {
+                    x.save(oss, format);
+                });
+                istringstream iss(oss.str());
+                CSpreadsheet loaded;
+                loaded.setThreadCount(threads);
+                double load = measure([&loaded, &iss]() {
+                    assert(loaded.load(iss));
+                });
+                report(__func__, variant + "save", save);
+                report(__func__, variant + "load", load);
+                assert(loaded.getValue(CPos(rows - 1, cols + 1)) == CValue((rows - 1) * 0.5 + 1.25));
+            }
+        }
+    }
+};
+
+#endif //PA2_BIG_TASK_BENCHMARK_H
@@ -7,6 +7,9 @@
 
 #include <cassert>
 #include <cfloat>
+#include <filesystem>
+#include <fstream>
+#include <random>
 #include "../src/CSpreadsheet.h"
 
 /**
@@ -53,6 +56,30 @@ struct Tester {
         cycleDetectionTest();
         loaderTest();
         functionsTest();
+        speedTest();
+        dependencyGraphTest();
+        deepChainTest();
+        parallelTest();
+        storageTest();
+        numberStorageTest();
+        numberKernelsTest();
+        streamingRangeTest();
+        rangeIndexTest();
+        sharedTemplateTest();
+        expressionCacheTest();
+        bytecodeTest();
+        numericBytecodeTest();
+        optimizerTest();
+        astArenaTest();
+        cellPoolTest();
+        snapshotTest();
+        lazyPasteTest();
+        cycleMarksTest();
+        errorValuesTest();
+        binaryFormatTest();
+        streamingLoadTest();
+        checksumTest();
+        partitionTest();
     }
 
     /**
@@ -427,6 +454,1610 @@ struct Tester {
         cout << __func__ << " ->    OK" << '\n' << endl;
     }
 
+    /**
+     * Tests that computed values are reused and recomputed only when some dependency changes.
+     */
+    static void speedTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x0;
+        assert(x0.setCell(CPos("A0"), "1"));
+        for (int row = 1; row <= 60; row++) {
+            string prev = "A" + to_string(row - 1);
+            assert(x0.setCell(CPos("A" + to_string(row)), "=" + prev + "+" + prev));
+        }
+        assert(valueMatch(x0.getValue(CPos("A60")), CValue(pow(2.0, 60))));
+        assert(x0.setCell(CPos("A0"), "2"));
+        assert(valueMatch(x0.getValue(CPos("A60")), CValue(pow(2.0, 61))));
+
+        assert(x0.setCell(CPos("B0"), "=sum(C0:C10)"));
+        assert(x0.setCell(CPos("B1"), "=B0*2"));
+        assert(valueMatch(x0.getValue(CPos("B1")), CValue()));
+        assert(x0.setCell(CPos("C5"), "=A1"));
+        assert(valueMatch(x0.getValue(CPos("B1")), CValue(8.0)));
+        assert(x0.setCell(CPos("A0"), "3"));
+        assert(valueMatch(x0.getValue(CPos("B1")), CValue(12.0)));
+        x0.copyRect(CPos("C0"), CPos("A0"), 1, 2);
+        assert(valueMatch(x0.getValue(CPos("B1")), CValue(30.0)));
+        x0.copyRect(CPos("C0"), CPos("D0"), 1, 11);
+        assert(valueMatch(x0.getValue(CPos("B1")), CValue()));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests queries of the dependency graph after setting, copying and loading cells.
+     */
+    static void dependencyGraphTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        auto matches = [](const vector<CPos> &found, const vector<string> &expected) {
+            set<pair<int, int>> found_coords, expected_coords;
+            for (const auto &pos: found) {
+                found_coords.insert(pos.getCoords());
+            }
+            for (const auto &pos: expected) {
+                expected_coords.insert(CPos(pos).getCoords());
+            }
+            return found.size() == expected.size() && found_coords == expected_coords;
+        };
+
+        CSpreadsheet x0;
+        assert(x0.setCell(CPos("A1"), "10"));
+        assert(x0.setCell(CPos("A2"), "=A1*2"));
+        assert(x0.setCell(CPos("A3"), "=sum(A1:A2) + B7"));
+        assert(x0.setCell(CPos("B1"), "=A3"));
+        assert(matches(x0.dependentsOf(CPos("A1")), {"A2", "A3"}));
+        assert(matches(x0.dependentsOf(CPos("A1"), true), {"A2", "A3", "B1"}));
+        assert(matches(x0.precedentsOf(CPos("A3")), {"A1", "A2", "B7"}));
+        assert(matches(x0.precedentsOf(CPos("B1"), true), {"A1", "A2", "A3", "B7"}));
+        assert(matches(x0.dependentsOf(CPos("B7")), {"A3"}));
+
+        assert(x0.setCell(CPos("A3"), "=B7"));
+        assert(matches(x0.dependentsOf(CPos("A1")), {"A2"}));
+
+        x0.copyRect(CPos("C2"), CPos("A2"));
+        assert(matches(x0.dependentsOf(CPos("C1")), {"C2"}));
+        x0.copyRect(CPos("A2"), CPos("D2"));
+        assert(x0.dependentsOf(CPos("A1")).empty());
+
+        std::ostringstream oss;
+        assert(x0.save(oss));
+        CSpreadsheet x1;
+        std::istringstream iss(oss.str());
+        assert(x1.load(iss));
+        assert(matches(x1.dependentsOf(CPos("B7"), true), {"A3", "B1"}));
+        CSpreadsheet x2 = x1;
+        assert(matches(x2.dependentsOf(CPos("C1")), {"C2"}));
+
+        // ranges found by their rows match the ranges intersecting a rectangle, also for long and wide ranges
+        CDependencyGraph graph;
+        mt19937 generator(5);
+        vector<pair<pair<int, int>, Rect>> references;
+        for (int i = 0; i < 2000; i++) {
+            int row = static_cast<int>(generator() % 5000) - 1000, col = static_cast<int>(generator() % 100);
+            int height = i % 10 == 0 ? static_cast<int>(generator() % 4000) : static_cast<int>(generator() % 20);
+            int width = i % 25 == 0 ? 70 + static_cast<int>(generator() % 10) : static_cast<int>(generator() % 3);
+            references.push_back({{i, 1000}, {{row, col}, {row + height, col + width}}});
+            graph.setReferences(references.back().first, {references.back().second});
+        }
+        graph.setReferences({0, 1000}, {});
+        references.erase(references.begin());
+        for (int i = 0; i < 200; i++) {
+            int row = static_cast<int>(generator() % 5000) - 1000, col = static_cast<int>(generator() % 100);
+            Rect area = {{row, col}, {row + static_cast<int>(generator() % 50), col + static_cast<int>(generator() % 5)}};
+            auto found = graph.dependentsOf(area);
+            set<pair<int, int>> found_cells(found.begin(), found.end()), expected;
+            for (const auto &[cell, range]: references) {
+                if (range.first.first <= area.second.first && area.first.first <= range.second.first
+                    && range.first.second <= area.second.second && area.first.second <= range.second.second) {
+                    expected.insert(cell);
+                }
+            }
+            assert(found_cells == expected);
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests evaluation of long chains of dependent cells, which would overflow the stack
+     * in recursive evaluation, and cycles reachable from such chains.
+     */
+    static void deepChainTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        const int length = 100000;
+        CSpreadsheet x0;
+        assert(x0.setCell(CPos("A0"), "0"));
+        for (int row = 1; row <= length; row++) {
+            assert(x0.setCell(CPos("A" + to_string(row)), "=A" + to_string(row - 1) + "+1"));
+        }
+        assert(valueMatch(x0.getValue(CPos("A" + to_string(length))), CValue(double(length))));
+        assert(x0.setCell(CPos("A0"), "=B0"));
+        assert(x0.setCell(CPos("B0"), "10"));
+        assert(valueMatch(x0.getValue(CPos("A" + to_string(length))), CValue(double(length + 10))));
+
+        assert(x0.setCell(CPos("B0"), "=A" + to_string(length)));
+        assert(valueMatch(x0.getValue(CPos("A1")), CValue()));
+
+        CSpreadsheet x1;
+        assert(x1.setCell(CPos("A0"), "=A1"));
+        assert(x1.setCell(CPos("A1"), "=A0"));
+        assert(x1.setCell(CPos("B0"), "=if(C0, A0, 42)"));
+        assert(x1.setCell(CPos("B1"), "=B0+1"));
+        assert(x1.setCell(CPos("C0"), "0"));
+        assert(valueMatch(x1.getValue(CPos("B1")), CValue(43.0)));
+        assert(x1.setCell(CPos("C0"), "1"));
+        assert(valueMatch(x1.getValue(CPos("B1")), CValue()));
+        assert(valueMatch(x1.getValue(CPos("A0")), CValue()));
+
+        // a long chain hanging off a cell marked as cyclic before is marked by one search, not evaluated again
+        CSpreadsheet x2;
+        assert(x2.setCell(CPos("D1"), "=D1"));
+        assert(valueMatch(x2.getValue(CPos("D1")), CValue()));
+        for (int row = 2; row <= length; row++) {
+            assert(x2.setCell(CPos("D" + to_string(row)), "=D" + to_string(row - 1) + "+1"));
+        }
+        assert(valueMatch(x2.getValue(CPos("D" + to_string(length))), CValue()));
+        assert(valueMatch(x2.getValue(CPos("D" + to_string(length / 2))), CValue()));
+        assert(x2.setCell(CPos("D1"), "1"));
+        assert(valueMatch(x2.getValue(CPos("D" + to_string(length))), CValue(double(length))));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that parallel evaluation gives the same results as the serial one.
+     */
+    static void parallelTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        const int rows = 2000;
+        CSpreadsheet serial, parallel;
+        parallel.setThreadCount(4);
+        for (CSpreadsheet *x: {&serial, &parallel}) {
+            for (int row = 0; row < rows; row++) {
+                string r = to_string(row);
+                assert(x->setCell(CPos("A" + r), r));
+                assert(x->setCell(CPos("B" + r), "=A" + r + " * 2 + 0.1"));
+                assert(x->setCell(CPos("C" + r), "=B" + r + " / (A" + r + " + 1) + B" + r));
+                assert(x->setCell(CPos("D" + r), "=if(C" + r + " > 100, \"big\", C" + r + ")"));
+            }
+            assert(x->setCell(CPos("E0"), "=sum(C0:C" + to_string(rows - 1) + ")"));
+            assert(x->setCell(CPos("E1"), "=countval(\"big\", D0:D" + to_string(rows - 1) + ")"));
+            assert(x->setCell(CPos("E2"), "=E3"));
+            assert(x->setCell(CPos("E3"), "=E2 + E0"));
+        }
+        for (auto pos: {"E0", "E1", "E2", "E3", "D10", "C1999"}) {
+            assert(valueMatch(parallel.getValue(CPos(pos)), serial.getValue(CPos(pos))));
+        }
+        assert(valueMatch(parallel.getValue(CPos("E1")), CValue(double(rows - 49))));
+
+        assert(serial.setCell(CPos("A7"), "1000"));
+        assert(parallel.setCell(CPos("A7"), "1000"));
+        CSpreadsheet copy = parallel;
+        assert(copy.getThreadCount() == 4);
+        for (auto pos: {"E0", "E1", "D7"}) {
+            assert(valueMatch(parallel.getValue(CPos(pos)), serial.getValue(CPos(pos))));
+            assert(valueMatch(copy.getValue(CPos(pos)), serial.getValue(CPos(pos))));
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests tiled cell storage - lookups, selections and deletions crossing tile borders.
+     */
+    static void storageTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CCellStorage cells;
+        for (int row = 60; row < 70; row++) {
+            for (int col = 10; col < 40; col += 3) {
+                cells.set({row, col}, cells.getPool().create<CStringCell>(to_string(row * 100 + col)));
+            }
+        }
+        assert(cells.size() == 100);
+        assert(cells.find({63, 13}) != nullptr && cells.find({64, 13}) != nullptr);
+        assert(cells.find({64, 14}) == nullptr && cells.find({1000, 1000}) == nullptr);
+
+        vector<pair<int, int>> visited;
+        cells.forEach({{62, 15}, {65, 20}}, [&visited](const pair<int, int> &coords, const CCell &) {
+            visited.push_back(coords);
+        });
+        vector<pair<int, int>> expected = {{62, 16}, {62, 19}, {63, 16}, {63, 19},
+                                           {64, 16}, {64, 19}, {65, 16}, {65, 19}};
+        assert(visited == expected);
+
+        cells.erase({{60, 0}, {69, 15}});
+        assert(cells.size() == 80);
+        assert(cells.find({61, 13}) == nullptr && cells.find({61, 16}) != nullptr);
+        CCellStorage copy = cells;
+        cells.clear();
+        assert(cells.empty() && copy.size() == 80);
+
+        CSpreadsheet x0;
+        for (int row = 0; row < 200; row++) {
+            assert(x0.setCell(CPos("O" + to_string(row)), to_string(row)));
+            assert(x0.setCell(CPos("P" + to_string(row)), "=O" + to_string(row) + " * 2"));
+        }
+        assert(x0.setCell(CPos("A1"), "=sum(O0:P199)"));
+        assert(valueMatch(x0.getValue(CPos("A1")), CValue(3.0 * 199 * 200 / 2)));
+        x0.copyRect(CPos("Q60"), CPos("O60"), 2, 10);
+        assert(valueMatch(x0.getValue(CPos("R65")), CValue(130.0)));
+        x0.copyRect(CPos("O0"), CPos("AZ1000"), 2, 200);
+        assert(valueMatch(x0.getValue(CPos("A1")), CValue()));
+        assert(valueMatch(x0.getValue(CPos("Q65")), CValue(65.0)));
+
+        // ranges starting right of a filled tile in the same tile row must not reach into it
+        CCellStorage left;
+        left.set({100, 15}, left.getPool().create<CStringCell>("left"));
+        left.setNumber({101, 15}, 1);
+        size_t reached = 0;
+        left.forEach({{1, 16}, {200, 20}}, [&reached](const pair<int, int> &, const CCell &) { reached++; });
+        left.forEachNumbers({{1, 16}, {200, 20}}, [&reached](const double *, uint64_t) { reached++; });
+        left.erase({{1, 16}, {200, 20}});
+        assert(reached == 0 && left.size() == 2);
+
+        CSpreadsheet x1;
+        assert(x1.setCell(CPos("P100"), "5"));
+        assert(x1.setCell(CPos("P101"), "7"));
+        assert(x1.setCell(CPos("A1"), "=sum(Q1:U200)"));
+        assert(x1.setCell(CPos("A2"), "=count(Q1:U200)"));
+        assert(x1.setCell(CPos("A3"), "=max(Q1:U200)"));
+        assert(x1.setCell(CPos("A4"), "=countval(5, Q1:U200)"));
+        assert(valueMatch(x1.getValue(CPos("A1")), CValue()));
+        assert(valueMatch(x1.getValue(CPos("A2")), CValue(0.0)));
+        assert(valueMatch(x1.getValue(CPos("A3")), CValue()));
+        assert(valueMatch(x1.getValue(CPos("A4")), CValue(0.0)));
+        x1.copyRect(CPos("AA1"), CPos("Q1"), 5, 200);
+        assert(valueMatch(x1.getValue(CPos("P100")), CValue(5.0)));
+        assert(valueMatch(x1.getValue(CPos("P101")), CValue(7.0)));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests packed number cells - rewriting them with other cells, aggregation, copying, saving and loading.
+     */
+    static void numberStorageTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CCellStorage cells;
+        cells.setNumber({70, 3}, 1.5);
+        cells.set({71, 3}, cells.getPool().create<CNumberCell>(2.5));
+        cells.set({72, 3}, cells.getPool().create<CStringCell>("x"));
+        assert(cells.size() == 3 && cells.find({71, 3}) == nullptr);
+        assert(cells.findNumber({71, 3}) != nullptr && *cells.findNumber({71, 3}) == 2.5);
+        cells.set({71, 3}, cells.getPool().create<CStringCell>("y"));
+        cells.setNumber({72, 3}, 4);
+        assert(cells.size() == 3 && cells.findNumber({71, 3}) == nullptr && cells.find({72, 3}) == nullptr);
+        double sum = 0;
+        size_t segments = 0;
+        cells.forEachNumbers({{0, 0}, {100, 100}}, [&sum, &segments](const double *numbers, uint64_t mask) {
+            segments++;
+            for (; mask != 0; mask &= mask - 1) {
+                sum += numbers[countr_zero(mask)];
+            }
+        });
+        assert(segments == 1 && sum == 5.5);
+        cells.erase({{70, 3}, {70, 3}});
+        assert(cells.size() == 2 && cells.findNumber({70, 3}) == nullptr);
+
+        CSpreadsheet x0;
+        for (int row = 0; row < 150; row++) {
+            assert(x0.setCell(CPos("C" + to_string(row)), to_string(row - 75)));
+        }
+        assert(x0.setCell(CPos("C10"), "text"));
+        assert(x0.setCell(CPos("C11"), "=C12 * 100"));
+        assert(x0.setCell(CPos("A1"), "=sum(B0:D149)"));
+        assert(x0.setCell(CPos("A2"), "=min(C0:C149)"));
+        assert(x0.setCell(CPos("A3"), "=max(C0:C149)"));
+        assert(x0.setCell(CPos("A4"), "=count(C0:C149)"));
+        assert(x0.setCell(CPos("A5"), "=countval(5, C0:C149)"));
+        assert(valueMatch(x0.getValue(CPos("A1")), CValue(-75.0 + 65 + 64 - 6300)));
+        assert(valueMatch(x0.getValue(CPos("A2")), CValue(-6300.0)));
+        assert(valueMatch(x0.getValue(CPos("A3")), CValue(74.0)));
+        assert(valueMatch(x0.getValue(CPos("A4")), CValue(150.0)));
+        assert(valueMatch(x0.getValue(CPos("A5")), CValue(1.0)));
+        assert(valueMatch(x0.getValue(CPos("C100")), CValue(25.0)));
+
+        x0.copyRect(CPos("C5"), CPos("C0"), 1, 10);
+        assert(valueMatch(x0.getValue(CPos("C14")), CValue(-66.0)));
+        assert(valueMatch(x0.getValue(CPos("C11")), CValue(-69.0)));
+        assert(valueMatch(x0.getValue(CPos("A3")), CValue(74.0)));
+
+        std::ostringstream oss;
+        assert(x0.save(oss));
+        CSpreadsheet x1;
+        std::istringstream iss(oss.str());
+        assert(x1.load(iss));
+        CSpreadsheet x2 = x1;
+        for (auto pos: {"A1", "A2", "A4", "C10", "C11", "C149"}) {
+            assert(valueMatch(x2.getValue(CPos(pos)), x0.getValue(CPos(pos))));
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that all supported aggregation kernels give the same results as the scalar ones.
+     */
+    static void numberKernelsTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        mt19937_64 generator(42);
+        uniform_real_distribution<double> distribution(-100, 100);
+        double numbers[64];
+        for (double &number: numbers) {
+            number = round(distribution(generator));
+        }
+        vector<uint64_t> masks = {0, 1, 3, 0x8000000000000000, ~uint64_t(0), 0x00ff00ff00ff00ff};
+        for (int i = 0; i < 50; i++) {
+            masks.push_back(generator());
+        }
+
+        auto best = CNumberKernels::implementation();
+        for (auto implementation: CNumberKernels::supported()) {
+            for (uint64_t mask: masks) {
+                assert(CNumberKernels::use(CNumberKernels::SCALAR));
+                double sum = CNumberKernels::sum(numbers, mask);
+                double min = CNumberKernels::min(numbers, mask, 50);
+                double max = CNumberKernels::max(numbers, mask, -50);
+                size_t equal = CNumberKernels::countEqual(numbers, mask, numbers[63]);
+                assert(CNumberKernels::use(implementation));
+                assert(valueMatch(CNumberKernels::sum(numbers, mask), sum));
+                assert(CNumberKernels::min(numbers, mask, 50) == min);
+                assert(CNumberKernels::max(numbers, mask, -50) == max);
+                assert(CNumberKernels::countEqual(numbers, mask, numbers[63]) == equal);
+            }
+            // a single number must not be read as a whole group
+            double single = 7;
+            assert(CNumberKernels::sum(&single, 1) == 7 && CNumberKernels::min(&single, 1, 10) == 7);
+            assert(CNumberKernels::max(&single, 1, 10) == 10 && CNumberKernels::countEqual(&single, 1, 7) == 1);
+
+            // NaN numbers are skipped and NaN given as the value means there is no number yet,
+            // so the result is NaN only for segments without other numbers
+            double nan = numeric_limits<double>::quiet_NaN();
+            double with_nan[8] = {nan, 3, -2, nan, 5, nan, nan, 1};
+            assert(CNumberKernels::min(with_nan, 0xff, nan) == -2 && CNumberKernels::max(with_nan, 0xff, nan) == 5);
+            assert(CNumberKernels::min(with_nan, 0x11, nan) == 5 && CNumberKernels::max(with_nan, 0x11, nan) == 5);
+            assert(CNumberKernels::min(with_nan, 0xff, -10) == -10 && CNumberKernels::max(with_nan, 0x01, 7) == 7);
+            assert(isnan(CNumberKernels::min(with_nan, 0x69, nan)) && isnan(CNumberKernels::max(with_nan, 0x69, nan)));
+            assert(isnan(CNumberKernels::min(with_nan, 0, nan)) && CNumberKernels::max(with_nan, 0, 4) == 4);
+
+            CSpreadsheet x0;
+            assert(x0.setCell(CPos("A1"), "nan") && x0.setCell(CPos("A2"), "nan"));
+            assert(x0.setCell(CPos("B1"), "nan") && x0.setCell(CPos("B2"), "-4") && x0.setCell(CPos("B3"), "=B1"));
+            assert(x0.setCell(CPos("C1"), "=min(A1:A2)") && x0.setCell(CPos("C2"), "=max(A1:A2)"));
+            assert(x0.setCell(CPos("C3"), "=min(B1:B3)") && x0.setCell(CPos("C4"), "=max(B1:B3)"));
+            assert(x0.setCell(CPos("C5"), "=min(D1:D9)") && x0.setCell(CPos("C6"), "=max(D1:D9)"));
+            assert(valueMatch(x0.getValue(CPos("C1")), CValue(nan)));
+            assert(valueMatch(x0.getValue(CPos("C2")), CValue(nan)));
+            assert(valueMatch(x0.getValue(CPos("C3")), CValue(-4.0)));
+            assert(valueMatch(x0.getValue(CPos("C4")), CValue(-4.0)));
+            assert(valueMatch(x0.getValue(CPos("C5")), CValue()));
+            assert(valueMatch(x0.getValue(CPos("C6")), CValue()));
+        }
+        assert(CNumberKernels::use(best));
+        assert(CNumberKernels::count(0x00ff00ff00ff00ff) == 32);
+
+        // aggregates compute only the requested parts, the count is always computed
+        CNumberAggregate all, sum_only(CNumberAggregate::SUM), count_only(0);
+        for (auto *aggregate: {&all, &sum_only, &count_only}) {
+            aggregate->add(numbers, masks.back());
+        }
+        assert(sum_only.sum == all.sum && sum_only.count == all.count && count_only.count == all.count);
+        assert(isnan(sum_only.min) && count_only.sum == 0 && isnan(count_only.max));
+
+        CSpreadsheet x0;
+        for (int row = 0; row < 300; row++) {
+            assert(x0.setCell(CPos("B" + to_string(row)), to_string(row % 7)));
+        }
+        assert(x0.setCell(CPos("B100"), "=B101 + 0.5"));
+        assert(x0.setCell(CPos("A1"), "=sum(B0:B299)"));
+        assert(x0.setCell(CPos("A2"), "=countval(3, B0:B299)"));
+        assert(x0.setCell(CPos("A3"), "=countval(B150, B0:B300)"));
+        assert(x0.setCell(CPos("A4"), "=count(B1:B299)"));
+        assert(valueMatch(x0.getValue(CPos("A1")), CValue(897.0 - 2 + 3.5)));
+        assert(valueMatch(x0.getValue(CPos("A2")), CValue(43.0)));
+        assert(valueMatch(x0.getValue(CPos("A3")), CValue(43.0)));
+        assert(valueMatch(x0.getValue(CPos("A4")), CValue(299.0)));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests streaming evaluation of ranges - cells are passed to consumers in place, selection is lazy.
+     */
+    static void streamingRangeTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x0;
+        assert(x0.setCell(CPos("A1"), "1"));
+        assert(x0.setCell(CPos("B1"), "text"));
+        assert(x0.setCell(CPos("A2"), "=A1 + 1"));
+        assert(x0.setCell(CPos("B2"), "=B1 + \"!\""));
+        assert(x0.setCell(CPos("A3"), "=Z100"));
+
+        CRange range(x0);
+        range.select(CPos("A1"), CPos("B3"));
+        CCycleDetectionVisitor visitor;
+        vector<CValue> values;
+        size_t numbers_count = 0;
+        range.evaluate(visitor, [&values](const CValue &value) {
+            values.push_back(value);
+        }, [&numbers_count](const double *, uint64_t mask) {
+            numbers_count += CNumberKernels::count(mask);
+        });
+        assert(numbers_count == 1 && values.size() == 4);
+        assert(valueMatch(values[0], CValue("text")) && valueMatch(values[1], CValue(2.0)));
+        assert(valueMatch(values[2], CValue("text!")) && valueMatch(values[3], CValue()));
+
+        // selection is read when pasted, so changes made after select() are pasted too
+        assert(x0.setCell(CPos("A1"), "10"));
+        range.paste(CPos("A2"));
+        assert(valueMatch(x0.getValue(CPos("A2")), CValue(10.0)));
+        assert(valueMatch(x0.getValue(CPos("A3")), CValue(11.0)));
+        assert(valueMatch(x0.getValue(CPos("B3")), CValue("text!")));
+        assert(valueMatch(x0.getValue(CPos("B4")), CValue()));
+
+        const int rows = 100000;
+        CSpreadsheet x1;
+        for (int row = 0; row < rows; row++) {
+            assert(x1.setCell(CPos("A" + to_string(row)), row % 2 ? "1" : "x"));
+        }
+        assert(x1.setCell(CPos("B1"), "=sum(A0:A" + to_string(rows - 1) + ")"));
+        assert(x1.setCell(CPos("B2"), "=count(A0:A" + to_string(rows - 1) + ")"));
+        assert(x1.setCell(CPos("B3"), "=countval(\"x\", A0:A" + to_string(rows - 1) + ")"));
+        assert(valueMatch(x1.getValue(CPos("B1")), CValue(double(rows / 2))));
+        assert(valueMatch(x1.getValue(CPos("B2")), CValue(double(rows))));
+        assert(valueMatch(x1.getValue(CPos("B3")), CValue(double(rows / 2))));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests indexes of number columns - aggregates of ranges with partial blocks and incremental updates.
+     */
+    static void rangeIndexTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CCellStorage cells;
+        cells.setRangeIndex(true);
+        for (int row = 0; row < 1000; row++) {
+            cells.setNumber({row, 5}, row);
+        }
+        CNumberAggregate aggregate;
+        assert(!cells.aggregate({{0, 5}, {999, 5}}, aggregate));
+        cells.refreshIndexes();
+        assert(cells.aggregate({{0, 5}, {999, 5}}, aggregate));
+        assert(aggregate.count == 1000 && aggregate.sum == 999 * 1000 / 2);
+        assert(aggregate.min == 0 && aggregate.max == 999);
+        for (auto [from, to]: vector<pair<int, int>>{{10, 20}, {63, 64}, {64, 127}, {1, 998}, {500, 5000}}) {
+            CNumberAggregate part;
+            assert(cells.aggregate({{from, 0}, {to, 10}}, part));
+            int last = min(to, 999);
+            assert(part.count == size_t(last - from + 1) && part.sum == (from + last) * (last - from + 1) / 2.0);
+            assert(part.min == from && part.max == last);
+        }
+        cells.setNumber({100, 5}, 0);
+        cells.set({101, 5}, cells.getPool().create<CStringCell>("x"));
+        cells.erase({{200, 5}, {263, 5}});
+        CNumberAggregate updated;
+        assert(cells.aggregate({{0, 5}, {999, 5}}, updated));
+        double removed = 100 + 101 + (200 + 263) * 64 / 2.0;
+        assert(updated.count == 1000 - 1 - 64 && updated.sum == 999 * 1000 / 2 - removed);
+        cells.setNumber({999, 5}, -1);
+        CNumberAggregate changed_max;
+        assert(cells.aggregate({{0, 5}, {999, 5}}, changed_max) && changed_max.min == -1 && changed_max.max == 998);
+        cells.setNumber({5000, 5}, 1);
+        assert(!cells.aggregate({{0, 5}, {999, 5}}, updated));
+
+        CSpreadsheet indexed, plain;
+        indexed.setRangeIndex(true);
+        mt19937 generator(7);
+        for (CSpreadsheet *x: {&indexed, &plain}) {
+            for (int row = 0; row < 3000; row++) {
+                assert(x->setCell(CPos("C" + to_string(row)), to_string(row % 13)));
+                assert(x->setCell(CPos("D" + to_string(row)), to_string(row % 5)));
+            }
+            assert(x->setCell(CPos("C70"), "=D70 * 10"));
+            assert(x->setCell(CPos("A1"), "=sum(C3:D2990)"));
+            assert(x->setCell(CPos("A2"), "=count(C3:D2990)"));
+            assert(x->setCell(CPos("A3"), "=sum(C65:C127)"));
+            assert(x->setCell(CPos("A4"), "=min(C3:D2990)"));
+            assert(x->setCell(CPos("A5"), "=max(C100:C2000)"));
+        }
+        for (int step = 0; step < 20; step++) {
+            string pos = "C" + to_string(generator() % 3000);
+            string value = to_string(generator() % 100);
+            if (step % 5 == 0) {
+                indexed.copyRect(CPos(pos), CPos("D100"), 2, 300);
+                plain.copyRect(CPos(pos), CPos("D100"), 2, 300);
+            } else {
+                assert(indexed.setCell(CPos(pos), value) && plain.setCell(CPos(pos), value));
+            }
+            for (auto result: {"A1", "A2", "A3", "A4", "A5"}) {
+                assert(valueMatch(indexed.getValue(CPos(result)), plain.getValue(CPos(result))));
+            }
+        }
+        CNumberAggregate check;
+        assert(indexed.getCells().aggregate({{0, 0}, {3000, 10}}, check));
+        std::ostringstream oss;
+        assert(indexed.save(oss));
+        std::istringstream iss(oss.str());
+        CSpreadsheet loaded;
+        loaded.setRangeIndex(true);
+        assert(loaded.load(iss));
+        CSpreadsheet copy = loaded;
+        for (auto result: {"A1", "A2", "A3", "A4", "A5"}) {
+            assert(valueMatch(copy.getValue(CPos(result)), plain.getValue(CPos(result))));
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that copies of an expression cell share one parsed expression and are evaluated
+     * relative to their positions, with absolute and relative references in ranges too.
+     */
+    static void sharedTemplateTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        const int rows = 1000;
+        CSpreadsheet x;
+        for (int row = 0; row < rows; row++) {
+            assert(x.setCell(CPos("A" + to_string(row)), to_string(row)));
+        }
+        assert(x.setCell(CPos("B0"), "=A0 * 2 + $A$1 + sum($A$0:A0) + countval(Z1, $D$0:D0)"));
+        // the filled area doubles with each copy
+        for (int filled = 1; filled < rows; filled *= 2) {
+            x.copyRect(CPos("B" + to_string(filled)), CPos("B0"), 1, min(filled, rows - filled));
+        }
+        auto templateOf = [](CSpreadsheet &sheet, int row) {
+            auto *cell = dynamic_cast<const CExprCell *>(sheet.getCells().find({row, 1}));
+            assert(cell != nullptr);
+            return cell->getTemplate();
+        };
+        auto expected = [](double row, double a5) {
+            double sum = row * (row + 1) / 2 + (row >= 5 ? a5 - 5 : 0);
+            return (row == 5 ? a5 : row) * 2 + 1 + sum + row + 1;
+        };
+        for (int row = 0; row < rows; row += 37) {
+            assert(valueMatch(x.getValue(CPos("B" + to_string(row))), CValue(expected(row, 5))));
+        }
+        const CExpressionTemplate *shared = templateOf(x, 0);
+        assert(shared != nullptr);
+        for (int row = 0; row < rows; row++) {
+            assert(templateOf(x, row) == shared);
+        }
+
+        assert(x.setCell(CPos("A5"), "100"));
+        assert(valueMatch(x.getValue(CPos("B5")), CValue(expected(5, 100))));
+        assert(valueMatch(x.getValue(CPos("B999")), CValue(expected(999, 100))));
+        assert(x.setCell(CPos("A2000"), "1") && x.setCell(CPos("A2001"), "1"));
+        x.copyRect(CPos("B2000"), CPos("B10"), 1, 2);
+        assert(valueMatch(x.getValue(CPos("B2000")), CValue(2 + 1 + 999 * 1000 / 2.0 + 95 + 1 + 2001)));
+        assert(valueMatch(x.getValue(CPos("B2001")), CValue(2 + 1 + 999 * 1000 / 2.0 + 95 + 2 + 2002)));
+        assert(templateOf(x, 2001) == shared);
+
+        CSpreadsheet copy = x;
+        assert(copy.setCell(CPos("A1"), "1001"));
+        assert(valueMatch(copy.getValue(CPos("B3")), CValue(6.0 + 1001 + 6 + 1000 + 4)));
+        assert(valueMatch(x.getValue(CPos("B3")), CValue(expected(3, 100))));
+        assert(templateOf(copy, 3) != shared && templateOf(copy, 3) != nullptr);
+        CSpreadsheet assigned;
+        assigned = copy;
+        assert(valueMatch(assigned.getValue(CPos("B3")), copy.getValue(CPos("B3"))));
+        assert(valueMatch(assigned.getValue(CPos("B500")), copy.getValue(CPos("B500"))));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests the cache of parsed expressions - normalization of expressions, sharing of parsed expressions
+     * between cells set or loaded separately, and counters of hits and misses.
+     */
+    static void expressionCacheTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        assert(CExpressionCache::normalize("= A1 +  \"a  \"\"b \" ") == "=A1+ \"a  \"\"b \"");
+        assert(CExpressionCache::normalize("=A1 < = 5") == "=A1< =5" && CExpressionCache::normalize("= -1") == "= -1");
+        assert(CExpressionCache::normalize("=\"a\" \"b\"") == "=\"a\" \"b\"");
+        assert(CExpressionCache::normalize("=sum( A1 : $B$2 ) * 2") == "=sum(A1:$B$2)*2");
+        assert(CExpressionCache::normalize("=1 2") == "=1 2");
+        assert(CExpressionCache::normalize("=1e -5 + 1E- 5") == "=1e -5+1E- 5");
+
+        CSpreadsheet x;
+        auto templateOf = [](CSpreadsheet &sheet, int row, int col) {
+            auto *cell = dynamic_cast<const CExprCell *>(sheet.getCells().find({row, col}));
+            assert(cell != nullptr);
+            return cell->getTemplate();
+        };
+        for (int row = 0; row < 100; row++) {
+            assert(x.setCell(CPos("B" + to_string(row)), to_string(row)));
+            assert(x.setCell(CPos("A" + to_string(row)), row % 2 ? "=$B$1 * 2 + 1" : "= $B$1*2 +1"));
+        }
+        const auto &cache = x.getExpressionCache();
+        assert(cache.getMisses() == 1 && cache.getHits() == 99 && cache.size() == 1);
+        for (int row = 0; row < 100; row++) {
+            assert(templateOf(x, row, 0) == templateOf(x, 0, 0));
+            assert(valueMatch(x.getValue(CPos("A" + to_string(row))), CValue(3.0)));
+        }
+        assert(x.setCell(CPos("C1"), "=1 +") && x.setCell(CPos("C2"), "=1 +"));
+        assert(valueMatch(x.getValue(CPos("C1")), CValue("=1 +")));
+        // expressions that are not valid are parsed only once
+        assert(cache.getMisses() == 2 && cache.size() == 1 && cache.getInvalid() == 1);
+
+        // whitespace that changes meaning of an expression is kept in the key, so variants do not share results
+        for (bool invalid_first: {true, false}) {
+            CSpreadsheet variants;
+            assert(variants.setCell(CPos("A1"), "1"));
+            vector<pair<string, CValue>> cells = {{"=A1 < = 5", CValue("=A1 < = 5")}, {"=A1<=5", CValue(1.0)},
+                                                  {"=\"a\" \"b\"", CValue("=\"a\" \"b\"")}, {"=\"a\"\"b\"", CValue("a\"b")}};
+            for (size_t i = 0; i < cells.size(); i++) {
+                size_t cell = invalid_first ? i : i ^ 1;
+                assert(variants.setCell(CPos("B" + to_string(cell)), cells[cell].first));
+            }
+            for (size_t cell = 0; cell < cells.size(); cell++) {
+                assert(valueMatch(variants.getValue(CPos("B" + to_string(cell))), cells[cell].second));
+            }
+        }
+
+        std::ostringstream oss;
+        assert(x.save(oss));
+        std::istringstream iss(oss.str());
+        CSpreadsheet loaded;
+        assert(loaded.load(iss));
+        assert(loaded.getExpressionCache().getHits() == 100);
+        assert(templateOf(loaded, 99, 0) == templateOf(loaded, 0, 0) && templateOf(loaded, 0, 0) != templateOf(x, 0, 0));
+        assert(valueMatch(loaded.getValue(CPos("A50")), CValue(3.0)));
+
+        for (int i = 0; i < 5000; i++) {
+            assert(x.setCell(CPos("D1"), "=B1 + " + to_string(i)));
+        }
+        assert(valueMatch(x.getValue(CPos("D1")), CValue(5000.0)));
+        assert(cache.getMisses() == 5002 && cache.size() < 2100);
+        // remembered invalid expressions are bounded too
+        for (int i = 0; i < 10000; i++) {
+            assert(x.setCell(CPos("D2"), "=B1 + " + to_string(i) + " +"));
+            assert(cache.getInvalid() <= 4096);
+        }
+        assert(valueMatch(x.getValue(CPos("D2")), CValue("=B1 + 9999 +")));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that compiled programs evaluate expressions to the same values as AST trees,
+     * including shifted copies, short-circuit of if function and functions over single values.
+     */
+    static void bytecodeTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "10") && x.setCell(CPos("A2"), "abc") && x.setCell(CPos("A3"), "-2.5"));
+        assert(x.setCell(CPos("A4"), "=A1 / 4") && x.setCell(CPos("B1"), "0") && x.setCell(CPos("B2"), "=B1 = 0"));
+        assert(x.setCell(CPos("B3"), "=A2 + \"d\"") && x.setCell(CPos("B4"), "7"));
+        vector<string> expressions = {
+                "=A1 + A3 * 2 - A4 / 2 ^ 2", "=-A1 + -A2", "=A1 + A2", "=A2 + A1 + A2", "=A1 / B1",
+                "=A1 = 10", "=A2 <> \"abc\"", "=A1 < A3", "=A2 <= B3", "=A3 > A4", "=A3 >= -2.5", "=A1 = A2",
+                "=sum(A1:B4)", "=count(A1:B4)", "=min(A1:B4)", "=max(A1:B4)", "=countval(10, A1:B4)",
+                "=countval(A9, A1:B5)", "=countval(\"abc\", A1:B4)", "=sum(A2:A2)", "=count(C1:C9)",
+                "=sum($A$1:A2) + max(A$1:$B4)",
+                "=if(B1, A1, A3)", "=if(A1, A2, A3)", "=if(A2, 1, 2)", "=if(A9, 1, 2)",
+                "=if(B2, if(A1 < 0, 1, 2 + if(A3, 3, 4)), 5) * 2", "=if(1, A1, A9 + 1) + if(0, A9, A3)",
+        };
+        int row = 20;
+        for (const auto &expression: expressions) {
+            assert(x.setCell(CPos("C" + to_string(row)), expression));
+            // a copy evaluates the same program with shifted references
+            x.copyRect(CPos("E" + to_string(row + 1)), CPos("C" + to_string(row)));
+            row += 2;
+        }
+        for (int evaluated = 20; evaluated < row; evaluated += 2) {
+            for (const auto &pos: {"C" + to_string(evaluated), "E" + to_string(evaluated + 1)}) {
+                auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos(pos).getCoords()));
+                assert(cell != nullptr && cell->getTemplate() != nullptr);
+                CValue value = x.getValue(CPos(pos));
+                CCycleDetectionVisitor visitor;
+                visitor.visit(cell, cell->getShift());
+                CValue expected = cell->getTemplate()->getRoot().evaluate(visitor);
+                visitor.leave(cell);
+                assert(valueMatch(value, expected));
+            }
+        }
+        assert(valueMatch(x.getValue(CPos("C20")), CValue(10 - 5 - 0.625)));
+        assert(valueMatch(x.getValue(CPos("C26")), CValue("abc10.000000abc")));
+        assert(valueMatch(x.getValue(CPos("C54")), CValue(2.0)));
+
+        assert(x.setCell(CPos("D1"), "=if(A1, 1, \"x\")"));
+        x.getValue(CPos("D1"));
+        auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos("D1").getCoords()));
+        const auto &code = cell->getTemplate()->getProgram().getInstructions();
+        vector<CBytecode::OpCode> ops;
+        for (auto instruction: code) {
+            ops.push_back(instruction.op);
+        }
+        assert((ops == vector<CBytecode::OpCode>{CBytecode::REFERENCE, CBytecode::TEST, CBytecode::BRANCH,
+                                                 CBytecode::CONSTANT, CBytecode::JUMP, CBytecode::CONSTANT}));
+        assert(code[1].arg == 6 && code[2].arg == 5 && code[4].arg == 6);
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that numeric programs are evaluated by the double-only path to the same values as by the generic path,
+     * also when a referenced cell or a function gives a string or undefined value during evaluation.
+     */
+    static void numericBytecodeTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "10") && x.setCell(CPos("A2"), "4") && x.setCell(CPos("A3"), "-2.5"));
+        assert(x.setCell(CPos("A4"), "=A1 / 4") && x.setCell(CPos("B1"), "0") && x.setCell(CPos("B2"), "=A1 + A2"));
+        vector<pair<string, bool>> expressions = {
+                {"=A1 + A3 * 2 - A4 / 2 ^ 2",                                true},
+                {"=-A1 + -A2 * (A1 <> A2) - (A3 >= A4)",                     true},
+                {"=A1 / B1 + 1",                                             true},
+                {"=sum(A1:B4) + count(A1:B4) * min(A1:A4) - max(A1:A4)",     true},
+                {"=countval(10, A1:B4) + sum(C1:C4) + 1",                    true},
+                {"=if(B1, A1, A3) + if(A2 - 4, 1, 2) * if(B2 > 3, A4, -A4)", true},
+                {"=sum(A1:A9) + 2 * A9",                                     true},
+                {"=A1 + \"x\"",                                             false},
+                {"=if(A1, 1, \"x\") + A2",                                  false},
+        };
+        int row = 20;
+        for (const auto &[expression, numeric]: expressions) {
+            assert(x.setCell(CPos("D" + to_string(row)), expression));
+            x.copyRect(CPos("F" + to_string(row + 1)), CPos("D" + to_string(row)));
+            row += 2;
+        }
+        auto check = [&x, &expressions, row]() {
+            for (int evaluated = 20; evaluated < row; evaluated += 2) {
+                for (const auto &pos: {"D" + to_string(evaluated), "F" + to_string(evaluated + 1)}) {
+                    auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos(pos).getCoords()));
+                    assert(cell != nullptr && cell->getTemplate() != nullptr);
+                    const CBytecode &program = cell->getTemplate()->getProgram();
+                    assert(program.isNumeric() == expressions[(evaluated - 20) / 2].second);
+                    CValue value = x.getValue(CPos(pos));
+                    CCycleDetectionVisitor visitor;
+                    visitor.visit(cell, cell->getShift());
+                    CValue expected = program.evaluateGeneric(visitor);
+                    CValue tree = cell->getTemplate()->getRoot().evaluate(visitor);
+                    visitor.leave(cell);
+                    assert(valueMatch(value, expected) && valueMatch(value, tree));
+                }
+            }
+        };
+        check();
+        assert(valueMatch(x.getValue(CPos("D20")), CValue(10 - 5 - 0.625)));
+        assert(valueMatch(x.getValue(CPos("D24")), CValue()));
+        assert(valueMatch(x.getValue(CPos("D32")), CValue()));
+
+        // strings and undefined values in referenced cells are evaluated by the generic path
+        assert(x.setCell(CPos("A2"), "abc") && x.setCell(CPos("B1"), "1") && x.setCell(CPos("A3"), ""));
+        check();
+        assert(valueMatch(x.getValue(CPos("B2")), CValue("10.000000abc")));
+        assert(valueMatch(x.getValue(CPos("D20")), CValue()));
+        assert(valueMatch(x.getValue(CPos("D24")), CValue(11.0)));
+        assert(valueMatch(x.getValue(CPos("D30")), CValue()));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests folding of constant subtrees, selection of if branches with a constant condition
+     * and sharing of repeated subexpressions, which are evaluated only once.
+     */
+    static void optimizerTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        assert(CPos("ab12").toString() == "AB12" && CPos("$Z$3").toString() == "$Z$3");
+        assert(CPos("A$1").toString() == "A$1" && CPos("$ZZ1").toString() == "$ZZ1");
+        assert(CPos("A1") == CPos("a1") && !(CPos("A1") == CPos("$A1")));
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "3") && x.setCell(CPos("A2"), "4") && x.setCell(CPos("A3"), "5"));
+        auto parsed = [&x](const string &pos, const string &expression) -> const CExpressionTemplate & {
+            assert(x.setCell(CPos(pos), expression));
+            x.getValue(CPos(pos));
+            auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos(pos).getCoords()));
+            assert(cell != nullptr && cell->getTemplate() != nullptr);
+            return *cell->getTemplate();
+        };
+        auto count = [](const CExpressionTemplate &expression, CBytecode::OpCode op) {
+            const auto &code = expression.getProgram().getInstructions();
+            return count_if(code.begin(), code.end(), [op](auto instruction) { return instruction.op == op; });
+        };
+
+        const auto &folded = parsed("B1", "=1 + 2 * 3 - -1");
+        assert(folded.dump() == "tree: 8\nfolded: 4\n");
+        assert(folded.getProgram().getInstructions().size() == 1);
+        assert(valueMatch(x.getValue(CPos("B1")), CValue(8.0)));
+
+        const auto &strings = parsed("B2", "=\"a\"\"b\" + 1 = \"x\"");
+        assert(strings.dump() == "tree: 0\nfolded: 2\n");
+        assert(parsed("B2", "=(\"a\"\"b\" + 1) + A1").dump() == "tree: (\"a\"\"b1.000000\" + A1)\nfolded: 1\n");
+        assert(valueMatch(x.getValue(CPos("B2")), CValue("a\"b1.0000003.000000")));
+
+        // undefined values have no literal, so they are not folded
+        assert(parsed("B3", "=1 / 0 + A1").dump() == "tree: ((1 / 0) + A1)\nfolded: 0\n");
+        assert(parsed("B3", "=if(1 - 1, A1, A2 * 2) + if(\"x\", A1, 1)").dump()
+               == "tree: ((A2 * 2) + if(\"x\", A1, 1))\nfolded: 2\n");
+        assert(valueMatch(x.getValue(CPos("B3")), CValue()));
+
+        const auto &shared = parsed("B4", "=(A1 + 2 * 3) * (A1 + 6) + sum(A1:A3) / sum(A1:A3) - sum($A1:A3)");
+        assert(shared.dump() == "tree: ((((A1 + 6) * (A1 + 6)) + (sum(A1:A3) / sum(A1:A3))) - sum($A1:A3))\n"
+                                "folded: 1\nshared: (A1 + 6)\nshared: A1\nshared: sum(A1:A3)\n");
+        // each occurrence keeps its instructions, which are skipped if the shared value is already computed
+        assert(count(shared, CBytecode::LOAD) == 6 && count(shared, CBytecode::STORE) == 6);
+        assert(valueMatch(x.getValue(CPos("B4")), CValue(81.0 + 1 - 12)));
+        // repeated references are dependencies only once
+        assert(shared.getReferences({0, 0}).size() == 3);
+
+        // the first occurrence of a shared expression may be in a branch which is not evaluated
+        assert(x.setCell(CPos("B5"), "=if(A1 > 100, A2 * A3, 1) + A2 * A3 + if(A1, -(A2 * A3), 0)"));
+        assert(valueMatch(x.getValue(CPos("B5")), CValue(1.0)));
+        assert(x.setCell(CPos("A1"), "101"));
+        assert(valueMatch(x.getValue(CPos("B5")), CValue(20.0)));
+
+        // shared slots are converted when the double-only path gives up
+        assert(x.setCell(CPos("B6"), "=(A1 + A2) * (A1 + A2) + A3 + (A1 + A2)"));
+        assert(valueMatch(x.getValue(CPos("B6")), CValue(105.0 * 105 + 5 + 105)));
+        assert(x.setCell(CPos("A3"), "x"));
+        assert(valueMatch(x.getValue(CPos("B6")), CValue("11025.000000x105.000000")));
+        assert(x.setCell(CPos("A2"), "y"));
+        assert(valueMatch(x.getValue(CPos("B6")), CValue()));
+        for (auto pos: {"B3", "B4", "B5", "B6"}) {
+            auto *cell = dynamic_cast<CExprCell *>(x.getCells().find(CPos(pos).getCoords()));
+            CCycleDetectionVisitor visitor;
+            visitor.visit(cell);
+            assert(valueMatch(x.getValue(CPos(pos)), cell->getTemplate()->getRoot().evaluate(visitor)));
+            assert(valueMatch(x.getValue(CPos(pos)), cell->getTemplate()->getProgram().evaluateGeneric(visitor)));
+            visitor.leave(cell);
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that nodes are created in blocks of the arena of a template and destroyed with it.
+     */
+    static void astArenaTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        // node which counts its destructions
+        struct CountedNode : public CNumberNode {
+            CountedNode(double number, int &destroyed) : CNumberNode(number), m_destroyed(destroyed) {}
+
+            ~CountedNode() override { m_destroyed++; }
+
+            int &m_destroyed;
+        };
+        int destroyed = 0;
+        {
+            CASTArena arena;
+            for (int i = 0; i < 1000; i++) {
+                CASTNode *node = arena.create<CountedNode>(i, destroyed);
+                CCycleDetectionVisitor visitor;
+                assert(valueMatch(node->evaluate(visitor), CValue(static_cast<double>(i))));
+            }
+            assert(arena.getNodes() == 1000 && arena.getBlocks() > 1 && arena.getBlocks() < 20);
+            assert(destroyed == 0);
+        }
+        assert(destroyed == 1000);
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "2") && x.setCell(CPos("A2"), "3"));
+        CExpressionTemplate usual("=if(A1 > 1, A1 * A2 + 4, sum(A1:A2)) - (1 + 2)", x);
+        assert(usual.getArena().getBlocks() == 1);
+        // 1 + 2 is folded to a new literal, the replaced nodes stay in the arena
+        assert(usual.getArena().getNodes() == 16);
+
+        string expression = "=A1";
+        for (int i = 0; i < 500; i++) {
+            expression += " + A" + to_string(i % 2 + 1) + " * " + to_string(i);
+        }
+        CExpressionTemplate large(expression, x);
+        assert(large.getArena().getNodes() == 2001 && large.getArena().getBlocks() > 1);
+        CCycleDetectionVisitor visitor;
+        assert(valueMatch(large.getRoot().evaluate(visitor), CValue(2.0 + 2 * 62250 + 3 * 62500)));
+        assert(valueMatch(large.getProgram().evaluate(visitor), CValue(2.0 + 2 * 62250 + 3 * 62500)));
+
+        // nodes of an expression which cannot be parsed are destroyed with the arena too
+        try {
+            CExpressionTemplate invalid("=A1 + (A2 * ", x);
+            assert(false);
+        } catch (const invalid_argument &e) {
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests handles of cells in the pool - generation checks of released cells, reuse of slots and memory,
+     * deep copies of storages and pastes over the copied area.
+     */
+    static void cellPoolTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CCellPool pool;
+        CCellHandle first = pool.create<CStringCell>("first");
+        CCellHandle expression = pool.create<CExprCell>("=A1 + 1");
+        assert(first && !CCellHandle() && pool.size() == 2 && pool.getBlocks() == 2);
+        assert(pool.find(first)->toString() == CStringCell("first").toString());
+        assert(pool.find(CCellHandle()) == nullptr);
+        pool.release(first);
+        assert(pool.find(first) == nullptr && pool.size() == 1);
+        // the slot is reused with a new generation, the old handle stays invalid
+        CCellHandle second = pool.create<CStringCell>("second");
+        assert(second.index == first.index && second.generation != first.generation);
+        assert(pool.find(first) == nullptr && pool.find(second) != nullptr);
+        pool.release(first);
+        assert(pool.find(second) != nullptr && pool.size() == 2);
+        for (int i = 0; i < 1000; i++) {
+            pool.release(pool.create<CStringCell>(to_string(i)));
+        }
+        assert(pool.getBlocks() == 2 && pool.find(expression) != nullptr);
+        pool.clear();
+        assert(pool.size() == 0 && pool.find(expression) == nullptr && pool.find(second) == nullptr);
+
+        CCellStorage cells;
+        cells.set({1, 1}, cells.getPool().create<CStringCell>("x"));
+        cells.set({1, 2}, cells.getPool().create<CStringCell>("y"));
+        CCellStorage copy = cells;
+        cells.set({1, 1}, cells.getPool().create<CStringCell>("z"));
+        assert(cells.getPool().size() == 2 && copy.getPool().size() == 2);
+        assert(copy.find({1, 1})->toString() == CStringCell("x").toString());
+        assert(cells.find({1, 1})->toString() == CStringCell("z").toString());
+        cells.erase({{1, 1}, {1, 2}});
+        assert(cells.getPool().size() == 0 && copy.find({1, 2}) != nullptr);
+
+        CSpreadsheet x;
+        for (int row = 0; row < 10; row++) {
+            assert(x.setCell(CPos("A" + to_string(row)), to_string(row)));
+            assert(x.setCell(CPos("B" + to_string(row)), "=A" + to_string(row) + " * 2"));
+        }
+        // the pasted area overlaps the copied one, cells are copied before the area is deleted
+        x.copyRect(CPos("B2"), CPos("B0"), 1, 8);
+        assert(valueMatch(x.getValue(CPos("B1")), CValue(2.0)));
+        assert(valueMatch(x.getValue(CPos("B9")), CValue(18.0)));
+        assert(x.getCells().getPool().size() == 10);
+        assert(x.setCell(CPos("B9"), "5"));
+        assert(x.getCells().getPool().size() == 9 && x.getCells().find(CPos("B9").getCoords()) == nullptr);
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests copies of spreadsheets sharing tiles of numbers - writes to a copy or to the source
+     * are not visible in the other spreadsheet.
+     */
+    static void snapshotTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        x.setRangeIndex(true);
+        for (int row = 0; row < 200; row++) {
+            for (char col = 'A'; col <= 'J'; col++) {
+                assert(x.setCell(CPos(col + to_string(row)), to_string(row)));
+            }
+        }
+        assert(x.setCell(CPos("Z0"), "=sum(A0:J199)"));
+        assert(x.setCell(CPos("Z1"), "=A5 + Z0"));
+        assert(x.setCell(CPos("Z2"), "text"));
+        assert(valueMatch(x.getValue(CPos("Z0")), CValue(10.0 * 199 * 200 / 2)));
+
+        CSpreadsheet y(x);
+        // 4 tiles with numbers are shared, the tile with expressions is copied
+        assert(x.getCells().getSharedTiles() == 4 && y.getCells().getSharedTiles() == 4);
+        assert(y.setCell(CPos("A5"), "1000"));
+        assert(x.getCells().getSharedTiles() == 3 && y.getCells().getSharedTiles() == 3);
+        assert(valueMatch(x.getValue(CPos("A5")), CValue(5.0)));
+        assert(valueMatch(y.getValue(CPos("A5")), CValue(1000.0)));
+        assert(valueMatch(x.getValue(CPos("Z1")), CValue(5.0 + 10 * 199 * 200 / 2)));
+        assert(valueMatch(y.getValue(CPos("Z1")), CValue(2000.0 - 5 + 10 * 199 * 200 / 2)));
+
+        // writes to the source are not visible in the copy either
+        x.copyRect(CPos("B100"), CPos("Z2"));
+        assert(x.setCell(CPos("C150"), "=B100"));
+        assert(valueMatch(x.getValue(CPos("C150")), CValue("text")));
+        assert(valueMatch(y.getValue(CPos("C150")), CValue(150.0)));
+        assert(valueMatch(y.getValue(CPos("Z0")), CValue(995.0 + 10 * 199 * 200 / 2)));
+        assert(valueMatch(x.getValue(CPos("Z0")), CValue(10.0 * 199 * 200 / 2 - 100 - 150)));
+        assert(x.getCells().getSharedTiles() == 1 && y.getCells().getSharedTiles() == 1);
+
+        CSpreadsheet z;
+        z = y;
+        // tiles of y written by x were copied by x, so all 4 tiles of y are shared with z now
+        assert(y.getCells().getSharedTiles() == 4);
+        assert(valueMatch(z.getValue(CPos("Z1")), y.getValue(CPos("Z1"))));
+        y = CSpreadsheet();
+        assert(z.getCells().getSharedTiles() == 1);
+        assert(valueMatch(z.getValue(CPos("A5")), CValue(1000.0)));
+
+        // copies sharing tiles are written from different threads, each keeps only its own writes
+        vector<CSpreadsheet> copies(4, z);
+        vector<thread> writers;
+        for (size_t i = 0; i < copies.size(); i++) {
+            writers.emplace_back([&copies, i]() {
+                for (int row = 0; row < 200; row++) {
+                    for (char col = 'A'; col <= 'J'; col++) {
+                        assert(copies[i].setCell(CPos(col + to_string(row)), to_string(row * 10 + i)));
+                    }
+                }
+            });
+        }
+        for (auto &writer: writers) {
+            writer.join();
+        }
+        for (size_t i = 0; i < copies.size(); i++) {
+            assert(valueMatch(copies[i].getValue(CPos("J199")), CValue(1990.0 + i)));
+            assert(valueMatch(copies[i].getValue(CPos("Z0")), CValue(10 * (10.0 * 199 * 200 / 2 + 200.0 * i))));
+        }
+        assert(valueMatch(z.getValue(CPos("J199")), CValue(199.0)));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that pastes recorded by copyRect and applied later give the same values as pastes
+     * applied immediately, also when pastes overlap, copy pasted cells or are rewritten.
+     */
+    static void lazyPasteTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet lazy, eager;
+        for (auto *x: {&lazy, &eager}) {
+            for (int row = 0; row < 20; row++) {
+                assert(x->setCell(CPos("A" + to_string(row)), to_string(row)));
+                assert(x->setCell(CPos("B" + to_string(row)), "=A" + to_string(row) + " * 2 + $A$1"));
+                assert(x->setCell(CPos("C" + to_string(row)), "=sum(A0:B" + to_string(row) + ")"));
+            }
+        }
+        // destination, source, width and height of each paste
+        vector<tuple<string, string, int, int>> pastes = {{"D0",  "A0",  3,  20},
+                                                          {"D5",  "D0",  3,  10},
+                                                          {"G0",  "B0",  2,  20},
+                                                          {"G0",  "A0",  3,  20},
+                                                          {"B10", "A0",  3,  5},
+                                                          {"J0",  "D3",  4,  15},
+                                                          {"D0",  "J0",  3,  20},
+                                                          {"A30", "A0",  12, 20},
+                                                          {"A30", "C0",  12, 20}};
+        // cells written after each paste, to pending destinations, to pending sources and to copied destinations
+        vector<pair<string, string>> writes = {{"E7", "=A1 + 100"}, {"A2", "7"}, {"H3", "text"}, {"I19", "=H3"},
+                                               {"A40", "5"}, {"K4", "=E7 * 2"}, {"E2", "=J4"}, {"B35", "1"},
+                                               {"C31", "=B35"}};
+        for (size_t i = 0; i < pastes.size(); i++) {
+            const auto &[dst, src, w, h] = pastes[i];
+            lazy.copyRect(CPos(dst), CPos(src), w, h);
+            eager.copyRect(CPos(dst), CPos(src), w, h);
+            eager.getValue(CPos("A0"));
+            assert(lazy.setCell(CPos(writes[i].first), writes[i].second));
+            assert(eager.setCell(CPos(writes[i].first), writes[i].second));
+        }
+        for (int i = 0; i < 200; i++) {
+            CPos dst("N" + to_string(i % 50)), src(string(1, static_cast<char>('A' + i % 13)) + to_string(i % 37));
+            lazy.copyRect(dst, src);
+            eager.copyRect(dst, src);
+        }
+        for (int row = 0; row < 50; row++) {
+            for (char col = 'A'; col <= 'N'; col++) {
+                CPos pos(col + to_string(row));
+                assert(valueMatch(lazy.getValue(pos), eager.getValue(pos)));
+            }
+        }
+
+        // a rewritten paste whose cells are copied by a later paste is still applied
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "1") && x.setCell(CPos("A2"), "2"));
+        x.copyRect(CPos("B1"), CPos("A1"));
+        x.copyRect(CPos("C1"), CPos("B1"));
+        x.copyRect(CPos("B1"), CPos("A2"));
+        assert(valueMatch(x.getValue(CPos("B1")), CValue(2.0)));
+        assert(valueMatch(x.getValue(CPos("C1")), CValue(1.0)));
+        // copies and const operations apply pending pastes once, later reads see the pasted cells
+        x.copyRect(CPos("D1"), CPos("A1"), 1, 2);
+        assert(x.setCell(CPos("E2"), "=D2 + 1"));
+        CSpreadsheet copy(x);
+        const CSpreadsheet constant = x;
+        ostringstream oss, const_oss;
+        assert(x.save(oss) && constant.save(const_oss) && oss.str() == const_oss.str());
+        assert(x.dependentsOf(CPos("D2")).size() == 1 && x.precedentsOf(CPos("E2")).size() == 1);
+        istringstream iss(oss.str());
+        CSpreadsheet loaded;
+        assert(loaded.load(iss));
+        for (auto *spreadsheet: {&x, &copy, &loaded}) {
+            assert(valueMatch(spreadsheet->getValue(CPos("D2")), CValue(2.0)));
+        }
+        x.copyRect(CPos("F1"), CPos("D1"), 2, 2);
+        const CSpreadsheet &view = x;
+        assert(view.precedentsOf(CPos("G2")).size() == 1 && view.dependentsOf(CPos("F2")).size() == 1);
+        assert(view.dependentsOf(CPos("F2")) == view.dependentsOf(CPos("F2")));
+        assert(valueMatch(x.getValue(CPos("G2")), CValue(3.0)));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests cycle detection by stamps of visitors in cells and cycles detected when cells are set.
+     */
+    static void cycleMarksTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "=1"));
+        auto *cell = dynamic_cast<CExprCell *>(x.findCell({1, 0}));
+        assert(cell != nullptr);
+        CCycleDetectionVisitor first;
+        assert(first.visit(cell) && !first.hasCycle());
+        assert(!first.visit(cell) && first.hasCycle());
+        // a stamp left by a visitor which was not closed does not make a cycle for other visitors
+        CCycleDetectionVisitor second;
+        assert(second.visit(cell, {1, 2}));
+        assert(second.getShift() == make_pair(1, 2));
+        second.leave(cell);
+        assert(second.visit(cell) && !second.hasCycle());
+        CCycleDetectionVisitor third;
+        assert(third.reach(cell) && !third.reach(cell));
+        // a visitor reusing the shifts of a destroyed visitor starts without shifts
+        {
+            CCycleDetectionVisitor opened;
+            assert(opened.visit(cell, {3, 4}) && opened.getShift() == make_pair(3, 4));
+        }
+        CCycleDetectionVisitor reused;
+        assert(reused.getShift() == make_pair(0, 0));
+
+        // cycles are marked when the last cell of the cycle is set
+        assert(x.setCell(CPos("B1"), "=B3 + 1"));
+        assert(x.setCell(CPos("B2"), "=B1 * 2"));
+        assert(x.setCell(CPos("C1"), "=B2"));
+        assert(!x.findCell({1, 1})->isEvaluated() && !x.findCell({2, 1})->isEvaluated());
+        assert(x.setCell(CPos("B3"), "=sum(B1:B2)"));
+        // only cells on the found path are marked, B2 is found to be cyclic by evaluation
+        assert(x.findCell({3, 1})->isEvaluated() && x.findCell({1, 1})->isEvaluated());
+        assert(!x.findCell({2, 1})->isEvaluated() && !x.findCell({1, 2})->isEvaluated());
+        assert(valueMatch(x.getValue(CPos("B2")), CValue()));
+        assert(valueMatch(x.getValue(CPos("C1")), CValue()));
+        assert(x.setCell(CPos("B3"), "5"));
+        assert(valueMatch(x.getValue(CPos("C1")), CValue(12.0)));
+
+        // conditional cycles are left for evaluation
+        assert(x.setCell(CPos("D1"), "=if(D3 > 0, D2, 7)"));
+        assert(x.setCell(CPos("D2"), "=D1 + 1"));
+        assert(x.setCell(CPos("D3"), "0"));
+        assert(!x.findCell({1, 3})->isEvaluated());
+        assert(valueMatch(x.getValue(CPos("D2")), CValue(8.0)));
+        assert(x.setCell(CPos("D3"), "1"));
+        assert(valueMatch(x.getValue(CPos("D2")), CValue()));
+
+        // cycles longer than the searched part of the graph are found by evaluation
+        CSpreadsheet y;
+        const int length = 1000;
+        for (int row = 1; row < length; row++) {
+            assert(y.setCell(CPos("A" + to_string(row)), "=A" + to_string(row - 1) + " + 1"));
+        }
+        assert(y.setCell(CPos("A0"), "=A" + to_string(length - 1)));
+        assert(!y.findCell({0, 0})->isEvaluated());
+        assert(valueMatch(y.getValue(CPos("A0")), CValue()));
+        assert(y.setCell(CPos("A0"), "1"));
+        assert(valueMatch(y.getValue(CPos("A" + to_string(length - 1))), CValue(double(length))));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests that cycles found by evaluation and expressions that cannot be parsed give undefined values
+     * or texts of the expressions, and that values evaluated after a cycle was found are not cached.
+     */
+    static void errorValuesTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        assert(x.setCell(CPos("A1"), "=if($Z$1 > 0, A2, 1)"));
+        assert(x.setCell(CPos("A2"), "=A1 + 1"));
+        assert(x.setCell(CPos("A3"), "=A2 * 2"));
+        assert(x.setCell(CPos("B1"), "=5"));
+        assert(x.setCell(CPos("B2"), "=sum(B1:B1) + A3"));
+        assert(x.setCell(CPos("Z1"), "1"));
+        assert(valueMatch(x.getValue(CPos("B2")), CValue()));
+        assert(valueMatch(x.getValue(CPos("A3")), CValue()));
+        // cells evaluated before the cycle was found keep their values, the others are evaluated again
+        assert(x.findCell({1, 1})->isEvaluated());
+        for (const auto &coords: vector<pair<int, int>>{{1, 0}, {2, 0}, {3, 0}, {2, 1}}) {
+            assert(!x.findCell(coords)->isEvaluated());
+        }
+        assert(x.setCell(CPos("Z1"), "0"));
+        assert(valueMatch(x.getValue(CPos("B2")), CValue(9.0)));
+        assert(valueMatch(x.getValue(CPos("A3")), CValue(4.0)));
+
+        // cells that cannot be parsed evaluate to their text
+        for (int row = 0; row < 100; row++) {
+            assert(x.setCell(CPos("C" + to_string(row)), "=A1 +* 2"));
+            assert(valueMatch(x.getValue(CPos("C" + to_string(row))), CValue("=A1 +* 2")));
+        }
+        assert(x.getExpressionCache().getMisses() == 6);
+        assert(x.setCell(CPos("D1"), "=C1"));
+        assert(valueMatch(x.getValue(CPos("D1")), CValue("=A1 +* 2")));
+
+        // contents starting by a number are numbers
+        assert(x.setCell(CPos("E1"), " 12abc") && x.setCell(CPos("E2"), "abc") && x.setCell(CPos("E3"), "1e999"));
+        assert(valueMatch(x.getValue(CPos("E1")), CValue(12.0)));
+        assert(valueMatch(x.getValue(CPos("E2")), CValue("abc")));
+        assert(valueMatch(x.getValue(CPos("E3")), CValue(HUGE_VAL)));
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests saving and loading in the binary format - exact numbers, any bytes in strings, shifted expressions,
+     * several blocks of cells, damaged data and loading of mapped files in both formats.
+     */
+    static void binaryFormatTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        const int rows = 70000;
+        for (int row = 0; row < rows; row++) {
+            assert(x.setCell(CPos(row, 0), to_string(row)));
+        }
+        assert(x.setCell(CPos("B0"), "0.1"));
+        assert(x.setCell(CPos("B1"), "0.333333333333333314829616256247"));
+        assert(x.setCell(CPos("B2"), "=A1 / 3"));
+        assert(x.setCell(CPos("B3"), string("a,1;\n\0\"b", 8)));
+        assert(x.setCell(CPos("B4"), ""));
+        assert(x.setCell(CPos("ZZ1000000"), "=sum(A0:A" + to_string(rows - 1) + ") + $B$0"));
+        x.copyRect(CPos("B5"), CPos("B2"));
+
+        ostringstream binary, text;
+        assert(x.save(binary, CLoader::BINARY) && x.save(text));
+        assert(binary.str().size() < text.str().size());
+        auto file = filesystem::temp_directory_path() / "pa2_binary_format_test.bin";
+        CSpreadsheet loaded, mapped, mapped_text;
+        istringstream iss(binary.str());
+        assert(loaded.load(iss));
+        ofstream(file, ios::binary) << binary.str();
+        assert(mapped.loadFile(file));
+        ofstream(file, ios::binary) << text.str();
+        assert(mapped_text.loadFile(file));
+        for (auto *spreadsheet: {&loaded, &mapped, &mapped_text}) {
+            assert(valueMatch(spreadsheet->getValue(CPos("A69999")), CValue(69999.0)));
+            assert(valueMatch(spreadsheet->getValue(CPos("B2")), CValue(1.0 / 3)));
+            assert(valueMatch(spreadsheet->getValue(CPos("B3")), CValue(string("a,1;\n\0\"b", 8))));
+            assert(valueMatch(spreadsheet->getValue(CPos("B4")), CValue("")));
+            assert(valueMatch(spreadsheet->getValue(CPos("B5")), CValue(4.0 / 3)));
+            assert(valueMatch(spreadsheet->getValue(CPos("ZZ1000000")), CValue(rows / 2.0 * (rows - 1) + 0.1)));
+        }
+        assert(get<double>(loaded.getValue(CPos("B1"))) == 1.0 / 3 && get<double>(mapped.getValue(CPos("B0"))) == 0.1);
+        // numbers are saved exactly only in the binary format
+        assert(get<double>(mapped_text.getValue(CPos("B1"))) != 1.0 / 3);
+
+        // a loader writes the cells once on each save
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            ostringstream once, twice;
+            assert(CLoader(once).save(mapped.getCells(), format));
+            CLoader loader(twice);
+            assert(loader.save(mapped.getCells(), format) && loader.save(mapped.getCells(), format));
+            assert(twice.str() == once.str() + once.str());
+        }
+
+        // damaged, truncated or unknown files are not loaded and the spreadsheet is not changed,
+        // text truncated inside a cell stops parsing before the cell is created
+        string data = binary.str();
+        vector<string> damaged = {data.substr(0, data.size() - 1), data + "x", data, data,
+                                  text.str().substr(0, text.str().rfind('\n', text.str().size() - 2) + 3)};
+        damaged[2][data.size() / 2] ^= 1;
+        damaged[3][8] = 4;
+        for (const auto &contents: damaged) {
+            istringstream damaged_iss(contents);
+            assert(!loaded.load(damaged_iss));
+        }
+        assert(!loaded.loadFile(file.string() + ".missing"));
+        assert(valueMatch(loaded.getValue(CPos("B3")), CValue(string("a,1;\n\0\"b", 8))));
+        filesystem::remove(file);
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests loading of streams in chunks - cells split between chunks, large strings, damaged data at the end
+     * of long streams and that the target container is not changed when the loading fails.
+     */
+    static void streamingLoadTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CSpreadsheet x;
+        const int rows = 20000;
+        for (int row = 0; row < rows; row++) {
+            assert(x.setCell(CPos(row, 0), string(row % 50, ';') + "," + to_string(row) + "\n"));
+            assert(x.setCell(CPos(row, 1), to_string(row) + ".5"));
+            assert(x.setCell(CPos(row, 2), "=B" + to_string(row) + " * 2"));
+        }
+        string large(3 << 20, 'x');
+        assert(x.setCell(CPos("D1"), large));
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            ostringstream oss;
+            assert(x.save(oss, format));
+            istringstream iss(oss.str());
+            CSpreadsheet loaded;
+            assert(loaded.load(iss));
+            for (int row = 0; row < rows; row += 997) {
+                assert(valueMatch(loaded.getValue(CPos(row, 0)), CValue(string(row % 50, ';') + "," + to_string(row) + "\n")));
+                assert(valueMatch(loaded.getValue(CPos(row, 2)), CValue(row * 2 + 1.0)));
+            }
+            assert(valueMatch(loaded.getValue(CPos("D1")), CValue(large)));
+
+            // damaged last byte is found when the last block is read
+            string damaged = oss.str();
+            damaged.back() ^= 1;
+            istringstream damaged_iss(damaged);
+            assert(!loaded.load(damaged_iss));
+            assert(valueMatch(loaded.getValue(CPos("D1")), CValue(large)));
+
+            CCellStorage cells;
+            cells.set({0, 0}, cells.getPool().create<CStringCell>("kept"));
+            istringstream loader_iss(damaged);
+            assert(!CLoader(loader_iss).load(cells));
+            assert(cells.getPool().size() == 1 && cells.find({0, 0}) != nullptr && cells.find({1, 0}) == nullptr);
+        }
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests checksums of blocks - known checksums of all implementations, damaged blocks found in streams
+     * and in mapped files checked in parallel, and loading of old files verified by a hash.
+     */
+    static void checksumTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        string data(5 * CChecksum::BLOCK_SIZE + 123, '\0');
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<char>(i * 7919 >> 3);
+        }
+        auto original = CChecksum::implementation();
+        vector<uint32_t> expected;
+        for (auto implementation: CChecksum::supported()) {
+            assert(CChecksum::use(implementation));
+            assert(CChecksum::update(0, "123456789") == 0xE3069283 && CChecksum::update(0, "") == 0);
+            assert(CChecksum::update(CChecksum::update(0, "12345"), "6789") == 0xE3069283);
+            auto checksums = CChecksum::computeBlocks(data);
+            assert(checksums.size() == 6 && (expected.empty() || checksums == expected));
+            expected = checksums;
+        }
+        assert(CChecksum::use(original));
+        CThreadPool pool(4);
+        assert(CChecksum::computeBlocks(data, &pool) == expected);
+        assert(!CChecksum::findDamaged(data, expected, &pool));
+        data[3 * CChecksum::BLOCK_SIZE + 5] ^= 1;
+        assert(CChecksum::findDamaged(data, expected, &pool) == 3);
+        assert(CChecksum::findDamaged(data.substr(0, 2 * CChecksum::BLOCK_SIZE), expected) == 2);
+
+        CSpreadsheet x;
+        for (int row = 0; row < 30000; row++) {
+            assert(x.setCell(CPos(row, 0), "text " + to_string(row)));
+            assert(x.setCell(CPos(row, 1), "=A" + to_string(row)));
+        }
+        auto file = filesystem::temp_directory_path() / "pa2_checksum_test.bin";
+        // data of the text format follow three header lines
+        auto text_offset = [](const string &saved) {
+            size_t offset = 0;
+            for (int line = 0; line < 3; line++) {
+                offset = saved.find('\n', offset) + 1;
+            }
+            return offset;
+        };
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            ostringstream oss;
+            assert(x.save(oss, format));
+            string saved = oss.str();
+            // data follow the header and the checksum table
+            size_t offset;
+            if (format == CLoader::TEXT) {
+                assert(saved.starts_with("#crc32c "));
+                offset = text_offset(saved);
+            } else {
+                uint64_t size;
+                memcpy(&size, saved.data() + 16, sizeof(size));
+                offset = saved.size() - size;
+            }
+            assert(saved.size() - offset > 4 * CChecksum::BLOCK_SIZE);
+
+            string damaged = saved;
+            damaged[offset + 2 * CChecksum::BLOCK_SIZE + 10] ^= 1;
+            CCellStorage cells;
+            istringstream iss(damaged);
+            CLoader loader(iss);
+            assert(!loader.load(cells) && loader.getDamagedBlock() == 2 && cells.getPool().size() == 0);
+            istringstream truncated(saved.substr(0, saved.size() - 1));
+            CLoader truncated_loader(truncated);
+            assert(!truncated_loader.load(cells));
+            assert(truncated_loader.getDamagedBlock() == CChecksum::blockCount(saved.size() - offset) - 1);
+
+            ofstream(file, ios::binary) << damaged;
+            CLoader file_loader(file.string());
+            file_loader.setThreadPool(&pool);
+            assert(!file_loader.load(cells) && file_loader.getDamagedBlock() == 2);
+            ofstream(file, ios::binary) << saved;
+            assert(file_loader.load(cells) && !file_loader.getDamagedBlock());
+            assert(cells.find({29999, 0}) != nullptr);
+
+            // damaged header or table is found, but no block is damaged
+            damaged = saved;
+            damaged[offset - 2] ^= 1;
+            istringstream damaged_table(damaged);
+            CLoader table_loader(damaged_table);
+            assert(!table_loader.load(cells) && !table_loader.getDamagedBlock());
+        }
+
+        // files saved with a hash of all data are loaded too
+        ostringstream text, binary;
+        assert(x.save(text) && x.save(binary, CLoader::BINARY));
+        string text_data = text.str().substr(text_offset(text.str()));
+        string hash = to_string(CHashingReader::hash(CHashingReader::INITIAL_HASH, text_data));
+        string old_text = string(20 - hash.size(), '0') + hash + text_data;
+        uint64_t size;
+        memcpy(&size, binary.str().data() + 16, sizeof(size));
+        // the only partition starts by the number of blocks, which is in the header of old files
+        string binary_data = binary.str().substr(binary.str().size() - size);
+        uint32_t version = 1;
+        uint64_t binary_hash = CHashingReader::hash(CHashingReader::INITIAL_HASH, binary_data.substr(4));
+        string old_binary = binary.str().substr(0, 8) + string(reinterpret_cast<const char *>(&version), 4)
+                            + binary_data.substr(0, 4) + string(reinterpret_cast<const char *>(&binary_hash), 8)
+                            + binary_data.substr(4);
+        for (const auto &old: {old_text, old_binary}) {
+            CSpreadsheet loaded, mapped;
+            istringstream iss(old);
+            assert(loaded.load(iss));
+            ofstream(file, ios::binary) << old;
+            assert(mapped.loadFile(file));
+            for (auto *spreadsheet: {&loaded, &mapped}) {
+                assert(valueMatch(spreadsheet->getValue(CPos("B29999")), CValue(string("text 29999"))));
+            }
+            string damaged = old;
+            damaged[old.size() / 2] ^= 1;
+            istringstream damaged_iss(damaged);
+            assert(!loaded.load(damaged_iss));
+        }
+        filesystem::remove(file);
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
+    /**
+     * Tests partitions of saved cells - merging of pools and storages, splitting of rows, the same files
+     * saved by any number of threads, parallel loading of streams and files and loading of files without partitions.
+     */
+    static void partitionTest() {
+        cout << '\n' << __func__ << " -> START" << endl;
+
+        CCellPool pool, other;
+        auto kept = pool.create<CStringCell>("kept");
+        auto released = pool.create<CStringCell>("released");
+        pool.release(released);
+        auto moved = other.create<CStringCell>("moved");
+        uint32_t offset = pool.merge(std::move(other));
+        assert(pool.size() == 2 && other.size() == 0 && offset == 2);
+        assert(pool.find(kept)->toString() == CStringCell("kept").toString());
+        assert(pool.find({moved.index + offset, moved.generation})->toString() == CStringCell("moved").toString());
+        auto created = pool.create<CStringCell>("created");
+        assert(pool.size() == 3 && pool.find(created) != nullptr && pool.getBlocks() == 2);
+
+        CCellStorage storage, part;
+        storage.setRangeIndex(true);
+        storage.setNumber({0, 0}, 1);
+        storage.set({1, 1}, storage.getPool().create<CStringCell>("first"));
+        part.set({1, 1}, part.getPool().create<CStringCell>("second"));
+        part.setNumber({2, 0}, 2);
+        part.setNumber({100, 0}, 3);
+        part.set({100, 1}, part.getPool().create<CExprCell>("=A101"));
+        storage.merge(std::move(part));
+        assert(part.empty() && storage.size() == 5 && storage.getPool().size() == 2);
+        assert(storage.find({1, 1})->toString() == CStringCell("second").toString() && storage.find({100, 1}) != nullptr);
+        storage.refreshIndexes();
+        CNumberAggregate aggregate;
+        assert(storage.aggregate({{0, 0}, {100, 0}}, aggregate) && aggregate.sum == 6 && aggregate.count == 3);
+
+        CSpreadsheet x;
+        const int rows = 80000;
+        for (int row = 0; row < rows; row++) {
+            assert(x.setCell(CPos(row, 0), to_string(row) + ".5"));
+            assert(x.setCell(CPos(row, 1), "text " + to_string(row)));
+            assert(x.setCell(CPos(row, 2), "=A" + to_string(row) + " * 2"));
+        }
+        assert(x.setCell(CPos(1000000, 0), "=sum(A0:A" + to_string(rows - 1) + ")"));
+        double sum = (rows - 1.0) * rows / 2 + rows * 0.5;
+
+        // whole tile rows with about the given number of cells, from the top
+        istringstream binary_iss([&x]() {
+            ostringstream oss;
+            assert(x.save(oss, CLoader::BINARY));
+            return oss.str();
+        }());
+        CCellStorage loaded_cells;
+        assert(CLoader(binary_iss).load(loaded_cells));
+        auto ranges = loaded_cells.partitionRows(CPartitions::PARTITION_CELLS);
+        assert(ranges.size() == 4 && ranges.front().first == 0 && ranges.back().second == 1000000 / 64 * 64 + 63);
+        for (size_t i = 0; i < ranges.size(); i++) {
+            assert(ranges[i].first % 64 == 0 && ranges[i].second % 64 == 63 && ranges[i].first <= ranges[i].second);
+            assert(i == 0 || ranges[i - 1].second < ranges[i].first);
+        }
+
+        auto file = filesystem::temp_directory_path() / "pa2_partition_test.bin";
+        for (auto format: {CLoader::TEXT, CLoader::BINARY}) {
+            ostringstream single, parallel;
+            x.setThreadCount(1);
+            assert(x.save(single, format));
+            x.setThreadCount(4);
+            assert(x.save(parallel, format));
+            assert(single.str() == parallel.str());
+
+            CSpreadsheet loaded, mapped;
+            loaded.setThreadCount(4);
+            mapped.setThreadCount(3);
+            mapped.setRangeIndex(true);
+            istringstream iss(parallel.str());
+            assert(loaded.load(iss));
+            ofstream(file, ios::binary) << parallel.str();
+            assert(mapped.loadFile(file));
+            for (auto *spreadsheet: {&loaded, &mapped}) {
+                for (int row = 0; row < rows; row += 4999) {
+                    assert(valueMatch(spreadsheet->getValue(CPos(row, 1)), CValue("text " + to_string(row))));
+                    assert(valueMatch(spreadsheet->getValue(CPos(row, 2)), CValue(row * 2 + 1.0)));
+                }
+                assert(valueMatch(spreadsheet->getValue(CPos(1000000, 0)), CValue(sum)));
+            }
+
+            // a damaged partition is not merged and the loaded spreadsheet is not changed
+            string damaged = parallel.str();
+            damaged[damaged.size() - 100000] ^= 1;
+            istringstream damaged_iss(damaged);
+            assert(!loaded.load(damaged_iss));
+            assert(valueMatch(loaded.getValue(CPos(rows - 1, 1)), CValue("text " + to_string(rows - 1))));
+        }
+
+        // const spreadsheets are saved from several threads at once, the runs of the pool are serialized
+        x.copyRect(CPos(rows, 0), CPos(0, 0), 3, 100);
+        const CSpreadsheet &shared = x;
+        vector<string> saves(4);
+        vector<thread> savers;
+        for (size_t i = 0; i < saves.size(); i++) {
+            savers.emplace_back([&shared, &saves, i]() {
+                ostringstream oss;
+                assert(shared.save(oss, i % 2 == 0 ? CLoader::TEXT : CLoader::BINARY));
+                saves[i] = oss.str();
+            });
+        }
+        for (auto &saver: savers) {
+            saver.join();
+        }
+        assert(saves[0] == saves[2] && saves[1] == saves[3]);
+        assert(valueMatch(x.getValue(CPos(rows + 99, 2)), CValue(99 * 2 + 1.0)));
+
+        // text files without the partition index are loaded in one thread
+        ostringstream text;
+        assert(x.save(text));
+        string saved = text.str();
+        size_t table_end = saved.find('\n', saved.find('\n') + 1);
+        string table = saved.substr(saved.find('\n') + 1, table_end - saved.find('\n') - 1);
+        char checksum[9];
+        snprintf(checksum, sizeof(checksum), "%08x", CChecksum::update(0, table));
+        string header = saved.substr(0, saved.find(' ', 8) + 1) + checksum + '\n';
+        string unpartitioned = header + table + '\n' + saved.substr(saved.find('\n', table_end + 1) + 1);
+        CSpreadsheet loaded;
+        loaded.setThreadCount(4);
+        istringstream iss(unpartitioned);
+        assert(loaded.load(iss));
+        assert(valueMatch(loaded.getValue(CPos(1000000, 0)), CValue(sum)));
+        filesystem::remove(file);
+
+        cout << __func__ << " ->    OK" << '\n' << endl;
+    }
+
 };
 
 #endif //PA2_BIG_TASK_CTESTER_H